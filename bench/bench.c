@@ -5,52 +5,370 @@
 #include "utf8proc.h"
 #include "util.h"
 
-int main(int argc, char **argv)
+/* an input and the preallocated buffers that the operations work in, so
+   that no allocation is timed */
+typedef struct {
+	 const uint8_t *src;
+	 utf8proc_ssize_t len;
+	 utf8proc_int32_t *nfd;        /* src decomposed, input of normalize */
+	 utf8proc_ssize_t nfdlen;
+	 utf8proc_int32_t *nfc;        /* src normalized, input of reencode */
+	 utf8proc_ssize_t nfclen;
+	 utf8proc_int32_t *buffer;     /* scratch codepoints */
+	 utf8proc_ssize_t buffersize;
+	 uint8_t *out;                 /* scratch UTF-8 */
+	 utf8proc_ssize_t outsize;
+} bench_input;
+
+/* the results of the operations end up here, so that they are not
+   optimized away, and are checked for errors once before timing */
+static volatile utf8proc_ssize_t sink;
+
+/* added to the options of decompose and the normalization forms, for
+   -prevalidated */
+static utf8proc_option_t extra_options = 0;
+
+static void op_iterate(void *data)
 {
-	 int i, j;
-	 int options = 0;
-	 
-	 for (i = 1; i < argc; ++i) {
-		  if (!strcmp(argv[i], "-nfkc")) {
-			   options |= UTF8PROC_STABLE|UTF8PROC_COMPOSE|UTF8PROC_COMPAT;
-			   continue;
+	 bench_input *in = (bench_input *) data;
+	 utf8proc_ssize_t pos = 0, sum = 0;
+	 utf8proc_int32_t cp;
+	 while (pos < in->len) {
+		  utf8proc_ssize_t n = utf8proc_iterate(in->src + pos, in->len - pos, &cp);
+		  if (n < 0) {
+			   sink = n;
+			   return;
 		  }
-		  if (!strcmp(argv[i], "-nfkd")) {
-			   options |= UTF8PROC_STABLE|UTF8PROC_DECOMPOSE|UTF8PROC_COMPAT;
+		  pos += n;
+		  sum += cp;
+	 }
+	 sink = sum;
+}
+
+static void op_validate(void *data)
+{
+	 bench_input *in = (bench_input *) data;
+	 sink = utf8proc_validate(in->src, in->len, NULL);
+}
+
+static void op_decompose(void *data)
+{
+	 bench_input *in = (bench_input *) data;
+	 sink = utf8proc_decompose(in->src, in->len, in->buffer, in->buffersize,
+							   UTF8PROC_STABLE | UTF8PROC_DECOMPOSE | extra_options);
+}
+
+/* normalize_utf32 and reencode work in place, so they start with a copy
+   of their input, which costs a small fraction of their own time */
+static void op_normalize(void *data)
+{
+	 bench_input *in = (bench_input *) data;
+	 memcpy(in->buffer, in->nfd, in->nfdlen * sizeof(utf8proc_int32_t));
+	 sink = utf8proc_normalize_utf32(in->buffer, in->nfdlen, UTF8PROC_STABLE | UTF8PROC_COMPOSE);
+}
+
+static void op_reencode(void *data)
+{
+	 bench_input *in = (bench_input *) data;
+	 memcpy(in->buffer, in->nfc, in->nfclen * sizeof(utf8proc_int32_t));
+	 sink = utf8proc_reencode(in->buffer, in->nfclen, UTF8PROC_STABLE);
+}
+
+static void map_buffer(bench_input *in, utf8proc_option_t options)
+{
+	 sink = utf8proc_map_buffer(in->src, in->len, in->out, in->outsize, options | extra_options);
+	 if (sink >= in->outsize) sink = UTF8PROC_ERROR_OVERFLOW;
+}
+
+static void op_nfc(void *data)
+{
+	 map_buffer((bench_input *) data, UTF8PROC_STABLE | UTF8PROC_COMPOSE);
+}
+
+static void op_nfd(void *data)
+{
+	 map_buffer((bench_input *) data, UTF8PROC_STABLE | UTF8PROC_DECOMPOSE);
+}
+
+static void op_nfkc(void *data)
+{
+	 map_buffer((bench_input *) data, UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_COMPAT);
+}
+
+static void op_nfkd(void *data)
+{
+	 map_buffer((bench_input *) data, UTF8PROC_STABLE | UTF8PROC_DECOMPOSE | UTF8PROC_COMPAT);
+}
+
+static void op_nfkc_casefold(void *data)
+{
+	 map_buffer((bench_input *) data, UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_COMPAT |
+				UTF8PROC_CASEFOLD | UTF8PROC_IGNORE | UTF8PROC_STRIPNA);
+}
+
+/* NFC without a copy of input that is already normalized */
+static void op_nfc_borrow(void *data)
+{
+	 bench_input *in = (bench_input *) data;
+	 uint8_t *out;
+	 sink = utf8proc_map_borrow(in->src, in->len, &out, UTF8PROC_STABLE | UTF8PROC_COMPOSE |
+								extra_options, NULL, NULL, NULL);
+	 free(out);
+}
+
+/* NFC over a copy of the input, including the time of the copy */
+static void op_nfc_inplace(void *data)
+{
+	 bench_input *in = (bench_input *) data;
+	 memcpy(in->out, in->src, in->len);
+	 sink = utf8proc_map_inplace(in->out, in->len, in->outsize, UTF8PROC_STABLE | UTF8PROC_COMPOSE |
+								 extra_options);
+	 if (sink > in->outsize) sink = UTF8PROC_ERROR_OVERFLOW;
+}
+
+/* NFC into the buffers of a context that is kept across runs */
+static void op_nfc_ctx(void *data)
+{
+	 static utf8proc_context_t *context = NULL;
+	 bench_input *in = (bench_input *) data;
+	 const uint8_t *out;
+	 if (!context && (sink = utf8proc_context_new(&context, NULL)) < 0) return;
+	 sink = utf8proc_map_custom_ctx(context, in->src, in->len, &out, UTF8PROC_STABLE | UTF8PROC_COMPOSE |
+									extra_options, NULL, NULL);
+}
+
+static void op_casefold(void *data)
+{
+	 bench_input *in = (bench_input *) data;
+	 sink = utf8proc_casefold_utf8(in->src, in->len, in->out, in->outsize);
+	 if (sink >= in->outsize) sink = UTF8PROC_ERROR_OVERFLOW;
+}
+
+static void op_graphemes(void *data)
+{
+	 bench_input *in = (bench_input *) data;
+	 utf8proc_grapheme_iterator_t iter;
+	 utf8proc_ssize_t end, n = 0;
+	 utf8proc_grapheme_init(&iter, in->src, in->len);
+	 while ((end = utf8proc_grapheme_next(&iter)) > 0) ++n;
+	 sink = end < 0 ? end : n;
+}
+
+static void op_words(void *data)
+{
+	 bench_input *in = (bench_input *) data;
+	 utf8proc_segment_iterator_t iter;
+	 utf8proc_ssize_t end, n = 0;
+	 utf8proc_word_init(&iter, in->src, in->len);
+	 while ((end = utf8proc_word_next(&iter)) > 0) ++n;
+	 sink = end < 0 ? end : n;
+}
+
+static void op_sentences(void *data)
+{
+	 bench_input *in = (bench_input *) data;
+	 utf8proc_segment_iterator_t iter;
+	 utf8proc_ssize_t end, n = 0;
+	 utf8proc_sentence_init(&iter, in->src, in->len);
+	 while ((end = utf8proc_sentence_next(&iter)) > 0) ++n;
+	 sink = end < 0 ? end : n;
+}
+
+static void op_charwidth(void *data)
+{
+	 bench_input *in = (bench_input *) data;
+	 utf8proc_ssize_t i, width = 0;
+	 for (i = 0; i < in->nfclen; ++i) width += utf8proc_charwidth(in->nfc[i]);
+	 sink = width;
+}
+
+static void op_strwidth(void *data)
+{
+	 bench_input *in = (bench_input *) data;
+	 sink = utf8proc_strwidth(in->src, in->len);
+}
+
+static const struct {
+	 const char *name;
+	 void (*func)(void *data);
+} ops[] = {
+	 {"iterate", op_iterate},
+	 {"validate", op_validate},
+	 {"decompose", op_decompose},
+	 {"normalize_utf32", op_normalize},
+	 {"reencode", op_reencode},
+	 {"nfc", op_nfc},
+	 {"nfd", op_nfd},
+	 {"nfkc", op_nfkc},
+	 {"nfkd", op_nfkd},
+	 {"nfkc_casefold", op_nfkc_casefold},
+	 {"nfc_borrow", op_nfc_borrow},
+	 {"nfc_inplace", op_nfc_inplace},
+	 {"nfc_ctx", op_nfc_ctx},
+	 {"casefold", op_casefold},
+	 {"graphemes", op_graphemes},
+	 {"words", op_words},
+	 {"sentences", op_sentences},
+	 {"charwidth", op_charwidth},
+	 {"strwidth", op_strwidth},
+};
+#define NOPS (sizeof(ops) / sizeof(ops[0]))
+
+/* run the selected operations on src[0..len), in buffers sized for it */
+static int bench_input_run(const bench_settings *settings, const int *selected,
+						   const char *name, const uint8_t *src, size_t len)
+{
+	 bench_input in;
+	 size_t i, codepoints = count_codepoints(src, len);
+	 utf8proc_ssize_t longest;
+	 int ok = 1;
+	 in.src = src;
+	 in.len = (utf8proc_ssize_t) len;
+	 /* the longest of the results, decomposed with everything */
+	 longest = utf8proc_decompose(src, len, NULL, 0, UTF8PROC_STABLE | UTF8PROC_DECOMPOSE |
+								  UTF8PROC_COMPAT | UTF8PROC_CASEFOLD);
+	 if (longest < 0) {
+		  fprintf(stderr, "%s: %s\n", name, utf8proc_errmsg(longest));
+		  return 0;
+	 }
+	 in.buffersize = longest + 1;
+	 in.outsize = 4 * longest + 1;
+	 in.nfd = (utf8proc_int32_t *) malloc(in.buffersize * sizeof(utf8proc_int32_t));
+	 in.nfc = (utf8proc_int32_t *) malloc(in.buffersize * sizeof(utf8proc_int32_t));
+	 in.buffer = (utf8proc_int32_t *) malloc(in.buffersize * sizeof(utf8proc_int32_t));
+	 in.out = (uint8_t *) malloc(in.outsize);
+	 if (!in.nfd || !in.nfc || !in.buffer || !in.out) {
+		  fprintf(stderr, "out of memory\n");
+		  exit(EXIT_FAILURE);
+	 }
+	 in.nfdlen = utf8proc_decompose(src, len, in.nfd, in.buffersize,
+									UTF8PROC_STABLE | UTF8PROC_DECOMPOSE);
+	 memcpy(in.nfc, in.nfd, in.nfdlen * sizeof(utf8proc_int32_t));
+	 in.nfclen = utf8proc_normalize_utf32(in.nfc, in.nfdlen, UTF8PROC_STABLE | UTF8PROC_COMPOSE);
+
+	 for (i = 0; i < NOPS; ++i) {
+		  if (!selected[i]) continue;
+		  ops[i].func(&in);
+		  if (sink < 0) {
+			   fprintf(stderr, "%s: %s: %s\n", name, ops[i].name, utf8proc_errmsg(sink));
+			   ok = 0;
 			   continue;
 		  }
-		  if (!strcmp(argv[i], "-nfc")) {
-			   options |= UTF8PROC_STABLE|UTF8PROC_COMPOSE;
+		  bench_report(settings, "utf8proc", ops[i].name, name, len, codepoints, ops[i].func, &in);
+	 }
+	 free(in.nfd);
+	 free(in.nfc);
+	 free(in.buffer);
+	 free(in.out);
+	 return ok;
+}
+
+/* replace *src by its NFD, so that the normalization forms that compose
+   have to do all the work */
+static int predecompose(uint8_t **src, size_t *len)
+{
+	 uint8_t *nfd;
+	 utf8proc_ssize_t nfdlen = utf8proc_map(*src, *len, &nfd, UTF8PROC_STABLE | UTF8PROC_DECOMPOSE);
+	 if (nfdlen < 0) return 0;
+	 free(*src);
+	 *src = nfd;
+	 *len = (size_t) nfdlen;
+	 return 1;
+}
+
+static void usage(void)
+{
+	 size_t i;
+	 fprintf(stderr, "usage: bench [-json] [-runs N] [-warmup N] [-synthetic] [-predecompose]\n"
+			 "             [-prevalidated] [-op NAME]... [file]...\n"
+			 "operations (default: all):");
+	 for (i = 0; i < NOPS; ++i) fprintf(stderr, " %s", ops[i].name);
+	 fprintf(stderr, "\nsynthetic corpora:");
+	 for (i = 0; synthetic_corpora[i]; ++i) fprintf(stderr, " %s", synthetic_corpora[i]);
+	 fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv)
+{
+	 int i;
+	 size_t j;
+	 bench_settings settings;
+	 int selected[NOPS] = {0};
+	 int any_selected = 0, predecomposed = 0, inputs = 0, ok = 1;
+
+	 bench_init(&settings);
+	 for (i = 1; i < argc; ++i) {
+		  const char *op = NULL;
+		  if (bench_option(&settings, argc, argv, &i)) continue;
+		  /* shorthands of -op, from the single map timing this replaces */
+		  if (!strcmp(argv[i], "-nfc") || !strcmp(argv[i], "-nfd") ||
+			  !strcmp(argv[i], "-nfkc") || !strcmp(argv[i], "-nfkd") ||
+			  !strcmp(argv[i], "-casefold")) {
+			   op = argv[i] + 1;
+		  } else if (!strcmp(argv[i], "-op") && i + 1 < argc) {
+			   op = argv[++i];
+		  } else if (!strcmp(argv[i], "-predecompose")) {
+			   predecomposed = 1;
 			   continue;
-		  }
-		  if (!strcmp(argv[i], "-nfd")) {
-			   options |= UTF8PROC_STABLE|UTF8PROC_DECOMPOSE;
+		  } else if (!strcmp(argv[i], "-prevalidated")) {
+			   extra_options = UTF8PROC_PREVALIDATED;
 			   continue;
-		  }
-		  if (!strcmp(argv[i], "-casefold")) {
-			   options |= UTF8PROC_CASEFOLD;
+		  } else if (argv[i][0] == '-') {
+			   fprintf(stderr, "unrecognized option: %s\n", argv[i]);
+			   usage();
+			   return EXIT_FAILURE;
+		  } else {
 			   continue;
 		  }
-		  if (argv[i][0] == '-') {
-			   fprintf(stderr, "unrecognized option: %s\n", argv[i]);
+		  for (j = 0; j < NOPS && strcmp(ops[j].name, op); ++j);
+		  if (j == NOPS) {
+			   fprintf(stderr, "unknown operation: %s\n", op);
+			   usage();
 			   return EXIT_FAILURE;
 		  }
+		  selected[j] = any_selected = 1;
+	 }
+	 if (!any_selected)
+		  for (j = 0; j < NOPS; ++j) selected[j] = 1;
 
+	 /* the files, after all options have been read */
+	 for (i = 1; i < argc; ++i) {
+		  if (argv[i][0] == '-') {
+			   if (!strcmp(argv[i], "-op") || !strcmp(argv[i], "-runs") ||
+				   !strcmp(argv[i], "-warmup")) ++i;
+			   continue;
+		  }
 		  size_t len;
 		  uint8_t *src = readfile(argv[i], &len);
 		  if (!src) {
 			   fprintf(stderr, "error reading %s\n", argv[i]);
 			   return EXIT_FAILURE;
 		  }
-		  uint8_t *dest;
-		  mytime start = gettime();
-		  for (j = 0; j < 100; ++j) {
-			   utf8proc_map(src, len, &dest, options);
-			   free(dest);
+		  if (predecomposed && !predecompose(&src, &len)) {
+			   fprintf(stderr, "error decomposing %s\n", argv[i]);
+			   return EXIT_FAILURE;
 		  }
-		  printf("%s: %g\n", argv[i], elapsed(gettime(), start) / 100);
+		  ok &= bench_input_run(&settings, selected, argv[i], src, len);
 		  free(src);
+		  ++inputs;
+	 }
+	 if (settings.synthetic) {
+		  for (j = 0; synthetic_corpora[j]; ++j) {
+			   size_t len;
+			   uint8_t *src = synthetic_corpus(synthetic_corpora[j], &len);
+			   if (!src || (predecomposed && !predecompose(&src, &len))) {
+					fprintf(stderr, "error generating %s\n", synthetic_corpora[j]);
+					return EXIT_FAILURE;
+			   }
+			   ok &= bench_input_run(&settings, selected, synthetic_corpora[j], src, len);
+			   free(src);
+			   ++inputs;
+		  }
+	 }
+	 if (!inputs) {
+		  usage();
+		  return EXIT_FAILURE;
 	 }
 
-	 return EXIT_SUCCESS;
+	 return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
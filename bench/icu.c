@@ -1,26 +1,110 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* ICU4C */
 #include <unicode/utypes.h>
 #include <unicode/ustring.h>
 #include <unicode/ucnv.h>
 #include <unicode/unorm2.h>
+#include <unicode/ubrk.h>
 
 #include "util.h"
 
-int main(int argc, char **argv)
+/* an input converted to ICU's UTF-16, with a destination buffer */
+typedef struct {
+	 const UNormalizer2 *nf;
+	 UBreakIterator *brk;
+	 UChar *usrc;
+	 int32_t ulen;
+	 UChar *udest;
+	 int32_t udestsize;
+	 UErrorCode err;
+} icu_input;
+
+static volatile int32_t sink;
+
+static void op_normalize(void *data)
+{
+	 icu_input *in = (icu_input *) data;
+	 sink = unorm2_normalize(in->nf, in->usrc, in->ulen, in->udest, in->udestsize, &in->err);
+}
+
+static void op_casefold(void *data)
+{
+	 icu_input *in = (icu_input *) data;
+	 sink = u_strFoldCase(in->udest, in->udestsize, in->usrc, in->ulen, U_FOLD_CASE_DEFAULT, &in->err);
+}
+
+static void op_graphemes(void *data)
+{
+	 icu_input *in = (icu_input *) data;
+	 int32_t n = 0;
+	 ubrk_first(in->brk);
+	 while (ubrk_next(in->brk) != UBRK_DONE) ++n;
+	 sink = n;
+}
+
+static const char *const nf_names[] = {"nfc", "nfd", "nfkc", "nfkd"};
+
+static const UNormalizer2 *nf_instance(int i, UErrorCode *err)
+{
+	 switch (i) {
+	 case 0: return unorm2_getNFCInstance(err);
+	 case 1: return unorm2_getNFDInstance(err);
+	 case 2: return unorm2_getNFKCInstance(err);
+	 default: return unorm2_getNFKDInstance(err);
+	 }
+}
+
+static int run(const bench_settings *settings, const char *name, const uint8_t *src, size_t len)
 {
+	 icu_input in;
+	 size_t codepoints = count_codepoints(src, len);
 	 int i;
 
-	 UErrorCode err;
-	 UConverter *uc = ucnv_open("UTF8", &err);
-	 if (U_FAILURE(err)) return EXIT_FAILURE;
+	 /* convert UTF8 data to ICU's UTF16, outside of the timing */
+	 in.err = U_ZERO_ERROR;
+	 in.usrc = (UChar*) malloc((2*len + 1) * sizeof(UChar));
+	 u_strFromUTF8(in.usrc, 2*len + 1, &in.ulen, (const char *) src, len, &in.err);
+	 if (U_FAILURE(in.err)) return 0;
+
+	 /* ICU's insane normalization API requires you to
+		know the size of the destination buffer in advance,
+		or alternatively to repeatly try normalizing and
+		double the buffer size until it succeeds.  Here, I just
+		allocate a huge destination buffer to avoid the issue. */
+	 in.udestsize = 18*in.ulen + 1;
+	 in.udest = (UChar*) malloc(in.udestsize * sizeof(UChar));
+
+	 for (i = 0; i < 4; ++i) {
+		  in.nf = nf_instance(i, &in.err);
+		  if (U_FAILURE(in.err)) return 0;
+		  op_normalize(&in);
+		  if (U_FAILURE(in.err)) return 0;
+		  bench_report(settings, "icu", nf_names[i], name, len, codepoints, op_normalize, &in);
+	 }
+	 op_casefold(&in);
+	 if (U_FAILURE(in.err)) return 0;
+	 bench_report(settings, "icu", "casefold", name, len, codepoints, op_casefold, &in);
+	 in.brk = ubrk_open(UBRK_CHARACTER, "", in.usrc, in.ulen, &in.err);
+	 if (U_FAILURE(in.err)) return 0;
+	 bench_report(settings, "icu", "graphemes", name, len, codepoints, op_graphemes, &in);
+	 ubrk_close(in.brk);
+
+	 free(in.udest);
+	 free(in.usrc);
+	 return 1;
+}
 
-	 const UNormalizer2 *NFKC = unorm2_getNFKCInstance(&err);
-	 if (U_FAILURE(err)) return EXIT_FAILURE;
-	 
+int main(int argc, char **argv)
+{
+	 int i;
+	 bench_settings settings;
+
+	 bench_init(&settings);
 	 for (i = 1; i < argc; ++i) {
+		  if (bench_option(&settings, argc, argv, &i)) continue;
 		  if (argv[i][0] == '-') {
 			   fprintf(stderr, "unrecognized option: %s\n", argv[i]);
 			   return EXIT_FAILURE;
@@ -32,30 +116,23 @@ int main(int argc, char **argv)
 			   fprintf(stderr, "error reading %s\n", argv[i]);
 			   return EXIT_FAILURE;
 		  }
-
-		  /* convert UTF8 data to ICU's UTF16 */
-		  UChar *usrc = (UChar*) malloc(2*len * sizeof(UChar));
-		  ucnv_toUChars(uc, usrc, 2*len, (char*) src, len, &err);
-		  if (U_FAILURE(err)) return EXIT_FAILURE;
-		  size_t ulen = u_strlen(usrc);
-
-		  /* ICU's insane normalization API requires you to
-			 know the size of the destination buffer in advance,
-			 or alternatively to repeatly try normalizing and
-			 double the buffer size until it succeeds.  Here, I just
-			 allocate a huge destination buffer to avoid the issue. */
-		  UChar *udest = (UChar*) malloc(10*ulen * sizeof(UChar));
-
-		  mytime start = gettime();
-		  for (int i = 0; i < 100; ++i) {
-			   unorm2_normalize(NFKC, usrc, ulen, udest, 10*ulen, &err);
-			   if (U_FAILURE(err)) return EXIT_FAILURE;
+		  if (!run(&settings, argv[i], src, len)) {
+			   fprintf(stderr, "ICU error on %s\n", argv[i]);
+			   return EXIT_FAILURE;
 		  }
-		  printf("%s: %g\n", argv[i], elapsed(gettime(), start) / 100);
-		  free(udest);
-		  free(usrc);
 		  free(src);
 	 }
+	 if (settings.synthetic) {
+		  for (i = 0; synthetic_corpora[i]; ++i) {
+			   size_t len;
+			   uint8_t *src = synthetic_corpus(synthetic_corpora[i], &len);
+			   if (!src || !run(&settings, synthetic_corpora[i], src, len)) {
+					fprintf(stderr, "ICU error on %s\n", synthetic_corpora[i]);
+					return EXIT_FAILURE;
+			   }
+			   free(src);
+		  }
+	 }
 
 	 return EXIT_SUCCESS;
 }
@@ -7,31 +7,70 @@
 /* libunistring */
 #include <unistr.h>
 #include <uninorm.h>
+#include <unicase.h>
 
 #include "util.h"
 
+/* an input with a destination buffer large enough that libunistring
+   never has to allocate the result */
+typedef struct {
+	 uninorm_t nf;
+	 const uint8_t *src;
+	 size_t len;
+	 uint8_t *dest;
+	 size_t destsize;
+} unistring_input;
+
+static uint8_t *volatile sink;
+
+static void op_normalize(void *data)
+{
+	 unistring_input *in = (unistring_input *) data;
+	 size_t destlen = in->destsize;
+	 sink = u8_normalize(in->nf, in->src, in->len, in->dest, &destlen);
+}
+
+static void op_casefold(void *data)
+{
+	 unistring_input *in = (unistring_input *) data;
+	 size_t destlen = in->destsize;
+	 sink = u8_casefold(in->src, in->len, NULL, NULL, in->dest, &destlen);
+}
+
+static int run(const bench_settings *settings, const char *name, const uint8_t *src, size_t len)
+{
+	 static const char *const nf_names[] = {"nfc", "nfd", "nfkc", "nfkd"};
+	 const uninorm_t nfs[] = {UNINORM_NFC, UNINORM_NFD, UNINORM_NFKC, UNINORM_NFKD};
+	 unistring_input in;
+	 size_t codepoints = count_codepoints(src, len);
+	 int i;
+
+	 in.src = src;
+	 in.len = len;
+	 in.destsize = 18*len + 1;
+	 in.dest = (uint8_t *) malloc(in.destsize);
+	 if (!in.dest) return 0;
+	 for (i = 0; i < 4; ++i) {
+		  in.nf = nfs[i];
+		  op_normalize(&in);
+		  if (sink != in.dest) return 0; /* error, or allocated */
+		  bench_report(settings, "unistring", nf_names[i], name, len, codepoints, op_normalize, &in);
+	 }
+	 op_casefold(&in);
+	 if (sink != in.dest) return 0;
+	 bench_report(settings, "unistring", "casefold", name, len, codepoints, op_casefold, &in);
+	 free(in.dest);
+	 return 1;
+}
+
 int main(int argc, char **argv)
 {
 	 int i;
-	 uninorm_t nf = UNINORM_NFKC;
+	 bench_settings settings;
 
+	 bench_init(&settings);
 	 for (i = 1; i < argc; ++i) {
-		  if (!strcmp(argv[i], "-nfkc")) {
-			   nf = UNINORM_NFKC;
-			   continue;
-		  }
-		  if (!strcmp(argv[i], "-nfkd")) {
-			   nf = UNINORM_NFKD;
-			   continue;
-		  }
-		  if (!strcmp(argv[i], "-nfc")) {
-			   nf = UNINORM_NFC;
-			   continue;
-		  }
-		  if (!strcmp(argv[i], "-nfd")) {
-			   nf = UNINORM_NFD;
-			   continue;
-		  }
+		  if (bench_option(&settings, argc, argv, &i)) continue;
 		  if (argv[i][0] == '-') {
 			   fprintf(stderr, "unrecognized option: %s\n", argv[i]);
 			   return EXIT_FAILURE;
@@ -43,18 +82,23 @@ int main(int argc, char **argv)
 			   fprintf(stderr, "error reading %s\n", argv[i]);
 			   return EXIT_FAILURE;
 		  }
-
-		  size_t destlen;
-		  uint8_t *dest;
-		  mytime start = gettime();
-		  for (int i = 0; i < 100; ++i) {
-			   dest = u8_normalize(nf, src, len, NULL, &destlen);
-			   if (!dest) return EXIT_FAILURE;
-			   free(dest);
+		  if (!run(&settings, argv[i], src, len)) {
+			   fprintf(stderr, "libunistring error on %s\n", argv[i]);
+			   return EXIT_FAILURE;
 		  }
-		  printf("%s: %g\n", argv[i], elapsed(gettime(), start) / 100);
 		  free(src);
 	 }
+	 if (settings.synthetic) {
+		  for (i = 0; synthetic_corpora[i]; ++i) {
+			   size_t len;
+			   uint8_t *src = synthetic_corpus(synthetic_corpora[i], &len);
+			   if (!src || !run(&settings, synthetic_corpora[i], src, len)) {
+					fprintf(stderr, "libunistring error on %s\n", synthetic_corpora[i]);
+					return EXIT_FAILURE;
+			   }
+			   free(src);
+		  }
+	 }
 
 	 return EXIT_SUCCESS;
 }
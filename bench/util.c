@@ -1,5 +1,8 @@
+#define _POSIX_C_SOURCE 199309L /* clock_gettime */
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 
 #include "util.h"
@@ -26,7 +29,7 @@ uint8_t *readfile(const char *filename, size_t *len)
 
 mytime gettime(void) {
 	 mytime t;
-	 gettimeofday(&t, NULL);
+	 clock_gettime(CLOCK_MONOTONIC, &t);
 	 return t;
 }
 
@@ -34,6 +37,240 @@ mytime gettime(void) {
 double elapsed(mytime t1, mytime t0)
 {
      return (double)(t1.tv_sec - t0.tv_sec) +
-          (double)(t1.tv_usec - t0.tv_usec) * 1.0E-6;
+          (double)(t1.tv_nsec - t0.tv_nsec) * 1.0E-9;
+}
+
+size_t count_codepoints(const uint8_t *s, size_t len)
+{
+	 size_t i, n = 0;
+	 for (i = 0; i < len; ++i)
+		  n += (s[i] & 0xC0) != 0x80;
+	 return n;
+}
+
+/******************************************************************/
+/* synthetic corpora */
+
+const char *const synthetic_corpora[] = {
+	 "ascii", "cjk", "emoji-zwj", "combining", NULL
+};
+
+#define CORPUS_SIZE (1 << 20)
+
+typedef struct {
+	 uint8_t *s;
+	 size_t len;
+	 uint32_t seed;
+} corpus;
+
+static uint32_t corpus_random(corpus *c, uint32_t n)
+{
+	 c->seed = c->seed * 1103515245u + 12345u;
+	 return (c->seed >> 8) % n;
+}
+
+static void corpus_put(corpus *c, uint32_t cp)
+{
+	 uint8_t *s = c->s + c->len;
+	 if (cp < 0x80) {
+		  s[0] = cp;
+		  c->len += 1;
+	 } else if (cp < 0x800) {
+		  s[0] = 0xC0 | (cp >> 6);
+		  s[1] = 0x80 | (cp & 0x3F);
+		  c->len += 2;
+	 } else if (cp < 0x10000) {
+		  s[0] = 0xE0 | (cp >> 12);
+		  s[1] = 0x80 | ((cp >> 6) & 0x3F);
+		  s[2] = 0x80 | (cp & 0x3F);
+		  c->len += 3;
+	 } else {
+		  s[0] = 0xF0 | (cp >> 18);
+		  s[1] = 0x80 | ((cp >> 12) & 0x3F);
+		  s[2] = 0x80 | ((cp >> 6) & 0x3F);
+		  s[3] = 0x80 | (cp & 0x3F);
+		  c->len += 4;
+	 }
+}
+
+/* English-like words, punctuation and lines */
+static void ascii_text(corpus *c)
+{
+	 static const char *const words[] = {
+		  "the", "of", "and", "to", "in", "is", "that", "for", "it", "as",
+		  "was", "with", "be", "by", "on", "not", "he", "I", "this", "are",
+		  "Unicode", "normalization", "character", "string", "benchmark"
+	 };
+	 const char *w = words[corpus_random(c, sizeof(words) / sizeof(words[0]))];
+	 memcpy(c->s + c->len, w, strlen(w));
+	 c->len += strlen(w);
+	 switch (corpus_random(c, 16)) {
+	 case 0: corpus_put(c, '.'); corpus_put(c, '\n'); break;
+	 case 1: corpus_put(c, ','); corpus_put(c, ' '); break;
+	 default: corpus_put(c, ' ');
+	 }
+}
+
+/* mostly ideographs, with kana and ideographic punctuation */
+static void cjk_text(corpus *c)
+{
+	 uint32_t r = corpus_random(c, 32);
+	 if (r < 20) corpus_put(c, 0x4E00 + corpus_random(c, 0x5200));
+	 else if (r < 30) corpus_put(c, 0x3041 + corpus_random(c, 0x56));
+	 else if (r == 30) corpus_put(c, 0x3001);
+	 else corpus_put(c, 0x3002);
 }
 
+/* emoji with modifiers, ZWJ sequences, flags and variation selectors */
+static void emoji_text(corpus *c)
+{
+	 switch (corpus_random(c, 5)) {
+	 case 0: /* family */
+		  corpus_put(c, 0x1F468); corpus_put(c, 0x200D);
+		  corpus_put(c, 0x1F469); corpus_put(c, 0x200D);
+		  corpus_put(c, 0x1F467); corpus_put(c, 0x200D);
+		  corpus_put(c, 0x1F466);
+		  break;
+	 case 1: /* skin tone */
+		  corpus_put(c, 0x1F44D); corpus_put(c, 0x1F3FB + corpus_random(c, 5));
+		  break;
+	 case 2: /* flag */
+		  corpus_put(c, 0x1F1E6 + corpus_random(c, 26));
+		  corpus_put(c, 0x1F1E6 + corpus_random(c, 26));
+		  break;
+	 case 3: /* emoji presentation */
+		  corpus_put(c, 0x2764); corpus_put(c, 0xFE0F);
+		  break;
+	 default: /* profession with skin tone */
+		  corpus_put(c, 0x1F469); corpus_put(c, 0x1F3FB + corpus_random(c, 5));
+		  corpus_put(c, 0x200D); corpus_put(c, 0x1F52C);
+	 }
+	 if (corpus_random(c, 4) == 0) corpus_put(c, ' ');
+}
+
+/* letters followed by long runs of combining marks in reverse canonical
+   order, the worst case of canonical ordering and composition */
+static void combining_text(corpus *c)
+{
+	 static const uint32_t marks[] = {
+		  0x0345 /* 240 */, 0x0301 /* 230 */, 0x0300 /* 230 */, 0x0316 /* 220 */,
+		  0x0323 /* 220 */, 0x031B /* 216 */, 0x0334 /* 1 */
+	 };
+	 uint32_t i, n = 1 + corpus_random(c, 30);
+	 corpus_put(c, 'a' + corpus_random(c, 26));
+	 for (i = 0; i < n; ++i)
+		  corpus_put(c, marks[i % (sizeof(marks) / sizeof(marks[0]))]);
+	 if (corpus_random(c, 4) == 0) corpus_put(c, ' ');
+}
+
+uint8_t *synthetic_corpus(const char *name, size_t *len)
+{
+	 void (*text)(corpus *c);
+	 corpus c;
+	 if (!strcmp(name, "ascii")) text = ascii_text;
+	 else if (!strcmp(name, "cjk")) text = cjk_text;
+	 else if (!strcmp(name, "emoji-zwj")) text = emoji_text;
+	 else if (!strcmp(name, "combining")) text = combining_text;
+	 else return NULL;
+	 /* leave room for the longest piece of text past CORPUS_SIZE */
+	 c.s = (uint8_t *) malloc(CORPUS_SIZE + 256);
+	 if (!c.s) return NULL;
+	 c.len = 0;
+	 c.seed = 42;
+	 while (c.len < CORPUS_SIZE) text(&c);
+	 *len = c.len;
+	 return c.s;
+}
+
+/******************************************************************/
+/* timing and reporting */
+
+void bench_init(bench_settings *settings)
+{
+	 settings->warmup = 3;
+	 settings->runs = 30;
+	 settings->json = 0;
+	 settings->synthetic = 0;
+}
+
+int bench_option(bench_settings *settings, int argc, char **argv, int *i)
+{
+	 if (!strcmp(argv[*i], "-json")) {
+		  settings->json = 1;
+		  return 1;
+	 }
+	 if (!strcmp(argv[*i], "-synthetic")) {
+		  settings->synthetic = 1;
+		  return 1;
+	 }
+	 if ((!strcmp(argv[*i], "-runs") || !strcmp(argv[*i], "-warmup")) && *i + 1 < argc) {
+		  int n = atoi(argv[*i + 1]);
+		  if (argv[*i][1] == 'r') settings->runs = n > 0 ? n : 1;
+		  else settings->warmup = n > 0 ? n : 0;
+		  ++*i;
+		  return 1;
+	 }
+	 return 0;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	 double x = *(const double *) a, y = *(const double *) b;
+	 return x < y ? -1 : x > y;
+}
+
+/* print s as a JSON string */
+static void print_json_string(const char *s)
+{
+	 putchar('"');
+	 for (; *s; ++s) {
+		  if (*s == '"' || *s == '\\') putchar('\\');
+		  if ((unsigned char) *s < 0x20) printf("\\u%04x", (unsigned char) *s);
+		  else putchar(*s);
+	 }
+	 putchar('"');
+}
+
+void bench_report(const bench_settings *settings, const char *library,
+				  const char *op, const char *input, size_t bytes, size_t codepoints,
+				  void (*func)(void *data), void *data)
+{
+	 int i;
+	 double median, p99;
+	 double *samples = (double *) malloc(sizeof(double) * settings->runs);
+	 if (!samples) {
+		  fprintf(stderr, "out of memory\n");
+		  exit(EXIT_FAILURE);
+	 }
+	 for (i = 0; i < settings->warmup; ++i) func(data);
+	 for (i = 0; i < settings->runs; ++i) {
+		  mytime start = gettime();
+		  func(data);
+		  samples[i] = elapsed(gettime(), start);
+	 }
+	 qsort(samples, settings->runs, sizeof(double), compare_doubles);
+	 median = settings->runs % 2 ? samples[settings->runs / 2] :
+		  (samples[settings->runs / 2 - 1] + samples[settings->runs / 2]) / 2;
+	 /* nearest rank */
+	 p99 = samples[(settings->runs * 99 + 99) / 100 - 1];
+	 free(samples);
+
+	 if (settings->json) {
+		  printf("{\"library\": ");
+		  print_json_string(library);
+		  printf(", \"op\": ");
+		  print_json_string(op);
+		  printf(", \"input\": ");
+		  print_json_string(input);
+		  printf(", \"bytes\": %zu, \"codepoints\": %zu, \"runs\": %d, "
+				 "\"median_s\": %.9g, \"p99_s\": %.9g, "
+				 "\"mb_per_s\": %.6g, \"mcp_per_s\": %.6g}\n",
+				 bytes, codepoints, settings->runs, median, p99,
+				 bytes / median * 1e-6, codepoints / median * 1e-6);
+	 } else {
+		  printf("%-9s %-15s %-16s %9.1f MB/s %9.2f Mcp/s   median %9.4f ms   p99 %9.4f ms\n",
+				 library, op, input, bytes / median * 1e-6, codepoints / median * 1e-6,
+				 median * 1e3, p99 * 1e3);
+	 }
+	 fflush(stdout);
+}
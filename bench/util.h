@@ -2,7 +2,7 @@
 #define UTIL_H 1
 
 #include <inttypes.h>
-#include <sys/time.h>
+#include <stddef.h>
 #include <time.h>
 
 #ifdef __cplusplus
@@ -11,10 +11,38 @@ extern "C" {
 
 uint8_t *readfile(const char *filename, size_t *len);
 
-typedef struct timeval mytime;
+typedef struct timespec mytime;
 mytime gettime(void);
 double elapsed(mytime t1, mytime t0);
 
+/* number of codepoints in the UTF-8 string s[0..len) */
+size_t count_codepoints(const uint8_t *s, size_t len);
+
+/* names of the corpora that synthetic_corpus generates, NULL-terminated */
+extern const char *const synthetic_corpora[];
+/* about 1 MB of deterministic text of the given kind, or NULL */
+uint8_t *synthetic_corpus(const char *name, size_t *len);
+
+/* settings shared by all benchmark programs */
+typedef struct {
+	 int warmup;   /* untimed calls before measuring */
+	 int runs;     /* timed calls, each one sample */
+	 int json;     /* print one JSON object per line instead of a table */
+	 int synthetic; /* also run on all synthetic corpora */
+} bench_settings;
+
+void bench_init(bench_settings *settings);
+/* parse the common option argv[*i], with its argument if any; returns 0 if
+   it is not one of -json, -runs N, -warmup N or -synthetic */
+int bench_option(bench_settings *settings, int argc, char **argv, int *i);
+
+/* time func(data) and print its median and 99th percentile time, with the
+   throughput for an input of `bytes` bytes of UTF-8 and `codepoints`
+   codepoints, under the names of the library, the operation and the input */
+void bench_report(const bench_settings *settings, const char *library,
+				  const char *op, const char *input, size_t bytes, size_t codepoints,
+				  void (*func)(void *data), void *data);
+
 #ifdef __cplusplus
 }
 #endif
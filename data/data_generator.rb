@@ -67,6 +67,24 @@
 #  authorization of the copyright holder.
 
 
+# Data that can be left out of the tables for smaller binaries, selected by
+# the arguments of this script (UTF8PROC_DATA_FLAGS in data/Makefile).  The
+# generated file then defines UTF8PROC_DATA_NO_COMPAT etc. for utf8proc.c.
+#   --no-compat        compatibility decompositions: UTF8PROC_COMPAT (and
+#                      so NFKC and NFKD) fails with UTF8PROC_ERROR_INVALIDOPTS
+#   --no-case-mapping  upper- and titlecase mappings outside of ASCII
+#                      (lowercase mappings and case folding are kept)
+#   --no-bidi          bidi classes and mirroring
+#   --no-charwidth     character widths: every codepoint is 1 column wide
+$omit = {}
+%w[compat case-mapping bidi charwidth].each { |name| $omit[name] = false }
+ARGV.each do |arg|
+  name = arg[/\A--no-([a-z-]+)\z/, 1]
+  raise "Unknown option #{arg}" unless $omit.key?(name)
+  $omit[name] = true
+end
+ARGV.clear # UnicodeData.txt is read from stdin
+
 $ignorable_list = File.read("DerivedCoreProperties.txt")[/# Derived Property: Default_Ignorable_Code_Point.*?# Total code points:/m]
 $ignorable = []
 $ignorable_list.each_line do |entry|
@@ -100,6 +118,217 @@ $emoji_data_list.each_line do |entry|
   end
 end
 
+# Word_Break and Sentence_Break values, as the upper-case property value names
+def read_break_property(filename)
+  values = Hash.new("OTHER")
+  File.read(filename).each_line do |entry|
+    if entry =~ /^([0-9A-F]+)\.\.([0-9A-F]+)\s*;\s*([A-Za-z_]+)/
+      $1.hex.upto($2.hex) { |e2| values[e2] = $3.upcase }
+    elsif entry =~ /^([0-9A-F]+)\s*;\s*([A-Za-z_]+)/
+      values[$1.hex] = $2.upcase
+    end
+  end
+  values
+end
+$word_break = read_break_property("WordBreakProperty.txt")
+$sentence_break = read_break_property("SentenceBreakProperty.txt")
+
+# Word break classes, in the order of the wordbreak bits of
+# utf8proc_segment_classes.  EXTENDED_PICTOGRAPHIC is Word_Break=Other with
+# Extended_Pictographic, likewise ALETTER_EXTENDED_PICTOGRAPHIC (for WB3c),
+# and EOT stands for the end of the text.
+$wordclasses = %w[OTHER CR LF NEWLINE EXTEND ZWJ REGIONAL_INDICATOR FORMAT
+                  KATAKANA HEBREW_LETTER ALETTER SINGLE_QUOTE DOUBLE_QUOTE
+                  MIDNUMLET MIDLETTER MIDNUM NUMERIC EXTENDNUMLET WSEGSPACE
+                  EXTENDED_PICTOGRAPHIC ALETTER_EXTENDED_PICTOGRAPHIC EOT]
+# Sentence break classes, likewise for the sentencebreak bits.
+$sentenceclasses = %w[OTHER CR LF EXTEND SEP FORMAT SP LOWER UPPER OLETTER
+                      NUMERIC ATERM SCONTINUE STERM CLOSE EOT]
+
+def wordclass(code)
+  value = $word_break[code]
+  if $grapheme_boundclass[code] == "UTF8PROC_BOUNDCLASS_EXTENDED_PICTOGRAPHIC"
+    value = { "OTHER" => "EXTENDED_PICTOGRAPHIC",
+              "ALETTER" => "ALETTER_EXTENDED_PICTOGRAPHIC" }[value] or
+      raise "unexpected Word_Break value #{value} of an Extended_Pictographic codepoint"
+  end
+  $wordclasses.index(value) or raise "unknown Word_Break value #{value}"
+end
+
+def sentenceclass(code)
+  $sentenceclasses.index($sentence_break[code]) or
+    raise "unknown Sentence_Break value #{$sentence_break[code]}"
+end
+
+# The word and sentence break rules of UAX #29 as state machines over these
+# classes.  Each transition is [action, state] for the segment iterator in
+# utf8proc.c: :none (no break in front of the codepoint), :break, :mark (no
+# break yet, but the rule needs to see the codepoints that follow: remember
+# this position) or :fail (the rule did not match after all: break at the
+# position remembered, and start over from there in state START).
+#
+# Rule numbering refers to TR29 Version 33 (Unicode 11.0.0):
+# http://www.unicode.org/reports/tr29/tr29-33.html
+#
+# The word break state is the class of the last codepoint that is not
+# ignored by WB4, with the lookahead states AL_MID (WB6/7), NUM_MID (WB11/12)
+# and HL_DQ (WB7b/c) and HL_SQ after WB7a.  The suffix _ZWJ means that the
+# preceding codepoint is a ZWJ (WB3c).
+$wordstates = %w[START OTHER CR NEWLINE WSEGSPACE ALETTER HEBREW_LETTER
+                 NUMERIC KATAKANA EXTENDNUMLET REGIONAL_INDICATOR HL_SQ
+                 AL_MID NUM_MID HL_DQ]
+$wordstates += $wordstates.map { |state| state + "_ZWJ" }
+
+def word_state_of(tc)
+  case tc
+  when "ALETTER", "HEBREW_LETTER", "NUMERIC", "KATAKANA", "EXTENDNUMLET",
+       "WSEGSPACE", "CR", "REGIONAL_INDICATOR"
+    tc
+  when "LF", "NEWLINE" then "NEWLINE"
+  when "ZWJ" then "OTHER_ZWJ"
+  else "OTHER"
+  end
+end
+
+def word_transition(state, tc)
+  zwj = state.end_with?("_ZWJ")
+  state = state.chomp("_ZWJ")
+  extpict = tc.end_with?("EXTENDED_PICTOGRAPHIC")
+  tc = "ALETTER" if tc == "ALETTER_EXTENDED_PICTOGRAPHIC"
+  ahletter = %w[ALETTER HEBREW_LETTER]
+  if %w[AL_MID NUM_MID HL_DQ].include?(state)
+    return [:none, state] if %w[EXTEND FORMAT].include?(tc)              # WB4
+    return [:none, state + "_ZWJ"] if tc == "ZWJ"                        # WB4
+    return [:none, tc] if state == "AL_MID" && ahletter.include?(tc)     # WB7
+    return [:none, tc] if state == "NUM_MID" && tc == "NUMERIC"          # WB11
+    return [:none, tc] if state == "HL_DQ" && tc == "HEBREW_LETTER"      # WB7c
+    return [:fail, "START"]
+  end
+  return [:break, "START"] if tc == "EOT"                               # WB2
+  return [:none, word_state_of(tc)] if state == "START"                 # WB1
+  return [:none, "NEWLINE"] if state == "CR" && tc == "LF"              # WB3
+  return [:break, word_state_of(tc)] if %w[CR NEWLINE].include?(state)  # WB3a
+  return [:break, word_state_of(tc)] if %w[CR LF NEWLINE].include?(tc)  # WB3b
+  return [:none, word_state_of(tc)] if zwj && extpict                   # WB3c
+  return [:none, state] if state == "WSEGSPACE" && tc == "WSEGSPACE"    # WB3d
+  state = "OTHER" if state == "WSEGSPACE"  # WB3d needs adjacent spaces
+  return [:none, state] if %w[EXTEND FORMAT].include?(tc)               # WB4
+  return [:none, state + "_ZWJ"] if tc == "ZWJ"                         # WB4
+  if ahletter.include?(state)
+    return [:none, tc] if ahletter.include?(tc)                         # WB5
+    return [:none, "HL_SQ"] if state == "HEBREW_LETTER" &&
+                               tc == "SINGLE_QUOTE"                     # WB7a
+    return [:mark, "AL_MID"] if %w[MIDLETTER MIDNUMLET
+                                   SINGLE_QUOTE].include?(tc)           # WB6
+    return [:mark, "HL_DQ"] if state == "HEBREW_LETTER" &&
+                               tc == "DOUBLE_QUOTE"                     # WB7b
+    return [:none, tc] if tc == "NUMERIC"                               # WB9
+  end
+  return [:none, tc] if state == "HL_SQ" && ahletter.include?(tc)      # WB7
+  if state == "NUMERIC"
+    return [:none, tc] if tc == "NUMERIC"                               # WB8
+    return [:none, tc] if ahletter.include?(tc)                         # WB10
+    return [:mark, "NUM_MID"] if %w[MIDNUM MIDNUMLET
+                                    SINGLE_QUOTE].include?(tc)          # WB12
+  end
+  return [:none, tc] if state == "KATAKANA" && tc == "KATAKANA"         # WB13
+  return [:none, tc] if %w[ALETTER HEBREW_LETTER NUMERIC KATAKANA
+                           EXTENDNUMLET].include?(state) &&
+                        tc == "EXTENDNUMLET"                            # WB13a
+  return [:none, tc] if state == "EXTENDNUMLET" &&
+                        %w[ALETTER HEBREW_LETTER NUMERIC
+                           KATAKANA].include?(tc)                       # WB13b
+  return [:none, "OTHER"] if state == "REGIONAL_INDICATOR" &&
+                             tc == "REGIONAL_INDICATOR"                 # WB15/16
+  [:break, word_state_of(tc)]                                           # WB999
+end
+
+# The sentence break state is the class of the last codepoint that is not
+# ignored by SB5, where UPPERLOWER is Upper or Lower, UL_ATERM is ATerm after
+# UPPERLOWER (SB7), the (S)ATERM_CLOSE and _SP states are SATerm Close* and
+# SATerm Close* Sp+, PARASEP is a paragraph separator other than CR, and
+# LOOK is the lookahead of SB8.
+$sentencestates = %w[START OTHER UPPERLOWER CR PARASEP ATERM UL_ATERM STERM
+                     ATERM_CLOSE STERM_CLOSE ATERM_SP STERM_SP LOOK]
+
+def sentence_state_of(tc, state = "OTHER")
+  case tc
+  when "UPPER", "LOWER" then "UPPERLOWER"
+  when "ATERM" then state == "UPPERLOWER" ? "UL_ATERM" : "ATERM"
+  when "STERM", "CR" then tc
+  when "LF", "SEP" then "PARASEP"
+  else "OTHER"
+  end
+end
+
+def sentence_transition(state, tc)
+  parasep = %w[SEP CR LF]
+  if state == "LOOK"
+    return [:none, "UPPERLOWER"] if tc == "LOWER"                       # SB8
+    return [:fail, "START"] if %w[OLETTER UPPER ATERM STERM
+                                  EOT].include?(tc) || parasep.include?(tc)
+    return [:none, "LOOK"]                                              # SB8
+  end
+  return [:break, "START"] if tc == "EOT"                               # SB2
+  return [:none, sentence_state_of(tc)] if state == "START"             # SB1
+  return [:none, "PARASEP"] if state == "CR" && tc == "LF"              # SB3
+  return [:break, sentence_state_of(tc)] if %w[CR PARASEP].include?(state) # SB4
+  return [:none, state] if %w[EXTEND FORMAT].include?(tc)               # SB5
+  if %w[ATERM UL_ATERM STERM ATERM_CLOSE STERM_CLOSE ATERM_SP
+        STERM_SP].include?(state)
+    aterm = %w[ATERM UL_ATERM ATERM_CLOSE ATERM_SP].include?(state)
+    return [:none, "OTHER"] if %w[ATERM UL_ATERM].include?(state) &&
+                               tc == "NUMERIC"                          # SB6
+    return [:none, "UPPERLOWER"] if state == "UL_ATERM" && tc == "UPPER" # SB7
+    return [:none, "UPPERLOWER"] if aterm && tc == "LOWER"              # SB8
+    return [:none, sentence_state_of(tc)] if %w[SCONTINUE ATERM
+                                                STERM].include?(tc)     # SB8a
+    return [:none, (aterm ? "ATERM" : "STERM") + "_CLOSE"] if
+      tc == "CLOSE" && !state.end_with?("_SP")                          # SB9
+    return [:none, (aterm ? "ATERM" : "STERM") + "_SP"] if tc == "SP"   # SB9, SB10
+    return [:none, sentence_state_of(tc)] if parasep.include?(tc)       # SB9, SB10
+    return [:mark, "LOOK"] if aterm && !%w[OLETTER UPPER].include?(tc)  # SB8
+    return [:break, sentence_state_of(tc)]                              # SB11
+  end
+  [:none, sentence_state_of(tc, state)]                                 # SB998
+end
+
+# Grapheme cluster break rules of UAX #29 as a state machine over boundclasses,
+# in the order of the utf8proc_boundclass_t enum.  The state is the boundclass
+# of the preceding codepoint, except that EXTENDED_PICTOGRAPHIC absorbs
+# EXTEND codepoints and becomes E_ZWG after a ZWJ (GB11), and that the second
+# of two REGIONAL_INDICATORs becomes OTHER (GB12/13).
+$boundclasses = %w[START OTHER CR LF CONTROL EXTEND L V T LV LVT
+                   REGIONAL_INDICATOR SPACINGMARK PREPEND ZWJ E_BASE E_MODIFIER
+                   GLUE_AFTER_ZWJ E_BASE_GAZ EXTENDED_PICTOGRAPHIC E_ZWG]
+
+# Rule numbering refers to TR29 Version 29 (Unicode 9.0.0):
+# http://www.unicode.org/reports/tr29/tr29-29.html
+def grapheme_break_simple(lbc, tbc)
+  return true if lbc == "START"                                     # GB1
+  return false if lbc == "CR" and tbc == "LF"                       # GB3
+  return true if %w[CR LF CONTROL].include?(lbc)                    # GB4
+  return true if %w[CR LF CONTROL].include?(tbc)                    # GB5
+  return false if lbc == "L" and %w[L V LV LVT].include?(tbc)       # GB6
+  return false if %w[LV V].include?(lbc) and %w[V T].include?(tbc)  # GB7
+  return false if %w[LVT T].include?(lbc) and tbc == "T"            # GB8
+  return false if %w[EXTEND ZWJ SPACINGMARK].include?(tbc)          # GB9, GB9a
+  return false if lbc == "PREPEND"                                  # GB9b
+  return false if lbc == "E_ZWG" and tbc == "EXTENDED_PICTOGRAPHIC" # GB11
+  return false if lbc == "REGIONAL_INDICATOR" and
+                  tbc == "REGIONAL_INDICATOR"                       # GB12/13
+  true                                                              # GB999
+end
+
+def grapheme_next_state(state, tbc)
+  return "OTHER" if state == "REGIONAL_INDICATOR" and tbc == "REGIONAL_INDICATOR"
+  if state == "EXTENDED_PICTOGRAPHIC"
+    return "EXTENDED_PICTOGRAPHIC" if tbc == "EXTEND"
+    return "E_ZWG" if tbc == "ZWJ"
+  end
+  tbc
+end
+
 $charwidth_list = File.read("CharWidths.txt")
 $charwidth = Hash.new(0)
 $charwidth_list.each_line do |entry|
@@ -109,6 +338,7 @@ $charwidth_list.each_line do |entry|
     $charwidth[$1.hex] = $2.to_i
   end
 end
+$charwidth = Hash.new(1) if $omit["charwidth"]
 
 $exclusions = File.read("CompositionExclusions.txt")[/# \(1\) Script Specifics.*?# Total code points:/m]
 $exclusions = $exclusions.chomp.split("\n").collect { |e| e.hex }
@@ -227,7 +457,25 @@ class UnicodeChar
     "#{$ignorable.include?(code)}, " <<
     "#{%W[Zl Zp Cc Cf].include?(category) and not [0x200C, 0x200D].include?(category)}, " <<
     "#{$charwidth[code]}, 0, " <<
-    "#{$grapheme_boundclass[code]}},\n"
+    "#{$grapheme_boundclass[code]}, " <<
+    "#{str2c $nfc_qc[code], 'QC'}, #{str2c $nfd_qc[code], 'QC'}, " <<
+    "#{str2c $nfkc_qc[code], 'QC'}, #{str2c $nfkd_qc[code], 'QC'}},\n"
+  end
+  # the fields of c_entry read by normalization and segmentation, see
+  # utf8proc_hot_property_t in utf8proc.c
+  def c_hot_entry(comb_indicies, expansion_index)
+    "{#{c_decomp_mapping}, " <<
+    "#{c_case_folding}, " <<
+    "#{comb_indicies[code] ? comb_indicies[code]: 'UINT16_MAX'}, " <<
+    "#{expansion_index}, " <<
+    "#{combining_class}, " <<
+    "#{str2c category, 'CATEGORY'}, " <<
+    "#{$grapheme_boundclass[code]}, " <<
+    "#{decomp_type.nil? ? 0 : 1}, " <<
+    "#{$ignorable.include?(code) ? 1 : 0}, " <<
+    "#{($exclusions.include?(code) or $excl_version.include?(code)) ? 1 : 0}, " <<
+    "#{str2c $nfc_qc[code], 'QC'}, #{str2c $nfd_qc[code], 'QC'}, " <<
+    "#{str2c $nfkc_qc[code], 'QC'}, #{str2c $nfkd_qc[code], 'QC'}}"
   end
 end
 
@@ -257,6 +505,56 @@ while gets
   end
 end
 
+chars.each do |char|
+  if $omit["compat"] and char.decomp_type
+    char.decomp_type = char.decomp_mapping = nil
+  end
+  if $omit["case-mapping"] and char.code >= 0x80
+    char.uppercase_mapping = char.titlecase_mapping = nil
+  end
+  if $omit["bidi"]
+    char.bidi_class = nil
+    char.bidi_mirrored = false
+  end
+end
+
+# Quick_Check properties of UAX #15, derived as in DerivedNormalizationProps.txt
+$nfc_qc = Hash.new("YES")
+$nfd_qc = Hash.new("YES")
+$nfkc_qc = Hash.new("YES")
+$nfkd_qc = Hash.new("YES")
+0xAC00.upto(0xD7A3) { |code| $nfd_qc[code] = $nfkd_qc[code] = "NO" }
+0x1161.upto(0x1175) { |code| $nfc_qc[code] = $nfkc_qc[code] = "MAYBE" }
+0x11A8.upto(0x11C2) { |code| $nfc_qc[code] = $nfkc_qc[code] = "MAYBE" }
+def compat_decomposable(char_hash, code)
+  char = char_hash[code]
+  return false unless char and char.decomp_mapping
+  return true unless char.decomp_type.nil?
+  char.decomp_mapping.any? { |cp| compat_decomposable(char_hash, cp) }
+end
+chars.each do |char|
+  mapping = char.decomp_mapping
+  next unless mapping
+  $nfkd_qc[char.code] = "NO"
+  # NFKD differs from NFD somewhere in the (recursive) decomposition:
+  $nfkc_qc[char.code] = "NO" if compat_decomposable(char_hash, char.code)
+  next unless char.decomp_type.nil?
+  $nfd_qc[char.code] = "NO"
+  first = char_hash[mapping[0]]
+  if mapping.length == 1 or char.combining_class != 0 or
+      first.nil? or first.combining_class != 0 or
+      $exclusions.include?(char.code) or $excl_version.include?(char.code)
+    $nfc_qc[char.code] = $nfkc_qc[char.code] = "NO" # full composition exclusion
+  end
+end
+chars.each do |char|
+  mapping = char.decomp_mapping
+  next unless char.decomp_type.nil? and mapping and mapping.length == 2
+  next if $nfc_qc[char.code] == "NO"
+  $nfc_qc[mapping[1]] = "MAYBE" unless $nfc_qc[mapping[1]] == "NO"
+  $nfkc_qc[mapping[1]] = "MAYBE" unless $nfkc_qc[mapping[1]] == "NO"
+end
+
 comb1st_indicies = {}
 comb2nd_indicies = {}
 comb2nd_indicies_sorted_keys = []
@@ -323,15 +621,91 @@ comb2nd_indicies_sorted_keys.each do |dm1|
   end
 end
 
+# The full (recursive) decomposition of a codepoint as utf8proc_decompose_char
+# computes it, for the cases listed in utf8proc_expansions below
+def hangul_decomposition(code)
+  sindex = code - 0xAC00
+  return nil unless sindex >= 0 and sindex < 11172
+  jamo = [0x1100 + sindex / 588, 0x1161 + (sindex % 588) / 28]
+  jamo << 0x11A7 + sindex % 28 unless sindex % 28 == 0
+  jamo
+end
+def full_expansion(char_hash, code, casefold, decompose, compat)
+  if decompose
+    jamo = hangul_decomposition(code)
+    return jamo if jamo
+  end
+  char = char_hash[code]
+  if casefold and $case_folding[code]
+    return $case_folding[code].flat_map { |cp| full_expansion(char_hash, cp, casefold, decompose, compat) }
+  end
+  if decompose and char and char.decomp_mapping and (char.decomp_type.nil? or compat)
+    return char.decomp_mapping.flat_map { |cp| full_expansion(char_hash, cp, casefold, decompose, compat) }
+  end
+  [code]
+end
+
+# Each row of utf8proc_expansions holds the offsets into
+# utf8proc_expanded_sequences of the full expansion under CASEFOLD alone,
+# then DECOMPOSE, DECOMPOSE|COMPAT, CASEFOLD|DECOMPOSE and
+# CASEFOLD|DECOMPOSE|COMPAT, or UINT16_MAX where the codepoint is left
+# alone.  A sequence starts with its length, with bit 31 set if it contains
+# a default ignorable codepoint.
+$expanded_sequences = []
+expanded_sequence_indicies = {}
+expansion_rows = []
+expansion_row_indicies = {}
+expansion_variants = [[true, false, false], [false, true, false], [false, true, true],
+                      [true, true, false], [true, true, true]]
+char_expansion_index = lambda do |char|
+  next "UINT16_MAX" unless char.decomp_mapping or char.case_folding
+  row = expansion_variants.map do |casefold, decompose, compat|
+    sequence = full_expansion(char_hash, char.code, casefold, decompose, compat)
+    next "UINT16_MAX" if sequence == [char.code]
+    sequence.each do |cp|
+      raise "Unassigned codepoint in expansion: #{cp}" if char_hash[cp].nil?
+    end
+    header = sequence.length
+    header |= 0x80000000 if sequence.any? { |cp| $ignorable.include?(cp) }
+    entry = [header] + sequence
+    idx = expanded_sequence_indicies[entry]
+    unless idx
+      idx = expanded_sequence_indicies[entry] = $expanded_sequences.length
+      $expanded_sequences.concat(entry)
+    end
+    raise "Expanded sequence index out of bound" if idx >= 0xFFFF
+    idx
+  end
+  next "UINT16_MAX" if row.all? { |idx| idx == "UINT16_MAX" }
+  unless expansion_row_indicies[row]
+    expansion_row_indicies[row] = expansion_rows.length
+    expansion_rows << row
+  end
+  expansion_row_indicies[row]
+end
+
 properties_indicies = {}
 properties = []
+# charwidth << 5 | boundclass of each property entry, for width computations
+# that need neither the rest of the entry nor a second lookup
+width_boundclass = [1 << 5 | $boundclasses.index("OTHER")]
+# sentencebreak << 5 | wordbreak of each property entry, see
+# utf8proc_segment_classes in utf8proc.c
+segment_classes = [0]
+hot_properties = []
 chars.each do |char|
   c_entry = char.c_entry(comb_indicies)
-  char.c_entry_index = properties_indicies[c_entry]
+  # the segment classes are not part of the entry, but must match too
+  key = [c_entry, wordclass(char.code), sentenceclass(char.code)]
+  char.c_entry_index = properties_indicies[key]
   unless char.c_entry_index
-    properties_indicies[c_entry] = properties.length
+    properties_indicies[key] = properties.length
     char.c_entry_index = properties.length
     properties << c_entry
+    hot_properties << char.c_hot_entry(comb_indicies, char_expansion_index.call(char))
+    width_boundclass << ($charwidth[char.code] << 5 |
+      $boundclasses.index($grapheme_boundclass[char.code].sub("UTF8PROC_BOUNDCLASS_", "")))
+    segment_classes << (sentenceclass(char.code) << 5 | wordclass(char.code))
   end
 end
 
@@ -356,6 +730,14 @@ for code in 0...0x110000
   end
 end
 
+# the size in bytes of each table in the output, for the report at the end
+$table_sizes = []
+
+$omit.each do |name, omitted|
+  $stdout << "#define UTF8PROC_DATA_NO_#{name.upcase.tr("-", "_")} 1\n" if omitted
+end
+$stdout << "\n" if $omit.values.any?
+
 $stdout << "static const utf8proc_uint16_t utf8proc_sequences[] = {\n  "
 i = 0
 $int_array.each do |entry|
@@ -368,6 +750,9 @@ $int_array.each do |entry|
 end
 $stdout << "};\n\n"
 
+$table_sizes << ["utf8proc_sequences", 2 * $int_array.length]
+
+$stdout << "#ifndef UTF8PROC_COMPACT_STAGE2\n"
 $stdout << "static const utf8proc_uint16_t utf8proc_stage1table[] = {\n  "
 i = 0
 stage1.each do |entry|
@@ -390,37 +775,262 @@ stage2.flatten.each do |entry|
   end
   $stdout << entry << ", "
 end
+$stdout << "};\n"
+$table_sizes << ["utf8proc_stage1table", 2 * stage1.length]
+$table_sizes << ["utf8proc_stage2table", 2 * stage2.length * 0x100]
+
+# With UTF8PROC_COMPACT_STAGE2, each block of the second stage is stored as
+# 8-bit indices into a palette of the distinct property indices of the block
+# (a block of 0x100 codepoints has at most 0x100 of them), and the first
+# stage holds the block numbers.
+raise "Too many stage2 blocks for UTF8PROC_COMPACT_STAGE2" if stage2.length > 0x100
+palettes = []
+palette_offsets = []
+palette_indices = []
+stage2.each do |block|
+  palette = {}
+  block.each { |entry| palette[entry] ||= palette.length }
+  palette_offsets << palettes.length
+  palettes.concat(palette.keys)
+  palette_indices.concat(block.map { |entry| palette[entry] })
+end
+raise "Palettes too large for UTF8PROC_COMPACT_STAGE2" if palettes.length > 0x10000
+
+$stdout << "#else\n"
+$stdout << "static const utf8proc_uint8_t utf8proc_stage1_blocks[] = {\n  "
+i = 0
+stage1.each do |entry|
+  i += 1
+  if i == 8
+    i = 0
+    $stdout << "\n  "
+  end
+  $stdout << (entry / 0x100) << ", "
+end
 $stdout << "};\n\n"
 
+$stdout << "static const utf8proc_uint16_t utf8proc_stage2_palette_offsets[] = {\n  "
+i = 0
+palette_offsets.each do |entry|
+  i += 1
+  if i == 8
+    i = 0
+    $stdout << "\n  "
+  end
+  $stdout << entry << ", "
+end
+$stdout << "};\n\n"
+
+$stdout << "static const utf8proc_uint8_t utf8proc_stage2_palette_indices[] = {\n  "
+i = 0
+palette_indices.each do |entry|
+  i += 1
+  if i == 8
+    i = 0
+    $stdout << "\n  "
+  end
+  $stdout << entry << ", "
+end
+$stdout << "};\n\n"
+
+$stdout << "static const utf8proc_uint16_t utf8proc_stage2_palettes[] = {\n  "
+i = 0
+palettes.each do |entry|
+  i += 1
+  if i == 8
+    i = 0
+    $stdout << "\n  "
+  end
+  $stdout << entry << ", "
+end
+$stdout << "};\n"
+$stdout << "#endif\n\n"
+compact_stage_size = stage1.length + 2 * palette_offsets.length +
+                     palette_indices.length + 2 * palettes.length
+
+$stdout << "#ifndef UTF8PROC_NO_DIRECT_TABLE\n"
+$stdout << "static const utf8proc_uint16_t utf8proc_direct_table[] = {\n  "
+i = 0
+0.upto(0x7FF) do |code|
+  i += 1
+  if i == 8
+    i = 0
+    $stdout << "\n  "
+  end
+  $stdout << stage2[stage1[code >> 8] / 0x100][code & 0xFF] << ", "
+end
+$stdout << "};\n"
+$stdout << "#endif\n\n"
+$table_sizes << ["utf8proc_direct_table", 2 * 0x800]
+
 $stdout << "static const utf8proc_property_t utf8proc_properties[] = {\n"
-$stdout << "  {0, 0, 0, 0, UINT16_MAX, UINT16_MAX, UINT16_MAX, UINT16_MAX, UINT16_MAX, UINT16_MAX,  false,false,false,false, 1, 0, UTF8PROC_BOUNDCLASS_OTHER},\n"
+$stdout << "  {0, 0, 0, 0, UINT16_MAX, UINT16_MAX, UINT16_MAX, UINT16_MAX, UINT16_MAX, UINT16_MAX,  false,false,false,false, 1, 0, UTF8PROC_BOUNDCLASS_OTHER, UTF8PROC_QC_YES, UTF8PROC_QC_YES, UTF8PROC_QC_YES, UTF8PROC_QC_YES},\n"
 properties.each { |line|
   $stdout << line
 }
 $stdout << "};\n\n"
+$table_sizes << ["utf8proc_properties", 24 * (properties.length + 1)]
+
 
 
+$stdout << "#ifndef UTF8PROC_NO_HOT_PROPERTIES\n"
+$stdout << "static const utf8proc_hot_property_t utf8proc_hot_properties[] = {\n"
+$stdout << "  {UINT16_MAX, UINT16_MAX, UINT16_MAX, UINT16_MAX, 0, 0, UTF8PROC_BOUNDCLASS_OTHER, 0, 0, 0, UTF8PROC_QC_YES, UTF8PROC_QC_YES, UTF8PROC_QC_YES, UTF8PROC_QC_YES},\n"
+hot_properties.each { |entry|
+  $stdout << "  " << entry << ",\n"
+}
+$stdout << "};\n\n"
+$table_sizes << ["utf8proc_hot_properties", 12 * (hot_properties.length + 1)]
 
-$stdout << "static const utf8proc_uint16_t utf8proc_combinations[] = {\n  "
+$stdout << "static const utf8proc_uint16_t utf8proc_expansions[][5] = {\n"
+expansion_rows.each { |row|
+  $stdout << "  {" << row.join(", ") << "},\n"
+}
+$stdout << "};\n\n"
+$table_sizes << ["utf8proc_expansions", 10 * expansion_rows.length]
+
+$stdout << "static const utf8proc_uint32_t utf8proc_expanded_sequences[] = {\n  "
 i = 0
-comb1st_indicies.keys.each_index do |a|
-  offset = 0
-  $stdout << comb1st_indicies_firstoffsets[a] << ", " << comb1st_indicies_lastoffsets[a] << ", "
+$expanded_sequences.each do |entry|
+  i += 1
+  if i == 8
+    i = 0
+    $stdout << "\n  "
+  end
+  $stdout << entry << "u, "
+end
+$stdout << "};\n"
+$stdout << "#endif\n\n"
+$table_sizes << ["utf8proc_expanded_sequences", 4 * $expanded_sequences.length]
+
+$stdout << "static const utf8proc_uint8_t utf8proc_width_boundclass[] = {\n  "
+i = 0
+width_boundclass.each do |entry|
+  i += 1
+  if i == 8
+    i = 0
+    $stdout << "\n  "
+  end
+  $stdout << entry << ", "
+end
+$stdout << "};\n\n"
+$table_sizes << ["utf8proc_width_boundclass", width_boundclass.length]
+
+$stdout << "static const utf8proc_uint16_t utf8proc_segment_classes[] = {\n  "
+i = 0
+segment_classes.each do |entry|
+  i += 1
+  if i == 8
+    i = 0
+    $stdout << "\n  "
+  end
+  $stdout << entry << ", "
+end
+$stdout << "};\n\n"
+$table_sizes << ["utf8proc_segment_classes", 2 * segment_classes.length]
+
+# The canonical compositions as a minimal perfect hash: the pair of
+# codepoints (starter, mark) is looked up in utf8proc_compositions at
+# composition_hash(key, salt), where key = starter << 16 ^ mark and salt
+# is utf8proc_composition_salts[composition_hash(key, 0)].  Each entry is
+# starter, mark, composite, where the composite has bit 31 set if it is
+# excluded from composition by UTF8PROC_STABLE.
+def composition_hash(key, salt, n)
+  y = ((key + salt) * 2654435769) & 0xFFFFFFFF
+  y ^= (key * 0x31415926) & 0xFFFFFFFF
+  (y * n) >> 32
+end
+
+compositions = []
+comb1st_indicies.each do |dm0, a|
   comb2nd_indicies_sorted_keys.each_with_index do |dm1, b|
-    break if offset > comb1st_indicies_lastoffsets[a]
-    if offset >= comb1st_indicies_firstoffsets[a]
-      i += 1
-      if i == 8
-        i = 0
-        $stdout << "\n  "
-      end
-      v = comb_array[a][b] ? comb_array[a][b] : 0
-      $stdout << (( v & 0xFFFF0000 ) >> 16) << ", " if comb2nd_indicies_nonbasic[dm1]
-      $stdout << (v & 0xFFFF) << ", "
-    end
-    offset += 1
-    offset += 1 if comb2nd_indicies_nonbasic[dm1]
+    code = comb_array[a][b]
+    next unless code
+    code |= 0x80000000 if $excl_version.include?(code)
+    compositions << [(dm0 << 16) ^ dm1, dm0, dm1, code]
   end
-  $stdout  << "\n"
+end
+composition_count = compositions.length
+raise "ambiguous composition key" if compositions.map { |c| c[0] }.uniq.length != composition_count
+buckets = Array.new(composition_count) { [] }
+compositions.each { |c| buckets[composition_hash(c[0], 0, composition_count)] << c }
+composition_salts = Array.new(composition_count, 0)
+composition_slots = Array.new(composition_count)
+(0...composition_count).sort_by { |b| [-buckets[b].length, b] }.each do |b|
+  next if buckets[b].empty?
+  salt = 1
+  loop do
+    slots = buckets[b].map { |c| composition_hash(c[0], salt, composition_count) }
+    break if slots.uniq.length == slots.length && slots.all? { |slot| composition_slots[slot].nil? }
+    salt += 1
+  end
+  raise "too large composition salt" if salt > 0xFFFF
+  composition_salts[b] = salt
+  buckets[b].each { |c| composition_slots[composition_hash(c[0], salt, composition_count)] = c }
+end
+
+$stdout << "static const utf8proc_uint16_t utf8proc_composition_salts[] = {\n  "
+composition_salts.each_with_index do |salt, index|
+  $stdout << "\n  " if index > 0 && index % 16 == 0
+  $stdout << salt << ", "
 end
 $stdout << "};\n\n"
+
+$stdout << "static const utf8proc_uint32_t utf8proc_compositions[][3] = {\n"
+composition_slots.each do |c|
+  $stdout << "  {" << c[1] << ", " << c[2] << ", " << c[3] << "u},\n"
+end
+$stdout << "};\n\n"
+$table_sizes << ["utf8proc_composition_salts", 2 * composition_count]
+$table_sizes << ["utf8proc_compositions", 12 * composition_count]
+
+$stdout << "/* utf8proc_grapheme_transitions[state][boundclass] is the new state after a\n"
+$stdout << "   codepoint of the given boundclass, ORed with 0x80 if there is a grapheme\n"
+$stdout << "   break before it */\n"
+$stdout << "static const utf8proc_uint8_t utf8proc_grapheme_transitions[][#{$boundclasses.length}] = {\n"
+$boundclasses.each do |state|
+  $stdout << "  {"
+  $stdout << $boundclasses.map { |tbc|
+    (grapheme_break_simple(state, tbc) ? 0x80 : 0) |
+      $boundclasses.index(grapheme_next_state(state, tbc))
+  }.join(", ")
+  $stdout << "},\n"
+end
+$stdout << "};\n"
+
+# transitions of the segment iterator: the new state, ORed with the action
+# << 6 (0 for no break, 1 for a break, 2 to mark and 3 to fail)
+def segment_transitions(name, states, classes)
+  actions = [:none, :break, :mark, :fail]
+  $stdout << "\nstatic const utf8proc_uint8_t #{name}[][#{classes.length}] = {\n"
+  states.each do |state|
+    $stdout << "  {"
+    $stdout << classes.map { |tc|
+      action, next_state = yield(state, tc)
+      raise "no state #{next_state}" unless states.index(next_state)
+      actions.index(action) << 6 | states.index(next_state)
+    }.join(", ")
+    $stdout << "},\n"
+  end
+  $stdout << "};\n"
+end
+
+$stdout << "\n/* utf8proc_word_transitions[state][class] and\n"
+$stdout << "   utf8proc_sentence_transitions[state][class] are the new state of the\n"
+$stdout << "   segment iterator after a codepoint of the given class, ORed with the\n"
+$stdout << "   action << 6 (see data/data_generator.rb) */"
+segment_transitions("utf8proc_word_transitions", $wordstates, $wordclasses) { |state, tc|
+  word_transition(state, tc)
+}
+segment_transitions("utf8proc_sentence_transitions", $sentencestates, $sentenceclasses) { |state, tc|
+  sentence_transition(state, tc)
+}
+
+# report the sizes of the larger tables, to weigh the options above
+stage_size = $table_sizes.select { |name, size| name =~ /stage.table/ }.map { |name, size| size }.inject(:+)
+total = $table_sizes.map { |name, size| size }.inject(:+)
+$stderr << "table sizes in bytes:\n"
+$table_sizes.each { |name, size| $stderr << sprintf("  %-28s %7d\n", name, size) }
+$stderr << sprintf("  %-28s %7d\n", "total", total)
+$stderr << sprintf("  %-28s %7d (stage tables %d instead of %d)\n", "with UTF8PROC_COMPACT_STAGE2",
+                   total - stage_size + compact_stage_size, compact_stage_size, stage_size)
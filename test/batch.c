@@ -0,0 +1,54 @@
+#include "tests.h"
+
+/* the batch lookups must agree with the single-codepoint functions,
+   including for invalid codepoints */
+
+#define FIRST (-16)
+#define LAST 0x110010
+#define N (LAST - FIRST)
+
+int main(int argc, char **argv)
+{
+    utf8proc_int32_t *in = (utf8proc_int32_t *) malloc(N * sizeof(utf8proc_int32_t));
+    utf8proc_int32_t *cases = (utf8proc_int32_t *) malloc(N * sizeof(utf8proc_int32_t));
+    utf8proc_propval_t *values = (utf8proc_propval_t *) malloc(N * sizeof(utf8proc_propval_t));
+    const utf8proc_property_t **properties = (const utf8proc_property_t **) malloc(N * sizeof(utf8proc_property_t *));
+    int *widths = (int *) malloc(N * sizeof(int));
+    utf8proc_int32_t i;
+
+    (void) argc; /* unused */
+    (void) argv; /* unused */
+
+    for (i = 0; i < N; i++) in[i] = FIRST + i;
+
+    utf8proc_get_property_batch(in, N, properties);
+    for (i = 0; i < N; i++)
+        check(properties[i] == utf8proc_get_property(in[i]), "wrong property of %d", in[i]);
+    utf8proc_category_batch(in, N, values);
+    for (i = 0; i < N; i++)
+        check(values[i] == (utf8proc_propval_t) utf8proc_category(in[i]), "wrong category of %d", in[i]);
+    utf8proc_charwidth_batch(in, N, widths);
+    for (i = 0; i < N; i++)
+        check(widths[i] == utf8proc_charwidth(in[i]), "wrong width of %d", in[i]);
+    utf8proc_boundclass_batch(in, N, values);
+    for (i = 0; i < N; i++)
+        check(values[i] == utf8proc_get_property(in[i])->boundclass, "wrong boundclass of %d", in[i]);
+    utf8proc_combining_class_batch(in, N, values);
+    for (i = 0; i < N; i++)
+        check(values[i] == utf8proc_get_property(in[i])->combining_class, "wrong combining class of %d", in[i]);
+    utf8proc_tolower_batch(in, N, cases);
+    for (i = 0; i < N; i++)
+        check(cases[i] == utf8proc_tolower(in[i]), "wrong lowercase of %d", in[i]);
+    utf8proc_toupper_batch(in, N, cases);
+    for (i = 0; i < N; i++)
+        check(cases[i] == utf8proc_toupper(in[i]), "wrong uppercase of %d", in[i]);
+    /* in place */
+    memcpy(cases, in, N * sizeof(utf8proc_int32_t));
+    utf8proc_totitle_batch(cases, N, cases);
+    for (i = 0; i < N; i++)
+        check(cases[i] == utf8proc_totitle(in[i]), "wrong titlecase of %d", in[i]);
+
+    free(in); free(cases); free(values); free(properties); free(widths);
+    printf("Batch property tests SUCCEEDED.\n");
+    return 0;
+}
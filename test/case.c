@@ -1,6 +1,89 @@
 #include "tests.h"
 #include <wctype.h>
 
+/* the expected result of utf8proc_tolower/toupper_utf8 of str[0..len):
+   the codepoint-wise mapping */
+static utf8proc_ssize_t map_codepoints(const utf8proc_uint8_t *str, utf8proc_ssize_t len,
+                                       utf8proc_uint8_t *dst, int upper)
+{
+     utf8proc_ssize_t pos = 0, dpos = 0;
+     while (pos < len) {
+          utf8proc_int32_t c;
+          pos += utf8proc_iterate(str + pos, len - pos, &c);
+          dpos += utf8proc_encode_char(upper ? utf8proc_toupper(c) : utf8proc_tolower(c), dst + dpos);
+     }
+     dst[dpos] = 0;
+     return dpos;
+}
+
+static void string_tests(void)
+{
+     utf8proc_uint8_t src[4096], buf[4200], expected[4200], *folded;
+     utf8proc_ssize_t len, n, elen;
+     utf8proc_int32_t c;
+     int i;
+
+     /* every codepoint on its own */
+     for (c = 0; c < 0x110000; ++c) {
+          if (!utf8proc_codepoint_valid(c)) continue;
+          len = utf8proc_encode_char(c, src);
+          elen = map_codepoints(src, len, expected, 0);
+          check(utf8proc_tolower_utf8(src, len, buf, sizeof(buf)) == elen &&
+                !memcmp(buf, expected, elen + 1), "utf8proc_tolower_utf8 mismatch for %x", c);
+          elen = map_codepoints(src, len, expected, 1);
+          check(utf8proc_toupper_utf8(src, len, buf, sizeof(buf)) == elen &&
+                !memcmp(buf, expected, elen + 1), "utf8proc_toupper_utf8 mismatch for %x", c);
+          elen = utf8proc_map(src, len, &folded, UTF8PROC_CASEFOLD);
+          check(utf8proc_casefold_utf8(src, len, buf, sizeof(buf)) == elen &&
+                !memcmp(buf, folded, elen + 1), "utf8proc_casefold_utf8 mismatch for %x", c);
+          free(folded);
+     }
+
+     /* mixed strings with ASCII runs, also converted in place */
+     srand(1);
+     for (i = 0; i < 2000; ++i) {
+          len = 0;
+          while (len < 4000) {
+               static const char *pieces[] = {
+                    "Hello, World! ", "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz",
+                    "\xc3\x84\xc3\xa4", "\xce\xa3\xcf\x83", "\xc3\x9f", "\xe1\xba\x9e",
+                    "\xd0\x96\xd0\xb6", "\xe2\x84\xaa", "\xef\xac\x80", "\xf0\x90\x90\x80"
+               };
+               const char *p = pieces[rand() % 10];
+               memcpy(src + len, p, strlen(p));
+               len += strlen(p);
+          }
+          elen = map_codepoints(src, len, expected, i & 1);
+          n = i & 1 ? utf8proc_toupper_utf8(src, len, buf, sizeof(buf)) :
+                      utf8proc_tolower_utf8(src, len, buf, sizeof(buf));
+          check(n == elen && !memcmp(buf, expected, elen + 1), "mixed string case mismatch");
+          elen = utf8proc_map(src, len, &folded, UTF8PROC_CASEFOLD);
+          check(utf8proc_casefold_utf8(src, len, buf, sizeof(buf)) == elen &&
+                !memcmp(buf, folded, elen + 1), "mixed string casefold mismatch");
+          free(folded);
+          /* none of the pieces lowercases to a longer encoding (but U+00DF
+             uppercases to the 3-byte U+1E9E) */
+          memcpy(buf, src, len);
+          elen = map_codepoints(src, len, expected, 0);
+          check(utf8proc_tolower_utf8(buf, len, buf, sizeof(buf)) == elen &&
+                !memcmp(buf, expected, elen + 1), "in-place case mismatch");
+     }
+
+     /* results that do not fit, and errors */
+     memcpy(src, "ABC\xc3\x84", 6);
+     check(utf8proc_tolower_utf8(src, 5, NULL, 0) == 5 &&
+           utf8proc_tolower_utf8(src, 5, buf, 5) == 5,
+           "utf8proc_tolower_utf8 with a short buffer");
+     check(utf8proc_tolower_utf8(src, -1, buf, sizeof(buf)) == 5 &&
+           !strcmp((char *) buf, "abc\xc3\xa4"), "utf8proc_tolower_utf8 of a NUL-terminated string");
+     memcpy(src, "\xc8\xba\xc8\xba", 5); /* U+023A lowercases to the 3-byte U+2C65 */
+     check(utf8proc_tolower_utf8(src, 4, src, sizeof(src)) == UTF8PROC_ERROR_OVERFLOW,
+           "utf8proc_tolower_utf8 growing in place");
+     memcpy(src, "AB\xff", 4);
+     check(utf8proc_tolower_utf8(src, 3, src, sizeof(src)) == UTF8PROC_ERROR_INVALIDUTF8 &&
+           !memcmp(src, "AB\xff", 4), "utf8proc_tolower_utf8 of invalid UTF-8");
+}
+
 int main(int argc, char **argv)
 {
      int error = 0, better = 0;
@@ -67,6 +150,8 @@ int main(int argc, char **argv)
            !strcmp((char*)utf8proc_NFKC_Casefold(str_1e9e), "ss"),
            "incorrect 0x00df/0x1e9e casefold normalization");
 
+     string_tests();
+
      printf("More up-to-date than OS unicode tables for %d tests.\n", better);
      printf("utf8proc case conversion tests SUCCEEDED.\n");
      return 0;
@@ -14,6 +14,72 @@ static int my_isprint(int c) {
            (cat == UTF8PROC_CATEGORY_CN) || (cat == UTF8PROC_CATEGORY_CO);
 }
 
+/* check utf8proc_strwidth and utf8proc_strwidth_prefix on str[0..len)
+   against the widths of the clusters found by utf8proc_grapheme_next */
+static void check_strwidth(const utf8proc_uint8_t *str, utf8proc_ssize_t len)
+{
+    utf8proc_ssize_t ends[4096], widths[4096]; /* cluster ends, widths up to them */
+    utf8proc_ssize_t n = 0, start = 0, end, w, maxwidth, i;
+    utf8proc_grapheme_iterator_t iter;
+    utf8proc_grapheme_init(&iter, str, len);
+    while ((end = utf8proc_grapheme_next(&iter)) > 0) {
+        utf8proc_ssize_t pos = start;
+        int cw = 0;
+        while (pos < end) {
+            utf8proc_int32_t c;
+            pos += utf8proc_iterate(str + pos, end - pos, &c);
+            if (utf8proc_charwidth(c) > cw) cw = utf8proc_charwidth(c);
+        }
+        widths[n] = (n ? widths[n-1] : 0) + cw;
+        ends[n++] = start = end;
+    }
+    check(end == 0, "invalid UTF-8 in width test");
+    check(utf8proc_strwidth(str, len) == (n ? widths[n-1] : 0), "utf8proc_strwidth mismatch");
+    for (maxwidth = 0; maxwidth <= (n ? widths[n-1] : 0) + 1; ++maxwidth) {
+        for (i = n; i > 0 && widths[i-1] > maxwidth; --i) ;
+        check(utf8proc_strwidth_prefix(str, len, maxwidth, &w) == (i ? ends[i-1] : 0) &&
+              w == (i ? widths[i-1] : 0),
+              "utf8proc_strwidth_prefix mismatch for width %zd", maxwidth);
+    }
+}
+
+static void strwidth_tests(void)
+{
+    /* ASCII (including controls and CR LF), marks, ZWJ sequences, Hangul
+       jamo, prepended concatenation marks, wide characters */
+    static const utf8proc_int32_t pieces[] = {
+        'a', 'b', ' ', '~', '\t', '\r', '\n', 0x7f, 0x301, 0x200d, 0x1f468,
+        0x1f469, 0x1f3fb, 0x1100, 0x1161, 0x11a8, 0x600, 0x4e00, 0xfe0f, 0xad,
+        0x1f1e6, 0xe9
+    };
+    utf8proc_uint8_t str[4096]; /* at most 60 pieces of up to 40 bytes */
+    int round, i;
+    check(utf8proc_strwidth((const utf8proc_uint8_t *) "", 0) == 0, "width of empty string");
+    check(utf8proc_strwidth((const utf8proc_uint8_t *) "e\xcc\x81t\xe4\xb8\x80", -1) == 4,
+          "width of NUL-terminated string");
+    check(utf8proc_strwidth((const utf8proc_uint8_t *) "ab\xff", 3) == UTF8PROC_ERROR_INVALIDUTF8,
+          "width of invalid UTF-8");
+    check(utf8proc_strwidth_prefix((const utf8proc_uint8_t *) "ab\xff", 3, 1, NULL) == 1,
+          "width prefix ending before invalid UTF-8");
+    srand(1);
+    for (round = 0; round < 20000; ++round) {
+        utf8proc_ssize_t len = 0;
+        int n = rand() % 60;
+        for (i = 0; i < n; ++i) {
+            if (rand() % 3 == 0) {
+                /* a run of ASCII, long enough for the vectorized paths */
+                int k, runlen = rand() % 40;
+                for (k = 0; k < runlen; ++k)
+                    str[len++] = rand() % 7 ? 'x' : (k & 1 ? '\r' : '\n');
+            }
+            else
+                len += utf8proc_encode_char(pieces[rand() % (sizeof(pieces) / sizeof(pieces[0]))],
+                                            str + len);
+        }
+        check_strwidth(str, len);
+    }
+}
+
 int main(int argc, char **argv)
 {
     int c, error = 0, updates = 0;
@@ -71,6 +137,7 @@ int main(int argc, char **argv)
             printf("  wcwidth(%x) = %d != charwidth %d\n", c, wc, w);
     }
     printf("   ... (positive widths for %d chars unknown to wcwidth) ...\n", updates);
+    strwidth_tests();
     printf("Character-width tests SUCCEEDED.\n");
 
     return 0;
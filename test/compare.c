@@ -0,0 +1,125 @@
+#include "tests.h"
+
+/* forms of the same text under some of the options below */
+static const char *variants[][3] = {
+    {"A\xcc\x8a", "\xc3\x85", "\xe2\x84\xab"},                   /* A + ring, Å, Angstrom sign */
+    {"Stra\xc3\x9f" "e", "STRASSE", "strasse"},
+    {"\xef\xac\x81", "fi", "FI"},                                /* fi ligature */
+    {"\xea\xb0\x80", "\xe1\x84\x80\xe1\x85\xa1", "\xea\xb0\x80"}, /* Hangul syllable and jamo */
+    {"q\xcc\xa3\xcc\x87", "q\xcc\x87\xcc\xa3", "Q\xcc\xa3\xcc\x87"}, /* marks in either order */
+    {"\r\n", "\n", "\r"},
+    {"The quick brown fox jumps over the lazy dog", "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG",
+     "the quick brown fox jumps over the lazy dog"},
+    {"\xef\xb7\xba", "x\xc2\xad", "\xe2\x80\x98"}                 /* U+FDFA, soft hyphen, quote */
+};
+
+static const utf8proc_option_t options[] = {
+    UTF8PROC_STABLE | UTF8PROC_COMPOSE,
+    UTF8PROC_STABLE | UTF8PROC_DECOMPOSE,
+    UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_COMPAT | UTF8PROC_CASEFOLD | UTF8PROC_IGNORE,
+    UTF8PROC_DECOMPOSE | UTF8PROC_CASEFOLD,
+    UTF8PROC_COMPOSE | UTF8PROC_CHARBOUND | UTF8PROC_NLF2LF | UTF8PROC_STRIPCC | UTF8PROC_LUMP,
+    UTF8PROC_CASEFOLD
+};
+
+static utf8proc_uint64_t fnv1a(const utf8proc_uint8_t *str, utf8proc_ssize_t len)
+{
+    utf8proc_uint64_t h = 0xcbf29ce484222325ULL;
+    utf8proc_ssize_t i;
+    for (i = 0; i < len; i++) {
+        h ^= str[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/* build a random string of `n` variants into `str`, taking the same
+   choices as the last call made with the same `seed`, except that now and
+   then another variant or text is picked */
+static size_t random_string(char *str, unsigned seed, int n)
+{
+    size_t len = 0, i;
+    int k;
+    for (k = 0; k < n; k++) {
+        const char *v;
+        seed = seed * 1103515245 + 12345;
+        i = (seed >> 16) % (sizeof(variants) / sizeof(variants[0]));
+        v = variants[i][rand() % 3];
+        if (rand() % 16 == 0) v = "\xcc\x81";
+        if ((seed >> 8) % 8 == 0)
+            for (i = 0; i < 300; i++) len += (size_t) sprintf(str + len, "\xcc\x81"); /* long run of marks */
+        len += (size_t) sprintf(str + len, "%s", v);
+    }
+    return len;
+}
+
+static void check_pair(const char *str1, size_t len1, const char *str2, size_t len2, utf8proc_option_t options)
+{
+    utf8proc_uint8_t *mapped1, *mapped2;
+    utf8proc_ssize_t m1, m2, result;
+    utf8proc_uint64_t hash;
+    int order, expected;
+    m1 = utf8proc_map((const utf8proc_uint8_t *) str1, (utf8proc_ssize_t) len1, &mapped1, options);
+    m2 = utf8proc_map((const utf8proc_uint8_t *) str2, (utf8proc_ssize_t) len2, &mapped2, options);
+    check(m1 >= 0 && m2 >= 0, "utf8proc_map failed");
+    expected = memcmp(mapped1, mapped2, (size_t) (m1 < m2 ? m1 : m2));
+    if (!expected) expected = (m1 > m2) - (m1 < m2);
+    expected = (expected > 0) - (expected < 0);
+
+    result = utf8proc_compare((const utf8proc_uint8_t *) str1, (utf8proc_ssize_t) len1,
+                              (const utf8proc_uint8_t *) str2, (utf8proc_ssize_t) len2, options, &order);
+    check(result == 0 && order == expected, "utf8proc_compare gave %d (error %zd) instead of %d for options %x",
+          order, result, expected, (unsigned) options);
+    result = utf8proc_equal((const utf8proc_uint8_t *) str1, (utf8proc_ssize_t) len1,
+                            (const utf8proc_uint8_t *) str2, (utf8proc_ssize_t) len2, options);
+    check(result == (expected == 0), "utf8proc_equal gave %zd for options %x", result, (unsigned) options);
+    result = utf8proc_hash((const utf8proc_uint8_t *) str1, (utf8proc_ssize_t) len1, options, &hash);
+    check(result == m1 && hash == fnv1a(mapped1, m1), "utf8proc_hash mismatch for options %x", (unsigned) options);
+    free(mapped1);
+    free(mapped2);
+}
+
+int main(int argc, char **argv)
+{
+    static char str1[65536], str2[65536];
+    const utf8proc_uint8_t *invalid = (const utf8proc_uint8_t *) "abc\xff";
+    utf8proc_uint64_t hash;
+    utf8proc_ssize_t result;
+    size_t i, j, len1, len2;
+    int order;
+
+    (void) argc; /* unused */
+    (void) argv; /* unused */
+
+    srand(1);
+    for (i = 0; i < 500; i++) {
+        unsigned seed = (unsigned) rand();
+        int n = rand() % 40;
+        len1 = random_string(str1, seed, n);
+        len2 = random_string(str2, seed, n + (rand() % 8 == 0));
+        for (j = 0; j < sizeof(options) / sizeof(options[0]); j++)
+            check_pair(str1, len1, str2, len2, options[j]);
+    }
+
+    check(utf8proc_equal((const utf8proc_uint8_t *) "Stra\xc3\x9f" "e", 0, (const utf8proc_uint8_t *) "STRASSE", 0,
+                         UTF8PROC_NULLTERM | UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_COMPAT |
+                         UTF8PROC_CASEFOLD | UTF8PROC_IGNORE) == 1,
+          "case-insensitive comparison of NUL-terminated strings failed");
+    check(utf8proc_hash((const utf8proc_uint8_t *) "", 0, UTF8PROC_COMPOSE, &hash) == 0 &&
+          hash == 0xcbf29ce484222325ULL, "wrong hash of the empty string");
+
+    result = utf8proc_compare(invalid, 4, (const utf8proc_uint8_t *) "abc", 3, UTF8PROC_COMPOSE, &order);
+    check(result == UTF8PROC_ERROR_INVALIDUTF8, "invalid UTF-8 was not detected");
+    memset(str1, 'a', 1000);
+    str1[1000] = '\xff';
+    result = utf8proc_compare((const utf8proc_uint8_t *) str1, 1001, (const utf8proc_uint8_t *) "b", 1,
+                              UTF8PROC_COMPOSE, &order);
+    check(result == 0 && order == -1, "comparison did not stop at the first difference");
+    check(utf8proc_hash(invalid, 4, UTF8PROC_CASEFOLD, &hash) == UTF8PROC_ERROR_INVALIDUTF8,
+          "invalid UTF-8 was not detected by utf8proc_hash");
+    check(utf8proc_equal(invalid, 1, invalid, 1, UTF8PROC_COMPOSE | UTF8PROC_DECOMPOSE) == UTF8PROC_ERROR_INVALIDOPTS,
+          "invalid options were not detected");
+
+    printf("compare tests SUCCEEDED.\n");
+    return 0;
+}
@@ -0,0 +1,133 @@
+#include "tests.h"
+
+/* the _ctx variants of the mapping functions, which reuse the buffers of
+   a utf8proc_context_t */
+
+static utf8proc_int32_t upcase_x(utf8proc_int32_t codepoint, void *data)
+{
+    (void) data; /* unused */
+    return codepoint == 'x' ? 'X' : codepoint;
+}
+
+/* map `str` with `context` and compare the result with utf8proc_map_custom */
+static void check_map(utf8proc_context_t *context, const char *str, utf8proc_option_t options)
+{
+    utf8proc_uint8_t *expected;
+    const utf8proc_uint8_t *output;
+    utf8proc_ssize_t len, clen;
+
+    len = utf8proc_map_custom((const utf8proc_uint8_t *) str, (utf8proc_ssize_t) strlen(str),
+                              &expected, options, upcase_x, NULL);
+    clen = utf8proc_map_custom_ctx(context, (const utf8proc_uint8_t *) str, (utf8proc_ssize_t) strlen(str),
+                                   &output, options, upcase_x, NULL);
+    check(clen == len, "map_custom_ctx length %zd instead of %zd", clen, len);
+    if (len >= 0) {
+        check(!memcmp(output, expected, (size_t) len + 1), "incorrect map_custom_ctx result for \"%s\"", str);
+        free(expected);
+    } else {
+        check(output == NULL, "map_custom_ctx output on error");
+    }
+}
+
+/* decompose `str` with `context` and compare the result with utf8proc_decompose_custom */
+static void check_decompose(utf8proc_context_t *context, const char *str, utf8proc_option_t options)
+{
+    utf8proc_int32_t expected[1024];
+    const utf8proc_int32_t *output;
+    utf8proc_ssize_t len, clen;
+
+    len = utf8proc_decompose_custom((const utf8proc_uint8_t *) str, (utf8proc_ssize_t) strlen(str),
+                                    expected, 1024, options, upcase_x, NULL);
+    clen = utf8proc_decompose_custom_ctx(context, (const utf8proc_uint8_t *) str, (utf8proc_ssize_t) strlen(str),
+                                         &output, options, upcase_x, NULL);
+    check(clen == len, "decompose_custom_ctx length %zd instead of %zd", clen, len);
+    check(len < 0 || !memcmp(output, expected, (size_t) len * sizeof(utf8proc_int32_t)),
+          "incorrect decompose_custom_ctx result for \"%s\"", str);
+}
+
+int main(int argc, char **argv)
+{
+    static const char *strings[] = {
+        "",
+        "x",
+        "e\xcc\x81 and x",
+        "a\xcc\x81\xcc\xa3 \xe1\x84\x80\xe1\x85\xa1\xe1\x86\xa8", /* marks to reorder, Hangul L V T */
+        "ABC\r\nDEF\xef\xbc\xa1\xc3\x9f\xe2\x80\xa8\xf0\x9f\x87\xa9\xf0\x9f\x87\xaa!",
+        "The quick brown fox jumps over the lazy dog, twice: THE QUICK BROWN FOX\xcc\x88",
+        "\xef\xac\x81\xef\xac\x81\xef\xac\x81\xef\xac\x81\xef\xac\x81\xef\xac\x81\xef\xac\x81\xef\xac\x81", /* fi ligatures */
+        "x\xff"
+    };
+    static const utf8proc_option_t options[] = {
+        UTF8PROC_STABLE | UTF8PROC_COMPOSE,
+        UTF8PROC_STABLE | UTF8PROC_DECOMPOSE | UTF8PROC_COMPAT,
+        UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_COMPAT | UTF8PROC_CASEFOLD | UTF8PROC_IGNORE,
+        UTF8PROC_COMPOSE | UTF8PROC_CHARBOUND | UTF8PROC_NLF2LS | UTF8PROC_LUMP
+    };
+    counting_allocator counts;
+    utf8proc_allocator_t allocator;
+    utf8proc_context_t *context;
+    const utf8proc_uint8_t *output;
+    const utf8proc_int32_t *codepoints;
+    char marks[2 * 1000 + 3];
+    size_t i, j, calls;
+    utf8proc_ssize_t len;
+
+    (void) argc; /* unused */
+    (void) argv; /* unused */
+
+    init_counting_allocator(&allocator, &counts);
+    check(utf8proc_context_new(&context, &allocator) == 0 && context != NULL, "utf8proc_context_new failed");
+    check(counts.live == 1, "context not allocated with its allocator");
+
+    for (i = 0; i < sizeof(strings) / sizeof(strings[0]); i++)
+        for (j = 0; j < sizeof(options) / sizeof(options[0]); j++) {
+            check_map(context, strings[i], options[j]);
+            check_decompose(context, strings[i], options[j] & ~UTF8PROC_COMPOSE);
+        }
+
+    /* a long run of marks grows the window, which then is kept as well */
+    marks[0] = 'o';
+    for (i = 0; i < 1000; i++) memcpy(marks + 1 + 2 * i, i % 2 ? "\xcc\x88" : "\xcc\xa3", 2);
+    marks[2 * 1000 + 1] = 'x';
+    marks[2 * 1000 + 2] = 0;
+    check_map(context, marks, UTF8PROC_STABLE | UTF8PROC_COMPOSE);
+    check_decompose(context, marks, UTF8PROC_STABLE | UTF8PROC_DECOMPOSE);
+
+    /* once the buffers are large enough, nothing is allocated */
+    calls = counts.calls;
+    for (i = 0; i < 100; i++) {
+        check_map(context, strings[i % 6], options[i % 4]);
+        check_decompose(context, strings[i % 6], options[i % 4] & ~UTF8PROC_COMPOSE);
+        len = utf8proc_map_custom_ctx(context, (const utf8proc_uint8_t *) marks, 0, &output,
+                                      UTF8PROC_NULLTERM | UTF8PROC_STABLE | UTF8PROC_COMPOSE, NULL, NULL);
+        check(len > 2 * 1000 && strlen((const char *) output) == (size_t) len,
+              "wrong length of the mapped marks");
+    }
+    check(counts.calls == calls, "%d allocations in the steady state", (int) (counts.calls - calls));
+
+    output = utf8proc_NFC_ctx(context, (const utf8proc_uint8_t *) "A\xcc\x8a");
+    check(output && !strcmp((const char *) output, "\xc3\x85"), "incorrect NFC_ctx result");
+    output = utf8proc_NFD_ctx(context, (const utf8proc_uint8_t *) "\xc3\x85");
+    check(output && !strcmp((const char *) output, "A\xcc\x8a"), "incorrect NFD_ctx result");
+    output = utf8proc_NFKC_ctx(context, (const utf8proc_uint8_t *) "\xef\xac\x81");
+    check(output && !strcmp((const char *) output, "fi"), "incorrect NFKC_ctx result");
+    output = utf8proc_NFKD_ctx(context, (const utf8proc_uint8_t *) "\xe2\x84\xab");
+    check(output && !strcmp((const char *) output, "A\xcc\x8a"), "incorrect NFKD_ctx result");
+    output = utf8proc_NFKC_Casefold_ctx(context, (const utf8proc_uint8_t *) "\xc3\x85\xc2\xad");
+    check(output && !strcmp((const char *) output, "\xc3\xa5"), "incorrect NFKC_Casefold_ctx result");
+    check(utf8proc_NFC_ctx(context, (const utf8proc_uint8_t *) "\xff") == NULL, "NFC_ctx of invalid UTF-8");
+
+    /* trimming releases the buffers, which are allocated again as needed */
+    utf8proc_context_trim(context);
+    check(counts.live == 1, "%d blocks left after utf8proc_context_trim", (int) counts.live);
+    check(utf8proc_decompose_custom_ctx(context, (const utf8proc_uint8_t *) "", 0, &codepoints,
+                                        UTF8PROC_DECOMPOSE, NULL, NULL) == 0 && codepoints != NULL,
+          "no buffer for an empty decomposition");
+    check_map(context, strings[3], options[0]);
+
+    utf8proc_context_free(context);
+    check(counts.live == 0, "%d blocks leaked by the context", (int) counts.live);
+
+    printf("Context tests SUCCEEDED.\n");
+    return 0;
+}
@@ -1,5 +1,122 @@
 #include "tests.h"
 
+/* reference implementation of the break rules, as utf8proc evaluated them
+   before they were compiled into a transition table */
+static utf8proc_bool ref_break_simple(int lbc, int tbc) {
+  return
+    (lbc == UTF8PROC_BOUNDCLASS_START) ? true :       // GB1
+    (lbc == UTF8PROC_BOUNDCLASS_CR &&                 // GB3
+     tbc == UTF8PROC_BOUNDCLASS_LF) ? false :         // ---
+    (lbc >= UTF8PROC_BOUNDCLASS_CR && lbc <= UTF8PROC_BOUNDCLASS_CONTROL) ? true :  // GB4
+    (tbc >= UTF8PROC_BOUNDCLASS_CR && tbc <= UTF8PROC_BOUNDCLASS_CONTROL) ? true :  // GB5
+    (lbc == UTF8PROC_BOUNDCLASS_L &&                  // GB6
+     (tbc == UTF8PROC_BOUNDCLASS_L ||                 // ---
+      tbc == UTF8PROC_BOUNDCLASS_V ||                 // ---
+      tbc == UTF8PROC_BOUNDCLASS_LV ||                // ---
+      tbc == UTF8PROC_BOUNDCLASS_LVT)) ? false :      // ---
+    ((lbc == UTF8PROC_BOUNDCLASS_LV ||                // GB7
+      lbc == UTF8PROC_BOUNDCLASS_V) &&                // ---
+     (tbc == UTF8PROC_BOUNDCLASS_V ||                 // ---
+      tbc == UTF8PROC_BOUNDCLASS_T)) ? false :        // ---
+    ((lbc == UTF8PROC_BOUNDCLASS_LVT ||               // GB8
+      lbc == UTF8PROC_BOUNDCLASS_T) &&                // ---
+     tbc == UTF8PROC_BOUNDCLASS_T) ? false :          // ---
+    (tbc == UTF8PROC_BOUNDCLASS_EXTEND ||             // GB9
+     tbc == UTF8PROC_BOUNDCLASS_ZWJ ||                // ---
+     tbc == UTF8PROC_BOUNDCLASS_SPACINGMARK ||        // GB9a
+     lbc == UTF8PROC_BOUNDCLASS_PREPEND) ? false :    // GB9b
+    (lbc == UTF8PROC_BOUNDCLASS_E_ZWG &&              // GB11 (requires additional handling below)
+     tbc == UTF8PROC_BOUNDCLASS_EXTENDED_PICTOGRAPHIC) ? false : // ----
+    (lbc == UTF8PROC_BOUNDCLASS_REGIONAL_INDICATOR &&          // GB12/13 (requires additional handling below)
+     tbc == UTF8PROC_BOUNDCLASS_REGIONAL_INDICATOR) ? false :  // ----
+    true; // GB999
+}
+
+static utf8proc_bool ref_break_extended(int lbc, int tbc, utf8proc_int32_t *state)
+{
+  int lbc_override = ((state && *state != UTF8PROC_BOUNDCLASS_START)
+                      ? *state : lbc);
+  utf8proc_bool break_permitted = ref_break_simple(lbc_override, tbc);
+  if (state) {
+    // Special support for GB 12/13 made possible by GB999. After two RI
+    // class codepoints we want to force a break. Do this by resetting the
+    // second RI's bound class to UTF8PROC_BOUNDCLASS_OTHER, to force a break
+    // after that character according to GB999 (unless of course such a break is
+    // forbidden by a different rule such as GB9).
+    if (*state == tbc && tbc == UTF8PROC_BOUNDCLASS_REGIONAL_INDICATOR)
+      *state = UTF8PROC_BOUNDCLASS_OTHER;
+    // Special support for GB11 (emoji extend* zwj / emoji)
+    else if (*state == UTF8PROC_BOUNDCLASS_EXTENDED_PICTOGRAPHIC) {
+      if (tbc == UTF8PROC_BOUNDCLASS_EXTEND) // fold EXTEND codepoints into emoji
+        *state = UTF8PROC_BOUNDCLASS_EXTENDED_PICTOGRAPHIC;
+      else if (tbc == UTF8PROC_BOUNDCLASS_ZWJ)
+        *state = UTF8PROC_BOUNDCLASS_E_ZWG; // state to record emoji+zwg combo
+      else
+        *state = tbc;
+    }
+    else
+      *state = tbc;
+  }
+  return break_permitted;
+}
+
+/* check utf8proc_grapheme_break(_stateful) against the reference rules for
+   every pair of boundclasses and every state */
+static void check_transitions(void)
+{
+    utf8proc_int32_t rep[UTF8PROC_BOUNDCLASS_E_ZWG + 1]; /* a codepoint of each boundclass */
+    utf8proc_int32_t c, state, ref_state;
+    int lbc, tbc, s;
+    for (lbc = 0; lbc <= UTF8PROC_BOUNDCLASS_E_ZWG; ++lbc)
+        rep[lbc] = -1;
+    for (c = 0x10FFFF; c >= 0; --c)
+        rep[utf8proc_get_property(c)->boundclass] = c;
+    for (lbc = 0; lbc <= UTF8PROC_BOUNDCLASS_E_ZWG; ++lbc) {
+        if (rep[lbc] < 0) continue;
+        for (tbc = 0; tbc <= UTF8PROC_BOUNDCLASS_E_ZWG; ++tbc) {
+            if (rep[tbc] < 0) continue;
+            check(utf8proc_grapheme_break(rep[lbc], rep[tbc]) ==
+                  ref_break_extended(lbc, tbc, NULL),
+                  "grapheme break mismatch for boundclasses %d, %d", lbc, tbc);
+            for (s = -1; s <= UTF8PROC_BOUNDCLASS_E_ZWG + 1; ++s) {
+                state = ref_state = s;
+                check(utf8proc_grapheme_break_stateful(rep[lbc], rep[tbc], &state) ==
+                      ref_break_extended(lbc, tbc, &ref_state) && state == ref_state,
+                      "grapheme break mismatch for boundclasses %d, %d in state %d",
+                      lbc, tbc, s);
+            }
+        }
+    }
+}
+
+/* check utf8proc_grapheme_next and utf8proc_grapheme_truncate against the
+   expected segmentation src (with '/' before each grapheme) of utf8 */
+static void check_iterator(const utf8proc_uint8_t *utf8, utf8proc_ssize_t len,
+                           const utf8proc_uint8_t *src)
+{
+    utf8proc_grapheme_iterator_t iter;
+    utf8proc_uint8_t g[1024];
+    utf8proc_ssize_t start = 0, end, gi = 0, n = 0;
+    utf8proc_grapheme_init(&iter, utf8, len);
+    while ((end = utf8proc_grapheme_next(&iter)) > 0) {
+        check(end > start && end <= len, "grapheme iterator returned %zd", end);
+        g[gi++] = '/';
+        memcpy(g + gi, utf8 + start, end - start);
+        gi += end - start;
+        ++n;
+        check(utf8proc_grapheme_truncate(utf8, len, n) == end,
+              "utf8proc_grapheme_truncate(%zd) mismatch", n);
+        start = end;
+    }
+    check(end == 0 && start == len, "grapheme iterator stopped at %zd", start);
+    check(utf8proc_grapheme_truncate(utf8, len, n + 1) == len &&
+          utf8proc_grapheme_truncate(utf8, len, 0) == 0,
+          "utf8proc_grapheme_truncate mismatch at the ends");
+    g[gi] = 0;
+    check(!strcmp((char*)g, (char*)src),
+          "grapheme iterator mismatch: \"%s\" instead of \"%s\"", (char*)g, (char*)src);
+}
+
 int main(int argc, char **argv)
 {
     char *buf = NULL;
@@ -8,6 +125,7 @@ int main(int argc, char **argv)
     utf8proc_uint8_t src[1024];
     int len;
     
+    check_transitions();
     check(f != NULL, "error opening GraphemeBreakTest.txt");
     while (getline(&buf, &bufsize, f) > 0) {
         size_t bi = 0, si = 0;
@@ -64,6 +182,7 @@ int main(int argc, char **argv)
                           g[i] = '/'; /* easier-to-read output (/ is not in test strings) */
                  check(!strcmp((char*)g, (char*)src),
                        "grapheme mismatch: \"%s\" instead of \"%s\"", (char*)g, (char*)src);
+                 check_iterator(utf8, j, src);
             }
             free(g);
         }
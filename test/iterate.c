@@ -8,6 +8,32 @@ static  int     error;
 #define CHECKVALID(pos, val, len) buf[pos] = val; testbytes(buf,len,len,__LINE__)
 #define CHECKINVALID(pos, val, len) buf[pos] = val; testbytes(buf,len,UTF8PROC_ERROR_INVALIDUTF8,__LINE__)
 
+/* utf8proc_validate must agree, wherever the sequence sits in a string */
+static void testvalidate(unsigned char *buf, int len, utf8proc_ssize_t retval, int line)
+{
+    unsigned char text[64];
+    utf8proc_ssize_t ret, offset;
+    int pad, end;
+
+    for (pad = 0; pad < 36; pad++) {
+        for (end = pad + len; end <= pad + len + 16; end += 16) {
+            memset(text, 'a', sizeof(text));
+            memcpy(text + pad, buf, len);
+            tests++;
+            ret = utf8proc_validate(text, end, &offset);
+            if (retval == len ? (ret != end || offset != end)
+                              : (ret != UTF8PROC_ERROR_INVALIDUTF8 || offset != pad)) {
+                fprintf(stderr, "Failed (%d): utf8proc_validate at %d of %d:", line, pad, end);
+                for (int i = 0; i < len ; i++) {
+                    fprintf(stderr, " 0x%02x", buf[i]);
+                }
+                fprintf(stderr, " -> %zd, offset %zd\n", ret, offset);
+                error++;
+            }
+        }
+    }
+}
+
 static void testbytes(unsigned char *buf, int len, utf8proc_ssize_t retval, int line)
 {
     utf8proc_int32_t out[16];
@@ -28,6 +54,7 @@ static void testbytes(unsigned char *buf, int len, utf8proc_ssize_t retval, int
         fprintf(stderr, " -> %zd\n", ret);
         error++;
     }
+    testvalidate(buf, len, retval, line);
 }
 
 int main(int argc, char **argv)
@@ -160,6 +187,8 @@ int main(int argc, char **argv)
     }
 
      check(!error, "utf8proc_iterate FAILED %d tests out of %d", error, tests);
+     check(utf8proc_validate((const utf8proc_uint8_t *) "caf\xc3\xa9", -1, NULL) == 5,
+           "utf8proc_validate failed on a NUL-terminated string");
      printf("utf8proc_iterate tests SUCCEEDED, (%d) tests passed.\n", tests);
 
      return 0;
@@ -0,0 +1,137 @@
+#include "tests.h"
+
+static void check_buffer(const char *input, utf8proc_option_t options)
+{
+    utf8proc_uint8_t *mapped, buf[1024];
+    utf8proc_ssize_t len, blen, i;
+    len = utf8proc_map((const utf8proc_uint8_t *) input, 0, &mapped, options | UTF8PROC_NULLTERM);
+    check(len >= 0, "utf8proc_map error = %s", utf8proc_errmsg(len));
+    blen = utf8proc_map_buffer((const utf8proc_uint8_t *) input, 0, NULL, 0, options | UTF8PROC_NULLTERM);
+    check(blen == len, "required length %zd instead of %zd", blen, len);
+    for (i = 0; i <= len + 1; ++i) {
+        memset(buf, 0x55, sizeof(buf));
+        blen = utf8proc_map_buffer((const utf8proc_uint8_t *) input, 0, buf, i, options | UTF8PROC_NULLTERM);
+        check(blen == len, "length %zd instead of %zd for bufsize %zd", blen, len, i);
+        check(buf[i] == 0x55, "wrote past bufsize %zd", i);
+        if (i > len)
+            check(!memcmp(buf, mapped, len + 1), "incorrect data for bufsize %zd", i);
+    }
+    free(mapped);
+}
+
+/* utf8proc_map_borrow must agree with utf8proc_map, and allocate exactly
+   when the result differs from the input */
+static void check_borrow(const char *input, utf8proc_option_t options, utf8proc_allocator_t *allocator)
+{
+    counting_allocator *counts = (counting_allocator *) allocator->data;
+    utf8proc_uint8_t *mapped, *output;
+    utf8proc_ssize_t len, blen;
+    size_t calls = counts->calls;
+    len = utf8proc_map((const utf8proc_uint8_t *) input, 0, &mapped, options | UTF8PROC_NULLTERM);
+    blen = utf8proc_map_borrow((const utf8proc_uint8_t *) input, 0, &output, options | UTF8PROC_NULLTERM,
+                               NULL, NULL, allocator);
+    check(blen == len, "map_borrow length %zd instead of %zd", blen, len);
+    if (len >= 0 && len == (utf8proc_ssize_t) strlen(input) && !memcmp(mapped, input, len)) {
+        check(output == NULL && counts->calls == calls, "map_borrow copied unchanged \"%s\"", input);
+    } else if (len >= 0) {
+        check(output != NULL && !strcmp((char *) output, (char *) mapped), "incorrect map_borrow result for \"%s\"", input);
+        count_free(output, counts);
+    }
+    check(counts->live == 0, "map_borrow leak");
+    free(mapped);
+}
+
+/* utf8proc_map_inplace must agree with utf8proc_map, in a buffer with
+   room for the result and in one of just strlen(input) bytes (which
+   keeps the start of a longer result) */
+static void check_inplace(const char *input, utf8proc_option_t options)
+{
+    utf8proc_uint8_t *mapped, *buf;
+    utf8proc_ssize_t len, ilen, n = (utf8proc_ssize_t) strlen(input);
+    len = utf8proc_map((const utf8proc_uint8_t *) input, n, &mapped, options);
+    check(len >= 0, "utf8proc_map error = %s", utf8proc_errmsg(len));
+    buf = (utf8proc_uint8_t *) malloc((size_t)(len > n ? len : n) + 1);
+    memcpy(buf, input, (size_t)n + 1);
+    ilen = utf8proc_map_inplace(buf, 0, len + 1, options | UTF8PROC_NULLTERM);
+    check(ilen == len && !memcmp(buf, mapped, (size_t)len + 1), "incorrect map_inplace result");
+    memcpy(buf, input, (size_t)n);
+    ilen = utf8proc_map_inplace(buf, n, n, options);
+    check(ilen == len, "map_inplace length %zd instead of %zd", ilen, len);
+    check(!memcmp(buf, mapped, (size_t)(len < n ? len : n)), "incorrect map_inplace result in place");
+    free(buf);
+    free(mapped);
+}
+
+int main(void)
+{
+    const char *nfd = "r\xcc\xa3\xcc\x87 A\xcc\x8a \xe1\x84\x80\xe1\x85\xa1"; /* "ṛ̇ Å 가" */
+    utf8proc_uint8_t buf[64], *output;
+    utf8proc_ssize_t len;
+    counting_allocator counts;
+    utf8proc_allocator_t allocator;
+
+    check_buffer(nfd, UTF8PROC_STABLE | UTF8PROC_COMPOSE);
+    check_buffer(nfd, UTF8PROC_STABLE | UTF8PROC_DECOMPOSE | UTF8PROC_CASEFOLD);
+    check_buffer("\xef\xac\x81 \xc3\x9f", UTF8PROC_COMPOSE | UTF8PROC_COMPAT | UTF8PROC_CASEFOLD);
+
+    len = utf8proc_NFC_buffer((const utf8proc_uint8_t *) nfd, buf, sizeof(buf));
+    check(len == 12 && !strcmp((char *) buf, "\xe1\xb9\x9b\xcc\x87 \xc3\x85 \xea\xb0\x80"), "incorrect NFC_buffer result");
+    len = utf8proc_NFKC_Casefold_buffer((const utf8proc_uint8_t *) "\xef\xac\x81", buf, 2);
+    check(len == 2, "incorrect NFKC_Casefold_buffer length %zd", len);
+
+    init_counting_allocator(&allocator, &counts);
+    len = utf8proc_map_allocator((const utf8proc_uint8_t *) nfd, 0, &output,
+                                 UTF8PROC_NULLTERM | UTF8PROC_STABLE | UTF8PROC_COMPOSE, NULL, NULL, &allocator);
+    check(len == 12 && !strcmp((char *) output, "\xe1\xb9\x9b\xcc\x87 \xc3\x85 \xea\xb0\x80"), "incorrect map_allocator result");
+    check(counts.calls > 0 && counts.live == 1, "allocator not used");
+    count_free(output, &counts);
+    len = utf8proc_map_allocator((const utf8proc_uint8_t *) "\xff", 1, &output, UTF8PROC_COMPOSE, NULL, NULL, &allocator);
+    check(len == UTF8PROC_ERROR_INVALIDUTF8 && output == NULL && counts.live == 0, "allocator leak on error");
+
+    /* unchanged, changed at the start, in the middle, at the end, and shortened */
+    check_borrow("\xe1\xb9\x9b\xcc\x87 \xc3\x85 \xea\xb0\x80", UTF8PROC_STABLE | UTF8PROC_COMPOSE, &allocator);
+    check_borrow(nfd, UTF8PROC_STABLE | UTF8PROC_COMPOSE, &allocator);
+    check_borrow(nfd, UTF8PROC_STABLE | UTF8PROC_DECOMPOSE, &allocator);
+    check_borrow("the quick brown fox", UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_CASEFOLD, &allocator);
+    check_borrow("The quick brown fox", UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_CASEFOLD, &allocator);
+    check_borrow("the quick brown FOX", UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_CASEFOLD, &allocator);
+    check_borrow("stra\xc3\x9f" "e", UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_CASEFOLD, &allocator);
+    check_borrow("caf\xc3\xa9\xe2\x80\x8b", UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_IGNORE, &allocator);
+    check_borrow("a\r\nb", UTF8PROC_NLF2LS, &allocator);
+    check_borrow("", UTF8PROC_STABLE | UTF8PROC_COMPOSE, &allocator);
+    len = utf8proc_map_borrow((const utf8proc_uint8_t *) "ok\xff", 3, &output, UTF8PROC_COMPOSE, NULL, NULL, &allocator);
+    check(len == UTF8PROC_ERROR_INVALIDUTF8 && output == NULL && counts.live == 0, "map_borrow error");
+
+    check_inplace(nfd, UTF8PROC_STABLE | UTF8PROC_COMPOSE);
+    check_inplace(nfd, UTF8PROC_STABLE | UTF8PROC_DECOMPOSE | UTF8PROC_CASEFOLD);
+    check_inplace("\xef\xac\x81 \xc3\x9f", UTF8PROC_COMPOSE | UTF8PROC_COMPAT | UTF8PROC_CASEFOLD);
+    check_inplace("A\xcc\x8a\x01 \xe2\x80\x8b", UTF8PROC_COMPOSE | UTF8PROC_STRIPCC | UTF8PROC_IGNORE | UTF8PROC_STRIPMARK);
+    {
+        /* long input: shrinking, then growing */
+        char *big = (char *) malloc(20001), *copy;
+        size_t i;
+        for (i = 0; i < 20000; i += 5) memcpy(big + i, i < 12000 ? "a\xcc\x8a \x41" : "\xc3\x85\x41 ", 5);
+        big[20000] = 0;
+        check_inplace(big, UTF8PROC_STABLE | UTF8PROC_COMPOSE);
+        check_inplace(big, UTF8PROC_STABLE | UTF8PROC_DECOMPOSE);
+        check_inplace(big, UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_CASEFOLD | UTF8PROC_CHARBOUND);
+        /* invalid UTF-8 at the end leaves all of the input untouched */
+        big[19999] = '\xff';
+        copy = (char *) malloc(20001);
+        memcpy(copy, big, 20001);
+        len = utf8proc_map_inplace((utf8proc_uint8_t *) big, 20000, 20000, UTF8PROC_STABLE | UTF8PROC_COMPOSE);
+        check(len == UTF8PROC_ERROR_INVALIDUTF8 && !memcmp(big, copy, 20001), "map_inplace modified invalid UTF-8");
+        /* it takes precedence over an unassigned codepoint (U+0378) in front of it */
+        memcpy(big + 8, "\xcd\xb8", 2);
+        memcpy(copy, big, 20001);
+        len = utf8proc_map((const utf8proc_uint8_t *) big, 20000, &output, UTF8PROC_COMPOSE | UTF8PROC_REJECTNA);
+        check(len == UTF8PROC_ERROR_NOTASSIGNED, "unassigned codepoint not rejected");
+        len = utf8proc_map_inplace((utf8proc_uint8_t *) big, 20000, 20000, UTF8PROC_COMPOSE | UTF8PROC_REJECTNA);
+        check(len == UTF8PROC_ERROR_INVALIDUTF8 && !memcmp(big, copy, 20001), "map_inplace modified invalid UTF-8");
+        free(copy);
+        free(big);
+    }
+
+    printf("map_buffer tests SUCCEEDED.\n");
+    return 0;
+}
@@ -37,10 +37,194 @@ static void issue102(void) /* #128 */
     check(!memcmp(correct, output, 8), "incorrect NFKC_Casefold data");
 }
 
+static void hangul_tbase(void) /* U+11A7 is not a trailing consonant */
+{
+    utf8proc_uint8_t input[] = {0xe1, 0x84, 0x80, 0xe1, 0x85, 0xa1, 0xe1, 0x86, 0xa7, 0x00}; /* "\u1100\u1161\u11A7" */
+    utf8proc_uint8_t nfc[] = {0xea, 0xb0, 0x80, 0xe1, 0x86, 0xa7, 0x00}; /* "\uAC00\u11A7" */
+    utf8proc_uint8_t *nfc_out;
+    nfc_out = utf8proc_NFC(input);
+    printf("NFC \"%s\" -> \"%s\" vs. \"%s\"\n", (char*)input, (char*)nfc_out, (char*)nfc);
+    check(strlen((char*) nfc_out) == 6, "incorrect nfc length");
+    check(!memcmp(nfc, nfc_out, 7), "incorrect nfc data");
+    free(nfc_out);
+}
+
+static void ascii_runs(void) /* bulk ASCII paths, around a composing mark */
+{
+    const char *input = "The Quick Brown Fox Jumps Over The Lazy DogE\xcc\x81 and AGAIN!";
+    const char *nfc = "The Quick Brown Fox Jumps Over The Lazy Dog\xc3\x89 and AGAIN!";
+    const char *folded = "the quick brown fox jumps over the lazy dog\xc3\xa9 and again!";
+    utf8proc_int32_t buffer[128];
+    utf8proc_ssize_t length;
+    utf8proc_uint8_t *output;
+    utf8proc_map((const utf8proc_uint8_t *) input, 0, &output, UTF8PROC_NULLTERM | UTF8PROC_STABLE | UTF8PROC_COMPOSE);
+    printf("NFC \"%s\" -> \"%s\" vs. \"%s\"\n", input, (char*)output, nfc);
+    check(!strcmp((char*) output, nfc), "incorrect nfc of ASCII runs");
+    free(output);
+    utf8proc_map((const utf8proc_uint8_t *) input, 0, &output, UTF8PROC_NULLTERM | UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_CASEFOLD);
+    printf("casefold \"%s\" -> \"%s\" vs. \"%s\"\n", input, (char*)output, folded);
+    check(!strcmp((char*) output, folded), "incorrect casefold of ASCII runs");
+    free(output);
+    length = utf8proc_decompose((const utf8proc_uint8_t *) input, 0, buffer, 128, UTF8PROC_NULLTERM | UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_CASEFOLD);
+    check(length == 56 && buffer[0] == 't' && buffer[43] == 'e' && buffer[44] == 0x301, "incorrect decomposition of ASCII runs");
+    length = utf8proc_reencode(buffer, length, UTF8PROC_STABLE | UTF8PROC_COMPOSE);
+    check(!strcmp((char*) buffer, folded), "incorrect reencoding of ASCII runs");
+}
+
+static void long_mark_runs(void) /* canonical ordering of long runs of combining marks */
+{
+    static const utf8proc_int32_t marks[] = {0x301, 0x323, 0x334, 0x5B0, 0x315, 0x31B, 0x345, 0x300, 0x302};
+    static utf8proc_uint8_t input[4 * 20000 + 1];
+    static utf8proc_int32_t original[20000], buffer[20000];
+    utf8proc_ssize_t i, j, k, len = 0, length;
+    unsigned seed = 1;
+    for (i = 0; i < 20000; i++) {
+        seed = seed * 1103515245 + 12345;
+        original[i] = (i % 5000 == 0 || (seed >> 16) % 1000 == 0) ? 'a' : marks[(seed >> 16) % 9];
+        len += utf8proc_encode_char(original[i], input + len);
+    }
+    input[len] = 0;
+    length = utf8proc_decompose(input, len, buffer, 20000, UTF8PROC_DECOMPOSE);
+    check(length == 20000, "incorrect decomposition length %zd of long mark runs", length);
+    for (i = 0; i < length; i = j) {
+        /* each run between starters must be a stable sort by combining class */
+        check(buffer[i] == original[i], "starter moved in long mark runs");
+        for (j = i + 1; j < length && buffer[j] != 'a'; j++)
+            check(utf8proc_get_property(buffer[j - 1])->combining_class <= utf8proc_get_property(buffer[j])->combining_class ||
+                  j == i + 1, "long mark run not in canonical order");
+        for (k = 0; k < 9; k++) {
+            utf8proc_ssize_t a = i, b = i;
+            for (;;) {
+                while (a < j && original[a] != marks[k]) a++;
+                while (b < j && buffer[b] != marks[k]) b++;
+                if (a == j || b == j) break;
+                a++; b++;
+            }
+            check(a == j && b == j, "long mark run not sorted stably");
+        }
+    }
+}
+
+static void stream_safe(void) /* UTF8PROC_STREAMSAFE */
+{
+    static utf8proc_uint8_t input[1 + 2 * 100 + 1];
+    utf8proc_int32_t buffer[256];
+    utf8proc_uint8_t *output;
+    utf8proc_ssize_t i, length;
+    input[0] = 'a';
+    for (i = 0; i < 100; i++) memcpy(input + 1 + 2 * i, "\xcc\x81", 2);
+    input[1 + 2 * 100] = 0;
+    length = utf8proc_decompose(input, 0, buffer, 256, UTF8PROC_NULLTERM | UTF8PROC_DECOMPOSE | UTF8PROC_STREAMSAFE);
+    check(length == 104, "incorrect stream-safe decomposition length %zd", length);
+    for (i = 0; i < length; i++)
+        check(buffer[i] == (i == 0 ? 'a' : i % 31 == 0 ? 0x034F : 0x0301), "incorrect stream-safe decomposition at %zd", i);
+    check(utf8proc_decompose(input, 0, buffer, 50, UTF8PROC_NULLTERM | UTF8PROC_DECOMPOSE | UTF8PROC_STREAMSAFE) == 104,
+          "incorrect stream-safe decomposition length for a short buffer");
+    for (i = 0; i < 50; i++)
+        check(buffer[i] == (i == 0 ? 'a' : i % 31 == 0 ? 0x034F : 0x0301), "incorrect stream-safe prefix at %zd", i);
+    length = utf8proc_map(input, 0, &output, UTF8PROC_NULLTERM | UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_STREAMSAFE);
+    check(length == 2 + 3 * 2 + 99 * 2 && !memcmp(output, "\xc3\xa1\xcc\x81", 4) &&
+          !memcmp(output + 2 + 29 * 2, "\xcd\x8f\xcc\x81", 4), "incorrect stream-safe NFC");
+    free(output);
+    /* the decomposition of U+1E69 (s with dot below and dot above) starts with a starter */
+    length = utf8proc_decompose((const utf8proc_uint8_t *) "\xe1\xb9\xa9\xcc\x81", 5, buffer, 256,
+                                UTF8PROC_DECOMPOSE | UTF8PROC_STREAMSAFE);
+    check(length == 4 && buffer[0] == 's', "CGJ inserted in front of a starter");
+}
+
+static void full_expansions(void) /* precomputed full decompositions */
+{
+    /* UTF8PROC_CHARBOUND decomposes codepoint by codepoint, so apart from
+       its 0xFFFF boundary markers it must agree with the precomputed
+       sequences */
+    static const utf8proc_option_t variants[] = {
+        UTF8PROC_CASEFOLD, UTF8PROC_DECOMPOSE, UTF8PROC_DECOMPOSE | UTF8PROC_COMPAT,
+        UTF8PROC_CASEFOLD | UTF8PROC_DECOMPOSE, UTF8PROC_CASEFOLD | UTF8PROC_DECOMPOSE | UTF8PROC_COMPAT,
+        UTF8PROC_DECOMPOSE | UTF8PROC_COMPAT | UTF8PROC_IGNORE
+    };
+    utf8proc_int32_t fast[64], slow[128], c;
+    size_t v;
+    for (v = 0; v < sizeof(variants) / sizeof(variants[0]); v++) {
+        for (c = 0; c < 0x110000; c++) {
+            int boundclass = UTF8PROC_BOUNDCLASS_START;
+            utf8proc_ssize_t i, j = 0, length, slow_length;
+            if (c == 0xFFFF) continue; /* taken for the boundary marker */
+            length = utf8proc_decompose_char(c, fast, 64, variants[v], NULL);
+            slow_length = utf8proc_decompose_char(c, slow, 128, variants[v] | UTF8PROC_CHARBOUND, &boundclass);
+            for (i = 0; i < slow_length; i++)
+                if (slow[i] != 0xFFFF) slow[j++] = slow[i];
+            check(length == j && !memcmp(fast, slow, (size_t)j * sizeof(utf8proc_int32_t)),
+                  "incorrect full decomposition of U+%04X with options %d", (unsigned)c, (int)variants[v]);
+        }
+    }
+}
+
+static void prevalidated(void) /* UTF8PROC_PREVALIDATED */
+{
+    static const char *const strings[] = {
+        "Stra\xc3\x9f" "e", "\xe5\x90\x8d\xe5\x89\x8d\xe3\x81\xaf", "a\xcc\x81\xcc\xa3 \xea\xb0\x80",
+        "\xf0\x9f\x98\x80\xef\xac\x81", "The quick brown fox jumps over the lazy dog \xc3\xa9"
+    };
+    static const utf8proc_option_t options[] = {
+        UTF8PROC_STABLE | UTF8PROC_COMPOSE, UTF8PROC_STABLE | UTF8PROC_DECOMPOSE | UTF8PROC_COMPAT,
+        UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_CASEFOLD
+    };
+    size_t i, j;
+    for (i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+        const utf8proc_uint8_t *str = (const utf8proc_uint8_t *) strings[i];
+        for (j = 0; j < sizeof(options) / sizeof(options[0]); j++) {
+            utf8proc_uint8_t *checked, *unchecked;
+            utf8proc_ssize_t length = utf8proc_map(str, 0, &checked, options[j] | UTF8PROC_NULLTERM);
+            check(utf8proc_map(str, 0, &unchecked, options[j] | UTF8PROC_NULLTERM | UTF8PROC_PREVALIDATED) == length &&
+                  !memcmp(checked, unchecked, (size_t) length), "prevalidated map differs for string %d", (int) i);
+            free(checked);
+            free(unchecked);
+            check(utf8proc_decompose(str, 0, NULL, 0, options[j] | UTF8PROC_NULLTERM | UTF8PROC_PREVALIDATED) ==
+                  utf8proc_decompose(str, 0, NULL, 0, options[j] | UTF8PROC_NULLTERM),
+                  "prevalidated decomposition differs for string %d", (int) i);
+        }
+        check(utf8proc_quick_check(str, 0, UTF8PROC_NULLTERM | UTF8PROC_COMPOSE | UTF8PROC_PREVALIDATED) ==
+              utf8proc_quick_check(str, 0, UTF8PROC_NULLTERM | UTF8PROC_COMPOSE),
+              "prevalidated quick check differs for string %d", (int) i);
+    }
+}
+
+static void lump(void) /* UTF8PROC_LUMP, as documented in lump.md */
+{
+    static const utf8proc_int32_t lumped[][2] = {
+        {0x00A0, 0x20}, {0x3000, 0x20}, {0x2018, 0x27}, {0x2019, 0x27}, {0x02BC, 0x27},
+        {0x02C8, 0x27}, {0x2010, 0x2D}, {0x2014, 0x2D}, {0x2212, 0x2D}, {0x2044, 0x2F},
+        {0x2215, 0x2F}, {0x2236, 0x3A}, {0x2039, 0x3C}, {0x2329, 0x3C}, {0x3008, 0x3C},
+        {0x203A, 0x3E}, {0x232A, 0x3E}, {0x3009, 0x3E}, {0x2216, 0x5C}, {0x02C4, 0x5E},
+        {0x02C6, 0x5E}, {0x2038, 0x5E}, {0x2303, 0x5E}, {0xFE4F, 0x5F}, {0x02CD, 0x5F},
+        {0x02CB, 0x60}, {0x2223, 0x7C}, {0x223C, 0x7E}, {0x2017, 0x2017}, {0x3007, 0x3007},
+        {0x2028, 0x2028}, {'a', 'a'}
+    };
+    utf8proc_int32_t dst[4];
+    size_t i;
+    for (i = 0; i < sizeof(lumped) / sizeof(lumped[0]); i++) {
+        check(utf8proc_decompose_char(lumped[i][0], dst, 4, UTF8PROC_LUMP, NULL) == 1 && dst[0] == lumped[i][1],
+              "incorrect lumping of U+%04X", (unsigned) lumped[i][0]);
+    }
+    /* line and paragraph separators only with UTF8PROC_NLF2LF */
+    check(utf8proc_decompose_char(0x2029, dst, 4, UTF8PROC_LUMP | UTF8PROC_NLF2LF, NULL) == 1 && dst[0] == 0x0A,
+          "incorrect lumping of U+2029");
+    /* the replacement is decomposed further with the other options */
+    check(utf8proc_decompose_char(0x2215, dst, 4, UTF8PROC_LUMP | UTF8PROC_COMPOSE | UTF8PROC_CASEFOLD, NULL) == 1 &&
+          dst[0] == 0x2F, "incorrect lumping of U+2215 with other options");
+}
+
 int main(void)
 {
     issue128();
     issue102();
+    hangul_tbase();
+    ascii_runs();
+    long_mark_runs();
+    stream_safe();
+    full_expansions();
+    prevalidated();
+    lump();
     printf("Misc tests SUCCEEDED.\n");
     return 0;
 }
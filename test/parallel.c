@@ -0,0 +1,82 @@
+#include "tests.h"
+
+static size_t tasks;
+
+/* a "thread pool" that runs the tasks backwards, to catch any dependence
+   of a chunk on the chunks in front of it */
+static void backwards(void (*task)(void *, utf8proc_size_t), void *context, utf8proc_size_t count, void *data)
+{
+    check(data == &tasks, "unexpected data passed");
+    tasks = count;
+    while (count > 0) task(context, --count);
+}
+
+static utf8proc_int32_t custom(utf8proc_int32_t codepoint, void *data)
+{
+    (void) data; /* unused */
+    return codepoint == 'x' ? 0x0301 /* a mark, so 'x' is no split point */ : codepoint;
+}
+
+static void check_parallel(const utf8proc_uint8_t *str, utf8proc_ssize_t len, utf8proc_option_t options, utf8proc_custom_func func)
+{
+    utf8proc_uint8_t *expected, *output;
+    utf8proc_ssize_t elen, olen;
+    elen = utf8proc_map_custom(str, len, &expected, options, func, NULL);
+    tasks = 0;
+    olen = utf8proc_map_parallel(str, len, &output, options, func, NULL, backwards, &tasks);
+    check(olen == elen, "utf8proc_map_parallel returned %zd instead of %zd for options %x", olen, elen, (unsigned) options);
+    check(tasks > 2 || (options & UTF8PROC_CHARBOUND), "string was not split (%d tasks)", (int) tasks);
+    if (elen >= 0)
+        check(!memcmp(output, expected, (size_t) elen + 1), "utf8proc_map_parallel result differs for options %x", (unsigned) options);
+    free(expected);
+    free(output);
+}
+
+int main(int argc, char **argv)
+{
+    static const char *pieces[] = {
+        "The quick brown fox jumps over the lazy dog. ",
+        "e\xcc\x81\xcc\xa3 ", "\r\n", "\r", "\xe1\x84\x80\xe1\x85\xa1\xe1\x86\xa8", "\xea\xb0\x80\xe1\x86\xa8",
+        "\xc2\xad", "\xef\xac\x81", "\x0b\xcc\x88", "\xc3\x85x", "\xe4\xb8\xad\xe6\x96\x87"
+    };
+    static const utf8proc_option_t options[] = {
+        UTF8PROC_STABLE | UTF8PROC_COMPOSE,
+        UTF8PROC_STABLE | UTF8PROC_DECOMPOSE,
+        UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_COMPAT | UTF8PROC_CASEFOLD | UTF8PROC_IGNORE,
+        UTF8PROC_COMPOSE | UTF8PROC_NLF2LF | UTF8PROC_STRIPCC | UTF8PROC_LUMP | UTF8PROC_STREAMSAFE,
+        UTF8PROC_COMPOSE | UTF8PROC_CHARBOUND
+    };
+    size_t size = 3 << 20, len = 0, i, j;
+    utf8proc_uint8_t *str = (utf8proc_uint8_t *) malloc(size + 1), *output;
+    utf8proc_ssize_t result;
+
+    (void) argc; /* unused */
+    (void) argv; /* unused */
+
+    srand(1);
+    while (len + 64 < size) {
+        const char *piece = pieces[rand() % (sizeof(pieces) / sizeof(pieces[0]))];
+        if (len > (1 << 20) - 100 && len < (1 << 20) + 10000) piece = "\xcc\x81"; /* nowhere to split */
+        if (len > (2 << 20) - 100 && len < (3 << 20) && len % 256 == 0) piece = "\xe1\x85\xa1"; /* Hangul V */
+        memcpy(str + len, piece, strlen(piece));
+        len += strlen(piece);
+    }
+    str[len] = 0;
+
+    for (i = 0; i < sizeof(options) / sizeof(options[0]); i++) {
+        check_parallel(str, (utf8proc_ssize_t) len, options[i], NULL);
+        check_parallel(str, 0, options[i] | UTF8PROC_NULLTERM, custom);
+    }
+
+    /* the error of the first chunk with one is returned */
+    for (j = 0; j < 2; j++) {
+        str[len - 100] = (utf8proc_uint8_t) "\xff\x80"[j];
+        str[len - 2000000] = 0xff;
+        result = utf8proc_map_parallel(str, (utf8proc_ssize_t) len, &output, UTF8PROC_COMPOSE | UTF8PROC_REJECTNA, NULL, NULL, backwards, &tasks);
+        check(result == UTF8PROC_ERROR_INVALIDUTF8 && output == NULL, "wrong error %zd", result);
+    }
+    free(str);
+
+    printf("parallel tests SUCCEEDED.\n");
+    return 0;
+}
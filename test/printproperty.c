@@ -37,7 +37,8 @@ int main(int argc, char **argv)
             "  ignorable = %d\n"
             "  control_boundary = %d\n"
             "  boundclass = %d\n"
-            "  charwidth = %d\n",
+            "  charwidth = %d\n"
+            "  nfc_qc = %d, nfd_qc = %d, nfkc_qc = %d, nfkd_qc = %d\n",
         argv[i], (char*) cstr,
         utf8proc_category_string(c),
         p->combining_class,
@@ -53,7 +54,8 @@ int main(int argc, char **argv)
         p->ignorable,
         p->control_boundary,
         p->boundclass,
-        utf8proc_charwidth(c));
+        utf8proc_charwidth(c),
+        p->nfc_qc, p->nfd_qc, p->nfkc_qc, p->nfkd_qc);
         free(map);
     }
     return 0;
@@ -0,0 +1,70 @@
+#include "tests.h"
+
+#define NFC  (UTF8PROC_STABLE | UTF8PROC_COMPOSE)
+#define NFD  (UTF8PROC_STABLE | UTF8PROC_DECOMPOSE)
+#define NFKC (UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_COMPAT)
+#define NFKD (UTF8PROC_STABLE | UTF8PROC_DECOMPOSE | UTF8PROC_COMPAT)
+
+static void check_property(utf8proc_int32_t c, int nfc, int nfd, int nfkc, int nfkd)
+{
+    const utf8proc_property_t *p = utf8proc_get_property(c);
+    check(p->nfc_qc == nfc && p->nfd_qc == nfd && p->nfkc_qc == nfkc && p->nfkd_qc == nfkd,
+          "wrong Quick_Check properties %d/%d/%d/%d for U+%04X",
+          p->nfc_qc, p->nfd_qc, p->nfkc_qc, p->nfkd_qc, c);
+}
+
+static void check_string(const char *str, int options, utf8proc_ssize_t qc, utf8proc_ssize_t normalized)
+{
+    utf8proc_ssize_t result;
+    result = utf8proc_quick_check((const utf8proc_uint8_t *) str, 0, (utf8proc_option_t)(options | UTF8PROC_NULLTERM));
+    check(result == qc, "quick check of \"%s\" returned %zd instead of %zd", str, result, qc);
+    result = utf8proc_isnormalized((const utf8proc_uint8_t *) str, (utf8proc_ssize_t) strlen(str), (utf8proc_option_t) options);
+    check(result == normalized, "isnormalized(\"%s\") returned %zd instead of %zd", str, result, normalized);
+}
+
+int main(void)
+{
+    enum { Y = UTF8PROC_QC_YES, N = UTF8PROC_QC_NO, M = UTF8PROC_QC_MAYBE };
+
+    check_property(0x0041, Y, Y, Y, Y);
+    check_property(0x00C5, Y, N, Y, N); /* Å */
+    check_property(0x212B, N, N, N, N); /* ANGSTROM SIGN, a singleton */
+    check_property(0x0301, M, Y, M, Y); /* COMBINING ACUTE ACCENT */
+    check_property(0x0344, N, N, N, N); /* non-starter decomposition */
+    check_property(0x00A8, Y, Y, N, N); /* DIAERESIS, <compat> 0020 0308 */
+    check_property(0x0385, Y, N, N, N); /* 00A8 0301, so not in NFKC */
+    check_property(0xFB01, Y, Y, N, N); /* LATIN SMALL LIGATURE FI */
+    check_property(0xAC00, Y, N, Y, N); /* Hangul syllable */
+    check_property(0x1161, M, Y, M, Y); /* Hangul V */
+    check_property(0x11A7, Y, Y, Y, Y); /* not a trailing consonant (TBASE) */
+    check_property(0x11A8, M, Y, M, Y); /* Hangul T */
+    check_property(0x0958, N, N, N, N); /* composition exclusion */
+    check_property(0x0378, Y, Y, Y, Y); /* unassigned */
+
+    check_string("ascii only", NFC, UTF8PROC_QC_YES, 1);
+    check_string("\xc3\x85ngstr\xc3\xb6m", NFC, UTF8PROC_QC_YES, 1);
+    check_string("\xc3\x85ngstr\xc3\xb6m", NFD, UTF8PROC_QC_NO, 0);
+    check_string("A\xcc\x8a", NFC, UTF8PROC_QC_MAYBE, 0);
+    check_string("A\xcc\x8a", NFD, UTF8PROC_QC_YES, 1);
+    check_string("\xe2\x84\xab", NFC, UTF8PROC_QC_NO, 0);
+    check_string("x\xcc\x81", NFC, UTF8PROC_QC_MAYBE, 1); /* no precomposed x with acute */
+    check_string("a\xcc\x81\xcc\xa3", NFD, UTF8PROC_QC_NO, 0); /* misordered marks */
+    check_string("a\xcc\xa3\xcc\x81", NFD, UTF8PROC_QC_YES, 1);
+    check_string("\xef\xac\x81", NFC, UTF8PROC_QC_YES, 1);
+    check_string("\xef\xac\x81", NFKC, UTF8PROC_QC_NO, 0);
+    check_string("\xea\xb0\x80\xe1\x86\xa7", NFC, UTF8PROC_QC_YES, 1);
+    check_string("\xe1\x84\x80\xe1\x85\xa1", NFKC, UTF8PROC_QC_MAYBE, 0);
+    check_string("\xe1\x84\x80\xe1\x85\xa1", NFKD, UTF8PROC_QC_YES, 1);
+
+    check(utf8proc_quick_check((const utf8proc_uint8_t *) "a\xff", 2, NFC) == UTF8PROC_ERROR_INVALIDUTF8,
+          "invalid UTF-8 not detected");
+    check(utf8proc_quick_check((const utf8proc_uint8_t *) "a", 1, UTF8PROC_CASEFOLD) == UTF8PROC_ERROR_INVALIDOPTS,
+          "invalid options not detected");
+    check(utf8proc_isnormalized((const utf8proc_uint8_t *) "Abc", 3, UTF8PROC_CASEFOLD) == 0,
+          "isnormalized failed for casefolding");
+    check(utf8proc_isnormalized((const utf8proc_uint8_t *) "abc", 3, UTF8PROC_CASEFOLD) == 1,
+          "isnormalized failed for casefolding");
+
+    printf("Quick_Check tests SUCCEEDED.\n");
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "tests.h"
+
+static size_t custom_calls;
+
+/* count the codepoints read by the normalizer, and map 'a' to an accented 'b' */
+static utf8proc_int32_t custom(utf8proc_int32_t codepoint, void *data)
+{
+    (void) data; /* unused */
+    custom_calls++;
+    return codepoint == 'a' ? 0x1E03 /* ḃ */ : codepoint;
+}
+
+/* read the mapped form of `str` from a reader, with utf8proc_reader_read
+   in chunks of `chunk` bytes or (for a `chunk` of 0) codepoint by codepoint
+   with utf8proc_reader_next, and compare it with utf8proc_map_custom */
+static void check_reader(const char *str, utf8proc_option_t options, utf8proc_custom_func func, utf8proc_ssize_t chunk)
+{
+    utf8proc_reader_t *reader;
+    utf8proc_uint8_t out[4096], *expected;
+    utf8proc_ssize_t result, outlen = 0;
+    utf8proc_int32_t uc;
+
+    check(utf8proc_reader_new(&reader, (const utf8proc_uint8_t *) str, -1, options | UTF8PROC_NULLTERM,
+                              func, NULL, NULL) == 0, "utf8proc_reader_new failed");
+    while (chunk) {
+        result = utf8proc_reader_read(reader, out + outlen, chunk);
+        check(result >= 0 && result <= chunk, "utf8proc_reader_read failed: %s", utf8proc_errmsg(result));
+        outlen += result;
+        if (result < chunk) break;
+    }
+    while (!chunk) {
+        result = utf8proc_reader_next(reader, &uc);
+        check(result >= 0, "utf8proc_reader_next failed: %s", utf8proc_errmsg(result));
+        if (result == 0) break;
+        if (uc == -1 || ((options & UTF8PROC_CHARBOUND) && (uc == 0xFFFF || uc == 0xFFFE))) {
+            check(result == 1, "grapheme boundary or U+%04X of %zd bytes", uc, result);
+            out[outlen] = uc == 0xFFFE ? 0xFE : 0xFF;
+        } else {
+            check(utf8proc_encode_char(uc, out + outlen) == result, "wrong length %zd of U+%04X", result, uc);
+        }
+        outlen += result;
+    }
+    check(utf8proc_reader_next(reader, &uc) == 0, "output after the end of the string");
+    utf8proc_reader_free(reader);
+
+    result = utf8proc_map_custom((const utf8proc_uint8_t *) str, 0, &expected, options | UTF8PROC_NULLTERM, func, NULL);
+    check(result >= 0 && result == outlen && !memcmp(out, expected, (size_t) outlen),
+          "reading \"%s\" in chunks of %d bytes differs from utf8proc_map", str, (int) chunk);
+    free(expected);
+}
+
+int main(int argc, char **argv)
+{
+    static const char *strings[] = {
+        "e\xcc\x81",                             /* e + acute */
+        "a\xcc\x81\xcc\xa3 \xe1\x84\x80\xe1\x85\xa1\xe1\x86\xa8", /* marks to reorder, Hangul L V T */
+        "ABC\r\nDEF\xef\xbc\xa1\xc3\x9f\xe2\x80\xa8\xf0\x9f\x87\xa9\xf0\x9f\x87\xaa!",
+        "The quick brown fox jumps over the lazy dog, twice: THE QUICK BROWN FOX\xcc\x88",
+        "\xef\xbf\xbf\xef\xbf\xbfx\xef\xbf\xbe\xd8\x80\xef\xbf\xbf\xcc\x81" /* U+FFFF, U+FFFE, Prepend */
+    };
+    static const utf8proc_int32_t charbound[] = {
+        -1, 0xFFFF, -1, 0xFFFF, -1, 'x', -1, 0xFFFE, -1, 0x0600, 0xFFFF, 0x0301, 0
+    };
+    static const utf8proc_option_t options[] = {
+        UTF8PROC_STABLE | UTF8PROC_COMPOSE,
+        UTF8PROC_STABLE | UTF8PROC_DECOMPOSE | UTF8PROC_COMPAT,
+        UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_COMPAT | UTF8PROC_CASEFOLD | UTF8PROC_IGNORE,
+        UTF8PROC_COMPOSE | UTF8PROC_CHARBOUND | UTF8PROC_NLF2LS | UTF8PROC_LUMP
+    };
+    char marks[1024];
+    utf8proc_reader_t *reader;
+    utf8proc_int32_t uc;
+    utf8proc_ssize_t result;
+    size_t i, j, n;
+
+    (void) argc; /* unused */
+    (void) argv; /* unused */
+
+    for (j = 0; j < sizeof(options) / sizeof(options[0]); j++)
+        for (i = 0; i < sizeof(strings) / sizeof(strings[0]); i++)
+            for (n = 0; n <= 8; n++) {
+                check_reader(strings[i], options[j], NULL, (utf8proc_ssize_t) n);
+                check_reader(strings[i], options[j], custom, (utf8proc_ssize_t) n);
+            }
+
+    /* grapheme boundaries are told apart from U+FFFF */
+    check(utf8proc_reader_new(&reader, (const utf8proc_uint8_t *) strings[4], -1,
+                              UTF8PROC_NULLTERM | UTF8PROC_CHARBOUND, NULL, NULL, NULL) == 0, "utf8proc_reader_new failed");
+    for (i = 0; charbound[i]; i++) {
+        result = utf8proc_reader_next(reader, &uc);
+        check(result > 0 && uc == charbound[i], "read %d instead of %d", (int) uc, (int) charbound[i]);
+    }
+    check(utf8proc_reader_next(reader, &uc) == 0, "output after the end of the string");
+    utf8proc_reader_free(reader);
+
+    /* a run of marks longer than the window of the normalizer */
+    marks[0] = 'o';
+    for (i = 1; i + 2 < sizeof(marks); i += 2) memcpy(marks + i, i % 4 == 1 ? "\xcc\x88" : "\xcc\xa3", 2);
+    marks[i] = 0;
+    check_reader(marks, UTF8PROC_STABLE | UTF8PROC_COMPOSE, NULL, 0);
+    check_reader(marks, UTF8PROC_STABLE | UTF8PROC_COMPOSE, NULL, 7);
+
+    /* only the first segment is looked at to read the first codepoint */
+    custom_calls = 0;
+    check(utf8proc_reader_new(&reader, (const utf8proc_uint8_t *) "a\xcc\x81\xcc\xa3\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9", -1,
+                              UTF8PROC_NULLTERM | UTF8PROC_COMPOSE, custom, NULL, NULL) == 0, "utf8proc_reader_new failed");
+    check(utf8proc_reader_next(reader, &uc) == 3 && uc == 0x1E05 && custom_calls <= 4,
+          "reading U+%04X took %d calls of custom_func", uc, (int) custom_calls);
+    utf8proc_reader_free(reader);
+
+    check(utf8proc_reader_new(&reader, (const utf8proc_uint8_t *) "x\xc3\xa9y\xff", 5, UTF8PROC_DECOMPOSE, NULL, NULL, NULL) == 0,
+          "utf8proc_reader_new failed");
+    check(utf8proc_reader_next(reader, &uc) == 1 && uc == 'x', "valid prefix was not read");
+    result = utf8proc_reader_next(reader, &uc);
+    check(result == 1 && uc == 'e', "valid prefix was not read");
+    check(utf8proc_reader_next(reader, &uc) == 2 && uc == 0x0301, "valid prefix was not read");
+    check(utf8proc_reader_next(reader, &uc) == UTF8PROC_ERROR_INVALIDUTF8, "invalid UTF-8 was not detected");
+    check(utf8proc_reader_next(reader, &uc) == UTF8PROC_ERROR_INVALIDUTF8, "error was not kept");
+    utf8proc_reader_free(reader);
+    check(utf8proc_reader_new(&reader, (const utf8proc_uint8_t *) "", 0, UTF8PROC_COMPOSE | UTF8PROC_DECOMPOSE,
+                              NULL, NULL, NULL) == UTF8PROC_ERROR_INVALIDOPTS && reader == NULL,
+          "invalid options were not detected");
+
+    printf("reader tests SUCCEEDED.\n");
+    return 0;
+}
@@ -0,0 +1,151 @@
+#include "tests.h"
+
+typedef void (*segment_init_func)(utf8proc_segment_iterator_t *iter,
+                                  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen);
+typedef utf8proc_ssize_t (*segment_next_func)(utf8proc_segment_iterator_t *iter);
+
+/* segment utf8 with the given iterator into g, with '/' before each
+   segment, checking the offsets it returns */
+static void segment(const utf8proc_uint8_t *utf8, utf8proc_ssize_t len, utf8proc_uint8_t *g,
+                    segment_init_func init, segment_next_func next)
+{
+    utf8proc_segment_iterator_t iter;
+    utf8proc_ssize_t start = 0, end, gi = 0;
+    init(&iter, utf8, len);
+    while ((end = next(&iter)) > 0) {
+        check(end > start && end <= len, "segment iterator returned %zd", end);
+        g[gi++] = '/';
+        memcpy(g + gi, utf8 + start, end - start);
+        gi += end - start;
+        start = end;
+    }
+    check(end == 0 && start == len, "segment iterator stopped at %zd", start);
+    check(next(&iter) == 0, "segment iterator continued past the end");
+    g[gi] = 0;
+}
+
+/* check the iterator against a test file in the format of GraphemeBreakTest.txt */
+static void check_file(const char *filename, const char *what,
+                       segment_init_func init, segment_next_func next)
+{
+    char *buf = NULL;
+    size_t bufsize = 0;
+    FILE *f = fopen(filename, "r");
+    utf8proc_uint8_t src[1024], utf8[1024], g[1024];
+    int len;
+
+    check(f != NULL, "error opening %s", filename);
+    lineno = 0;
+    while (getline(&buf, &bufsize, f) > 0) {
+        size_t bi = 0, si = 0, i, j;
+        lineno += 1;
+
+        if (buf[0] == '#') continue;
+
+        while (buf[bi]) {
+            bi = skipspaces(buf, bi);
+            if (buf[bi] == '/') { /* break */
+                src[si++] = '/';
+                bi++;
+            }
+            else if (buf[bi] == '+') { /* no break */
+                bi++;
+            }
+            else if (buf[bi] == '#') { /* start of comments */
+                break;
+            }
+            else { /* hex-encoded codepoint */
+                len = encode((char*) (src + si), buf + bi) - 1;
+                while (src[si]) ++si; /* advance to NUL termination */
+                bi += len;
+            }
+        }
+        if (si && src[si-1] == '/')
+            --si; /* no break after the final segment */
+        src[si] = 0;
+        if (!si) continue;
+
+        for (i = j = 0; i < si; ++i)
+            if (src[i] != '/')
+                utf8[j++] = src[i];
+        if (utf8proc_validate(utf8, j, NULL) != (utf8proc_ssize_t) j) {
+            /* the test files contain surrogate codepoints, which are only for UTF-16 */
+            printf("line %zd: ignoring invalid UTF-8 codepoints\n", lineno);
+            continue;
+        }
+        segment(utf8, j, g, init, next);
+        check(!strcmp((char*)g, (char*)src),
+              "%s mismatch: \"%s\" instead of \"%s\"", what, (char*)g, (char*)src);
+    }
+    free(buf);
+    fclose(f);
+    printf("Passed %s tests after %zd lines!\n", what, lineno);
+}
+
+/* check the segmentation of s, given as the expected segments separated by '|' */
+static void check_segments(const char *s, segment_init_func init, segment_next_func next)
+{
+    utf8proc_uint8_t utf8[256], src[256], g[256];
+    size_t i, j = 0;
+    src[0] = '/';
+    for (i = 0; s[i]; ++i) {
+        src[i + 1] = s[i] == '|' ? '/' : s[i];
+        if (s[i] != '|') utf8[j++] = s[i];
+    }
+    src[i + 1] = 0;
+    segment(utf8, j, g, init, next);
+    check(!strcmp((char*)g, (char*)src),
+          "segment mismatch: \"%s\" instead of \"%s\"", (char*)g, (char*)src);
+}
+
+static void check_words(const char *s)
+{
+    check_segments(s, utf8proc_word_init, utf8proc_word_next);
+}
+
+static void check_sentences(const char *s)
+{
+    check_segments(s, utf8proc_sentence_init, utf8proc_sentence_next);
+}
+
+int main(int argc, char **argv)
+{
+    utf8proc_segment_iterator_t iter;
+
+    /* examples of UAX#29 */
+    check_words("The| |quick| |(|\"|brown|\"|)| |fox| |can't| |jump| |32.3| |feet|,| |right|?");
+    check_words("can't| |e.g|.| |3,000.50| |a_b| |x|.|\xF0\x9F\x98\x80"); /* WB6-12, WB13a/b */
+    check_words("a|.|.|b| |1|,|,|2| |a|.");                   /* failed lookahead */
+    check_words("\xD7\x90'\xD7\x91| |\xD7\x90\"\xD7\x91| |\xD7\x90'| |\xD7\x90|\"");  /* WB7a-c */
+    check_words("\xE3\x82\xAB\xE3\x82\xBF\xE3\x82\xAB\xE3\x83\x8A");  /* WB13 */
+    check_words("a\xCC\x88.\xCC\x88\xE2\x80\x8D" "b");    /* WB4 in the lookahead */
+    check_words("a|\r\n|\n|\n|\r|b");                     /* WB3-3b */
+    check_words("   |\t|  \xCC\x88| ");                  /* WB3d */
+    check_words("\xE2\x80\x8D\xF0\x9F\x9B\x91| |a\xE2\x80\x8D\xF0\x9F\x9B\x91"); /* WB3c */
+    check_words("\xF0\x9F\x87\xA6\xF0\x9F\x87\xA7|\xF0\x9F\x87\xA8");  /* WB15-16 */
+
+    check_sentences("This is a test. |And another?! |\"Yes.\"  |Done");
+    check_sentences("Mr. |Smith etc. and co. went.");          /* SB8, SB11 */
+    check_sentences("3.4 U.S.A. |A.B. |C");                      /* SB6, SB7 */
+    check_sentences("He said (\"Stop.\") |She did.\n|\n|Next");  /* SB9-11, SB4 */
+    check_sentences("Is it 'ok.' (yes). |Ok.");
+    check_sentences("etc.)' the end.");
+    check_sentences("a.\r\n|b");                               /* SB3 */
+    check_sentences("Wait... |What?");
+    check_sentences("a. , b.");                                /* SB8a */
+
+    /* an empty string has no segments */
+    utf8proc_word_init(&iter, (const utf8proc_uint8_t *) "", -1);
+    check(utf8proc_word_next(&iter) == 0, "word in an empty string");
+    utf8proc_sentence_init(&iter, (const utf8proc_uint8_t *) "ab. Cd", -1);
+    check(utf8proc_sentence_next(&iter) == 4 && utf8proc_sentence_next(&iter) == 6 &&
+          utf8proc_sentence_next(&iter) == 0, "NUL-terminated sentences");
+    utf8proc_word_init(&iter, (const utf8proc_uint8_t *) "ab \xFF", 4);
+    check(utf8proc_word_next(&iter) == 2 &&
+          utf8proc_word_next(&iter) == UTF8PROC_ERROR_INVALIDUTF8, "invalid UTF-8 not detected");
+
+    check(argc > 2, "usage: segmenttest WordBreakTest.txt SentenceBreakTest.txt");
+    check_file(argv[1], "word", utf8proc_word_init, utf8proc_word_next);
+    check_file(argv[2], "sentence", utf8proc_sentence_init, utf8proc_sentence_next);
+    return 0;
+}
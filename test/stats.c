@@ -0,0 +1,82 @@
+#include "tests.h"
+
+/* the counters of utf8proc compiled with UTF8PROC_STATS */
+
+static utf8proc_stats_t stats;
+
+/* map `str` with `options` and collect the counters of just that */
+static void count(const char *str, utf8proc_option_t options)
+{
+    utf8proc_uint8_t *output;
+    utf8proc_stats_reset();
+    if (utf8proc_map((const utf8proc_uint8_t *) str, 0, &output, options | UTF8PROC_NULLTERM) >= 0)
+        free(output);
+    check(utf8proc_stats_get(&stats), "counters not compiled in");
+}
+
+int main(int argc, char **argv)
+{
+    utf8proc_int32_t buffer[16];
+    char ascii[101];
+
+    (void) argc; /* unused */
+    (void) argv; /* unused */
+
+    utf8proc_stats_reset();
+    check(utf8proc_stats_get(&stats) && stats.bytes_in == 0 && stats.composition_hits == 0,
+          "counters not reset");
+
+    count("a\xcc\x81", UTF8PROC_STABLE | UTF8PROC_COMPOSE);
+    check(stats.bytes_in == 3 && stats.bytes_out == 2 && stats.codepoints_in == 2 &&
+          stats.codepoints_out == 2, "wrong byte or codepoint counts of NFC: %d %d %d %d",
+          (int) stats.bytes_in, (int) stats.bytes_out, (int) stats.codepoints_in, (int) stats.codepoints_out);
+    check(stats.composition_hits == 1 && stats.composition_misses == 0 &&
+          stats.compositions_skipped == 0, "wrong composition counts");
+    count("\xce\xa9X", UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_CASEFOLD); /* nothing composes */
+    check(stats.compositions_skipped >= 1 && stats.composition_misses == 0 && stats.bytes_out == 3,
+          "composition pass not skipped");
+
+    count("\xea\xb0\x80", UTF8PROC_STABLE | UTF8PROC_DECOMPOSE); /* Hangul syllable */
+    check(stats.hangul_decompositions == 1 && stats.codepoints_out == 2, "wrong Hangul decomposition counts");
+    count("\xe1\x84\x80\xe1\x85\xa1", UTF8PROC_STABLE | UTF8PROC_COMPOSE); /* its jamo */
+    check(stats.hangul_compositions == 1 && stats.bytes_out == 3, "wrong Hangul composition counts");
+
+    count("\xef\xac\x81", UTF8PROC_STABLE | UTF8PROC_DECOMPOSE | UTF8PROC_COMPAT); /* fi ligature */
+    check(stats.expansions == 1 && stats.recursive_expansions == 0 && stats.codepoints_out == 2,
+          "wrong expansion counts");
+    count("\xef\xac\x81", UTF8PROC_STABLE | UTF8PROC_DECOMPOSE | UTF8PROC_COMPAT | UTF8PROC_LUMP);
+    check(stats.expansions == 1 && stats.recursive_expansions == 1, "wrong recursive expansion counts");
+
+    /* a buffer that is too short does not decompose twice for UTF8PROC_STREAMSAFE */
+    utf8proc_stats_reset();
+    check(utf8proc_decompose((const utf8proc_uint8_t *) "\xef\xac\x81", 3, NULL, 0,
+                             UTF8PROC_DECOMPOSE | UTF8PROC_COMPAT | UTF8PROC_STREAMSAFE) == 2, "wrong decomposition size");
+    utf8proc_stats_get(&stats);
+    check(stats.expansions == 1 && stats.codepoints_out == 2, "wrong stream-safe expansion counts");
+
+    /* U+0301 (230) in front of U+0326 (220), which does not compose with a */
+    utf8proc_stats_reset();
+    check(utf8proc_decompose((const utf8proc_uint8_t *) "a\xcc\x81\xcc\xa6", 5, buffer, 16,
+                             UTF8PROC_DECOMPOSE) == 3, "wrong decomposition");
+    utf8proc_stats_get(&stats);
+    check(stats.reordered_runs == 1 && stats.reordered_marks == 2 && stats.bytes_in == 5,
+          "wrong reordering counts");
+    check(utf8proc_normalize_utf32(buffer, 3, UTF8PROC_COMPOSE) == 2, "wrong composition");
+    utf8proc_stats_get(&stats);
+    check(stats.composition_misses == 1 && stats.composition_hits == 1, "wrong composition miss count");
+
+    count("x\xff", UTF8PROC_STABLE | UTF8PROC_COMPOSE);
+    check(stats.invalid_utf8 == 1, "invalid UTF-8 not counted");
+
+    memset(ascii, 'a', 100);
+    ascii[100] = 0;
+    count(ascii, UTF8PROC_STABLE | UTF8PROC_COMPOSE);
+    check(stats.quick_check_bytes == 100 && stats.bytes_in == 100 && stats.bytes_out == 100,
+          "wrong quick check counts");
+    count(ascii, UTF8PROC_CASEFOLD);
+    check(stats.ascii_bytes >= 64 && stats.bytes_in == 100 && stats.codepoints_out == 100,
+          "wrong ASCII counts");
+
+    printf("Stats tests SUCCEEDED.\n");
+    return 0;
+}
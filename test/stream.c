@@ -0,0 +1,90 @@
+#include "tests.h"
+
+/* feed `str` to `stream` in chunks of `chunk` bytes and compare the
+   concatenated output with utf8proc_map */
+static void check_chunked(utf8proc_stream_t *stream, const char *str, utf8proc_option_t options, size_t chunk)
+{
+    size_t len = strlen(str), pos, outlen = 0;
+    utf8proc_uint8_t out[1024], *expected;
+    const utf8proc_uint8_t *dst;
+    utf8proc_ssize_t result;
+
+    for (pos = 0; pos < len; pos += chunk) {
+        result = utf8proc_stream_feed(stream, (const utf8proc_uint8_t *) str + pos,
+                                      (utf8proc_ssize_t) (len - pos < chunk ? len - pos : chunk), &dst);
+        check(result >= 0, "utf8proc_stream_feed failed: %s", utf8proc_errmsg(result));
+        check(strlen((const char *) dst) == (size_t) result, "utf8proc_stream_feed output is not NUL-terminated");
+        memcpy(out + outlen, dst, (size_t) result);
+        outlen += (size_t) result;
+    }
+    result = utf8proc_stream_finish(stream, &dst);
+    check(result >= 0, "utf8proc_stream_finish failed: %s", utf8proc_errmsg(result));
+    memcpy(out + outlen, dst, (size_t) result);
+    outlen += (size_t) result;
+
+    result = utf8proc_map((const utf8proc_uint8_t *) str, (utf8proc_ssize_t) len, &expected, options);
+    check(result >= 0 && (size_t) result == outlen && !memcmp(out, expected, outlen),
+          "chunks of %d bytes of \"%s\" were not mapped like the whole string", (int) chunk, str);
+    free(expected);
+}
+
+int main(int argc, char **argv)
+{
+    static const char *strings[] = {
+        "e\xcc\x81",                             /* e + acute */
+        "a\xcc\x81\xcc\xa3 \xe1\x84\x80\xe1\x85\xa1\xe1\x86\xa8", /* marks to reorder, Hangul L V T */
+        "ABC\r\nDEF\xef\xbc\xa1\xc3\x9f\xe2\x80\xa8\xf0\x9f\x87\xa9\xf0\x9f\x87\xaa!",
+        "The quick brown fox jumps over the lazy dog, twice: THE QUICK BROWN FOX\xcc\x88",
+        "o\xcc\x88\xcc\xa3\xcc\x88\xcc\xa3\xcc\x88\xcc\xa3\xcc\x88\xcc\xa3\xcc\x88\xcc\xa3\xcc\x88\xcc\xa3"
+        "\xcc\x88\xcc\xa3\xcc\x88\xcc\xa3\xcc\x88\xcc\xa3\xcc\x88\xcc\xa3\xcc\x88\xcc\xa3\xcc\x88\xcc\xa3"
+        "\xcc\x88\xcc\xa3\xcc\x88\xcc\xa3\xcc\x88\xcc\xa3\xcc\x88\xcc\xa3\xcc\x88\xcc\xa3\xcc\x88\xcc\xa3"
+        "\xe1\xb9\xa9\xcc\x88\xcc\xa3x" /* 36 marks in front of U+1E69 */
+    };
+    static const utf8proc_option_t options[] = {
+        UTF8PROC_STABLE | UTF8PROC_COMPOSE,
+        UTF8PROC_STABLE | UTF8PROC_DECOMPOSE | UTF8PROC_COMPAT,
+        UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_COMPAT | UTF8PROC_CASEFOLD | UTF8PROC_IGNORE,
+        UTF8PROC_COMPOSE | UTF8PROC_CHARBOUND | UTF8PROC_NLF2LS | UTF8PROC_LUMP,
+        UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_STREAMSAFE
+    };
+    utf8proc_stream_t *stream;
+    const utf8proc_uint8_t *dst;
+    utf8proc_ssize_t result;
+    size_t i, j, chunk;
+
+    (void) argc; /* unused */
+    (void) argv; /* unused */
+
+    for (j = 0; j < sizeof(options) / sizeof(options[0]); j++) {
+        check(utf8proc_stream_new(&stream, options[j], NULL, NULL, NULL) == 0, "utf8proc_stream_new failed");
+        for (i = 0; i < sizeof(strings) / sizeof(strings[0]); i++)
+            for (chunk = 1; chunk <= 8; chunk++)
+                check_chunked(stream, strings[i], options[j], chunk);
+        utf8proc_stream_free(stream);
+    }
+
+    /* a mark in one chunk composes with the final starter of the previous one */
+    check(utf8proc_stream_new(&stream, UTF8PROC_STABLE | UTF8PROC_COMPOSE, NULL, NULL, NULL) == 0,
+          "utf8proc_stream_new failed");
+    result = utf8proc_stream_feed(stream, (const utf8proc_uint8_t *) "ae", 2, &dst);
+    check(result == 1 && dst[0] == 'a', "the final starter of a chunk was not held back");
+    result = utf8proc_stream_feed(stream, (const utf8proc_uint8_t *) "\xcc\x81", 2, &dst);
+    check(result == 0, "a combining mark was not held back");
+    result = utf8proc_stream_finish(stream, &dst);
+    check(result == 2 && !strcmp((const char *) dst, "\xc3\xa9"), "a mark did not compose across chunks");
+
+    /* an incomplete sequence at the end is an error, which sticks */
+    result = utf8proc_stream_feed(stream, (const utf8proc_uint8_t *) "x\xe2\x82", 3, &dst);
+    check(result == 0, "an incomplete sequence was not held back");
+    result = utf8proc_stream_finish(stream, &dst);
+    check(result == UTF8PROC_ERROR_INVALIDUTF8 && !dst, "an incomplete sequence was accepted");
+    result = utf8proc_stream_feed(stream, (const utf8proc_uint8_t *) "x", 1, &dst);
+    check(result == UTF8PROC_ERROR_INVALIDUTF8, "the error did not stick");
+    utf8proc_stream_free(stream);
+
+    check(utf8proc_stream_new(&stream, UTF8PROC_COMPOSE | UTF8PROC_DECOMPOSE, NULL, NULL, NULL) == UTF8PROC_ERROR_INVALIDOPTS && !stream,
+          "invalid options were accepted");
+
+    printf("Stream tests SUCCEEDED.\n");
+    return 0;
+}
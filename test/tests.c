@@ -44,3 +44,33 @@ size_t encode(char *dest, const char *buf)
           d += utf8proc_encode_char(c, (utf8proc_uint8_t *) (dest + d));
      }
 }
+
+void *count_alloc(size_t size, void *data)
+{
+    counting_allocator *a = (counting_allocator *) data;
+    a->calls++; a->live++;
+    return malloc(size);
+}
+
+void *count_realloc(void *ptr, size_t size, void *data)
+{
+    ((counting_allocator *) data)->calls++;
+    return realloc(ptr, size);
+}
+
+void count_free(void *ptr, void *data)
+{
+    ((counting_allocator *) data)->live--;
+    free(ptr);
+}
+
+/* point `allocator` to the count_ functions, counting in `counts` */
+void init_counting_allocator(utf8proc_allocator_t *allocator, counting_allocator *counts)
+{
+    counts->calls = 0;
+    counts->live = 0;
+    allocator->alloc_func = count_alloc;
+    allocator->realloc_func = count_realloc;
+    allocator->free_func = count_free;
+    allocator->data = counts;
+}
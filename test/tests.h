@@ -21,3 +21,14 @@ extern size_t lineno;
 void check(int cond, const char *format, ...);
 size_t skipspaces(const char *buf, size_t i);
 size_t encode(char *dest, const char *buf);
+
+/* an allocator for utf8proc_allocator_t that counts what it does */
+typedef struct {
+    size_t calls; /* allocations and reallocations */
+    long live;    /* blocks not freed yet */
+} counting_allocator;
+
+void *count_alloc(size_t size, void *data);
+void *count_realloc(void *ptr, size_t size, void *data);
+void count_free(void *ptr, void *data);
+void init_counting_allocator(utf8proc_allocator_t *allocator, counting_allocator *counts);
@@ -42,6 +42,34 @@
 
 
 #include "utf8proc.h"
+#include <string.h>
+
+/* vector kernels for runs of ASCII; define UTF8PROC_NO_SIMD to use only
+   the portable word-at-a-time versions */
+#if !defined(UTF8PROC_NO_SIMD)
+#  if defined(__SSE2__) || defined(_M_X64) || \
+      (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    include <emmintrin.h>
+#    define UTF8PROC_SSE2 1
+     /* the UTF-8 validator needs SSSE3 byte shuffles, which GCC and clang
+        can also compile for and select at runtime */
+#    if defined(__SSSE3__) || defined(__AVX__)
+#      include <tmmintrin.h>
+#      define UTF8PROC_SSSE3 1
+#      define UTF8PROC_SSSE3_TARGET
+#      define UTF8PROC_HAVE_SSSE3() 1
+#    elif (defined(__x86_64__) || defined(__i386__)) && \
+          ((defined(__GNUC__) && __GNUC__ >= 5) || defined(__clang__))
+#      include <tmmintrin.h>
+#      define UTF8PROC_SSSE3 1
+#      define UTF8PROC_SSSE3_TARGET __attribute__((target("ssse3")))
+#      define UTF8PROC_HAVE_SSSE3() __builtin_cpu_supports("ssse3")
+#    endif
+#  elif defined(__ARM_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+#    include <arm_neon.h>
+#    define UTF8PROC_NEON 1
+#  endif
+#endif
 
 #ifndef SSIZE_MAX
 #define SSIZE_MAX ((size_t)SIZE_MAX/2)
@@ -50,7 +78,78 @@
 #  define UINT16_MAX 65535U
 #endif
 
-#include "utf8proc_data.c"
+/* hot-path counters, see utf8proc_stats_get; define UTF8PROC_STATS to
+   enable them, otherwise UTF8PROC_STAT compiles to nothing */
+#ifdef UTF8PROC_STATS
+#  if defined(_MSC_VER)
+#    define UTF8PROC_THREAD_LOCAL __declspec(thread)
+#  elif defined(__GNUC__) || defined(__clang__)
+#    define UTF8PROC_THREAD_LOCAL __thread
+#  else
+#    define UTF8PROC_THREAD_LOCAL _Thread_local
+#  endif
+static UTF8PROC_THREAD_LOCAL utf8proc_stats_t utf8proc_stats;
+#  define UTF8PROC_STAT(counter, n) (utf8proc_stats.counter += (utf8proc_uint64_t)(n))
+#else
+#  define UTF8PROC_STAT(counter, n) ((void)0)
+#endif
+
+/* for the option-specialized copies of the decomposition kernel */
+#if defined(_MSC_VER)
+#  define UTF8PROC_ALWAYS_INLINE __forceinline
+#elif defined(__GNUC__) || defined(__clang__)
+#  define UTF8PROC_ALWAYS_INLINE __inline__ __attribute__((always_inline))
+#else
+#  define UTF8PROC_ALWAYS_INLINE
+#endif
+
+/* The fields of utf8proc_property_t that normalization, segmentation and
+   quick checks read, kept in a separate array with the same index as
+   utf8proc_properties so that these hot paths pull half as much data into
+   the cache.  The hot properties also index the full (recursive)
+   decompositions in utf8proc_expansions.  Define UTF8PROC_NO_HOT_PROPERTIES
+   to save the memory of these arrays and read utf8proc_properties instead. */
+#ifndef UTF8PROC_NO_HOT_PROPERTIES
+typedef struct utf8proc_hot_property_struct {
+  utf8proc_uint16_t decomp_seqindex;
+  utf8proc_uint16_t casefold_seqindex;
+  utf8proc_uint16_t comb_index;
+  utf8proc_uint16_t expansion_index; /* row of utf8proc_expansions */
+  unsigned combining_class:8;
+  unsigned category:5;
+  unsigned boundclass:5;
+  unsigned decomp_type:1; /* whether decomp_type is nonzero (compatibility) */
+  unsigned ignorable:1;
+  unsigned comp_exclusion:1;
+  unsigned nfc_qc:2;
+  unsigned nfd_qc:2;
+  unsigned nfkc_qc:2;
+  unsigned nfkd_qc:2;
+} utf8proc_hot_property_t;
+#else
+typedef utf8proc_property_t utf8proc_hot_property_t;
+#define utf8proc_hot_properties utf8proc_properties
+#endif
+
+/* Define UTF8PROC_DATA_FILE as a quoted file name to build with tables
+   generated by data/data_generator.rb from a subset of the data, which
+   defines UTF8PROC_DATA_NO_COMPAT etc. for what it leaves out. */
+#ifdef UTF8PROC_DATA_FILE
+#  include UTF8PROC_DATA_FILE
+#else
+#  include "utf8proc_data.c"
+#endif
+
+/* the options that the tables cannot serve, rejected with
+   UTF8PROC_ERROR_INVALIDOPTS */
+#ifdef UTF8PROC_DATA_NO_COMPAT
+#  define UTF8PROC_DATA_UNSUPPORTED UTF8PROC_COMPAT
+#else
+#  define UTF8PROC_DATA_UNSUPPORTED 0
+#endif
+
+#define UTF8PROC_COMPOSITION_COUNT \
+  (sizeof(utf8proc_compositions) / sizeof(utf8proc_compositions[0]))
 
 
 UTF8PROC_DLLEXPORT const utf8proc_int8_t utf8proc_utf8class[256] = {
@@ -227,91 +326,484 @@ static utf8proc_ssize_t unsafe_encode_char(utf8proc_int32_t uc, utf8proc_uint8_t
    } else return 0;
 }
 
+/* the index of the properties of uc.  The codepoints below U+0800, which
+   have one- and two-byte encodings and make up most text in Latin, Greek,
+   Cyrillic, Hebrew and Arabic scripts, are looked up in a flat table of
+   4 KiB instead of the two stages (define UTF8PROC_NO_DIRECT_TABLE to
+   leave it out).  Define UTF8PROC_COMPACT_STAGE2 for a second stage of
+   8-bit indices into a palette per block, about a third smaller (30 KiB)
+   for one more load per lookup. */
+static utf8proc_uint16_t unsafe_property_index(utf8proc_int32_t uc) {
+  /* ASSERT: uc >= 0 && uc < 0x110000 */
+#ifndef UTF8PROC_NO_DIRECT_TABLE
+  if (uc < 0x800) return utf8proc_direct_table[uc];
+#endif
+#ifndef UTF8PROC_COMPACT_STAGE2
+  return utf8proc_stage2table[
+    utf8proc_stage1table[uc >> 8] + (uc & 0xFF)
+  ];
+#else
+  {
+    int block = utf8proc_stage1_blocks[uc >> 8];
+    return utf8proc_stage2_palettes[utf8proc_stage2_palette_offsets[block] +
+      utf8proc_stage2_palette_indices[block << 8 | (uc & 0xFF)]];
+  }
+#endif
+}
+
 /* internal "unsafe" version that does not check whether uc is in range */
 static const utf8proc_property_t *unsafe_get_property(utf8proc_int32_t uc) {
   /* ASSERT: uc >= 0 && uc < 0x110000 */
-  return utf8proc_properties + (
-    utf8proc_stage2table[
-      utf8proc_stage1table[uc >> 8] + (uc & 0xFF)
-    ]
-  );
+  return utf8proc_properties + unsafe_property_index(uc);
+}
+
+/* the hot fields of the properties of uc, see utf8proc_hot_property_t */
+static const utf8proc_hot_property_t *unsafe_get_hot_property(utf8proc_int32_t uc) {
+  /* ASSERT: uc >= 0 && uc < 0x110000 */
+  return utf8proc_hot_properties + unsafe_property_index(uc);
+}
+
+/* Runs of ASCII.  Every ASCII character is assigned, not ignorable, not a
+   mark, has no decomposition, lumps to itself and casefolds at most from
+   A-Z to a-z, so outside of UTF8PROC_CHARBOUND (and custom mappings) such
+   runs can be processed in bulk, 16 bytes at a time with SSE2 or NEON
+   (both part of the baseline of x86-64 and AArch64), or one machine word
+   at a time otherwise. */
+
+/* the number of ASCII bytes at the start of str[0..len) */
+static utf8proc_ssize_t ascii_span(const utf8proc_uint8_t *str, utf8proc_ssize_t len) {
+  utf8proc_ssize_t pos = 0;
+#if defined(UTF8PROC_SSE2)
+  for (; pos + 16 <= len; pos += 16)
+    if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(str + pos)))) break;
+#elif defined(UTF8PROC_NEON)
+  for (; pos + 16 <= len; pos += 16)
+    if (vmaxvq_u8(vld1q_u8(str + pos)) >= 0x80) break;
+#else
+  for (; pos + (utf8proc_ssize_t)sizeof(size_t) <= len; pos += sizeof(size_t)) {
+    size_t word;
+    memcpy(&word, str + pos, sizeof(size_t));
+    if (word & ((size_t)-1 / 0xFF * 0x80)) break;
+  }
+#endif
+  while (pos < len && str[pos] < 0x80) pos++;
+  return pos;
+}
+
+#define ascii_tolower(c) ((utf8proc_uint8_t)((unsigned)((c) - 'A') < 26 ? (c) + 0x20 : (c)))
+
+#if defined(UTF8PROC_SSE2)
+static __m128i ascii_tolower16(__m128i x) {
+  __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('A' - 1)),
+                                _mm_cmplt_epi8(x, _mm_set1_epi8('Z' + 1)));
+  return _mm_add_epi8(x, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+#elif defined(UTF8PROC_NEON)
+static uint8x16_t ascii_tolower16(uint8x16_t x) {
+  uint8x16_t upper = vandq_u8(vcgeq_u8(x, vdupq_n_u8('A')),
+                              vcleq_u8(x, vdupq_n_u8('Z')));
+  return vaddq_u8(x, vandq_u8(upper, vdupq_n_u8(0x20)));
+}
+#endif
+
+#define ascii_toupper(c) ((utf8proc_uint8_t)((unsigned)((c) - 'a') < 26 ? (c) - 0x20 : (c)))
+
+#if defined(UTF8PROC_SSE2)
+static __m128i ascii_toupper16(__m128i x) {
+  __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('a' - 1)),
+                                _mm_cmplt_epi8(x, _mm_set1_epi8('z' + 1)));
+  return _mm_sub_epi8(x, _mm_and_si128(lower, _mm_set1_epi8(0x20)));
+}
+#elif defined(UTF8PROC_NEON)
+static uint8x16_t ascii_toupper16(uint8x16_t x) {
+  uint8x16_t lower = vandq_u8(vcgeq_u8(x, vdupq_n_u8('a')),
+                              vcleq_u8(x, vdupq_n_u8('z')));
+  return vsubq_u8(x, vandq_u8(lower, vdupq_n_u8(0x20)));
+}
+#endif
+
+/* copy the `len` ASCII bytes of `src` to `dst`, mapping A-Z to a-z if
+   `lower` is set (in which case `dst` may overlap `src` as long as it does
+   not start behind it) */
+static void ascii_copy(const utf8proc_uint8_t *src, utf8proc_uint8_t *dst, utf8proc_ssize_t len, utf8proc_bool lower) {
+  utf8proc_ssize_t pos = 0;
+  if (!lower) {
+    memcpy(dst, src, (size_t)len);
+    return;
+  }
+#if defined(UTF8PROC_SSE2)
+  for (; pos + 16 <= len; pos += 16)
+    _mm_storeu_si128((__m128i *)(dst + pos),
+      ascii_tolower16(_mm_loadu_si128((const __m128i *)(src + pos))));
+#elif defined(UTF8PROC_NEON)
+  for (; pos + 16 <= len; pos += 16)
+    vst1q_u8(dst + pos, ascii_tolower16(vld1q_u8(src + pos)));
+#endif
+  for (; pos < len; pos++) dst[pos] = ascii_tolower(src[pos]);
+}
+
+/* copy the `len` ASCII bytes of `src` to `dst`, mapping a-z to A-Z; `dst`
+   may overlap `src` as long as it does not start behind it */
+static void ascii_copy_upper(const utf8proc_uint8_t *src, utf8proc_uint8_t *dst, utf8proc_ssize_t len) {
+  utf8proc_ssize_t pos = 0;
+#if defined(UTF8PROC_SSE2)
+  for (; pos + 16 <= len; pos += 16)
+    _mm_storeu_si128((__m128i *)(dst + pos),
+      ascii_toupper16(_mm_loadu_si128((const __m128i *)(src + pos))));
+#elif defined(UTF8PROC_NEON)
+  for (; pos + 16 <= len; pos += 16)
+    vst1q_u8(dst + pos, ascii_toupper16(vld1q_u8(src + pos)));
+#endif
+  for (; pos < len; pos++) dst[pos] = ascii_toupper(src[pos]);
+}
+
+/* widen the `len` ASCII bytes of `src` to codepoints in `dst`, mapping A-Z
+   to a-z if `lower` is set */
+static void ascii_widen(const utf8proc_uint8_t *src, utf8proc_int32_t *dst, utf8proc_ssize_t len, utf8proc_bool lower) {
+  utf8proc_ssize_t pos = 0;
+#if defined(UTF8PROC_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  for (; pos + 16 <= len; pos += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(src + pos));
+    __m128i lo, hi;
+    if (lower) x = ascii_tolower16(x);
+    lo = _mm_unpacklo_epi8(x, zero);
+    hi = _mm_unpackhi_epi8(x, zero);
+    _mm_storeu_si128((__m128i *)(dst + pos), _mm_unpacklo_epi16(lo, zero));
+    _mm_storeu_si128((__m128i *)(dst + pos + 4), _mm_unpackhi_epi16(lo, zero));
+    _mm_storeu_si128((__m128i *)(dst + pos + 8), _mm_unpacklo_epi16(hi, zero));
+    _mm_storeu_si128((__m128i *)(dst + pos + 12), _mm_unpackhi_epi16(hi, zero));
+  }
+#elif defined(UTF8PROC_NEON)
+  for (; pos + 16 <= len; pos += 16) {
+    uint8x16_t x = vld1q_u8(src + pos);
+    uint16x8_t lo, hi;
+    if (lower) x = ascii_tolower16(x);
+    lo = vmovl_u8(vget_low_u8(x));
+    hi = vmovl_u8(vget_high_u8(x));
+    vst1q_u32((utf8proc_uint32_t *)(dst + pos), vmovl_u16(vget_low_u16(lo)));
+    vst1q_u32((utf8proc_uint32_t *)(dst + pos + 4), vmovl_u16(vget_high_u16(lo)));
+    vst1q_u32((utf8proc_uint32_t *)(dst + pos + 8), vmovl_u16(vget_low_u16(hi)));
+    vst1q_u32((utf8proc_uint32_t *)(dst + pos + 12), vmovl_u16(vget_high_u16(hi)));
+  }
+#endif
+  if (lower) {
+    for (; pos < len; pos++) dst[pos] = ascii_tolower(src[pos]);
+  } else {
+    for (; pos < len; pos++) dst[pos] = src[pos];
+  }
+}
+
+/* narrow the run of ASCII codepoints at the start of src[0..len) to bytes
+   in `dst`, returning its length.  `dst` may overlap `src` as long as it
+   does not start behind it (as when re-encoding in place). */
+static utf8proc_ssize_t ascii_narrow(const utf8proc_int32_t *src, utf8proc_ssize_t len, utf8proc_uint8_t *dst) {
+  utf8proc_ssize_t pos = 0;
+#if defined(UTF8PROC_SSE2)
+  const __m128i nonascii = _mm_set1_epi32(~0x7F);
+  for (; pos + 16 <= len; pos += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(src + pos));
+    __m128i b = _mm_loadu_si128((const __m128i *)(src + pos + 4));
+    __m128i c = _mm_loadu_si128((const __m128i *)(src + pos + 8));
+    __m128i d = _mm_loadu_si128((const __m128i *)(src + pos + 12));
+    __m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(any, nonascii),
+                                          _mm_setzero_si128())) != 0xFFFF) break;
+    _mm_storeu_si128((__m128i *)(dst + pos),
+      _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+  }
+#elif defined(UTF8PROC_NEON)
+  for (; pos + 16 <= len; pos += 16) {
+    const utf8proc_uint32_t *s = (const utf8proc_uint32_t *)(src + pos);
+    uint32x4_t a = vld1q_u32(s), b = vld1q_u32(s + 4);
+    uint32x4_t c = vld1q_u32(s + 8), d = vld1q_u32(s + 12);
+    if (vmaxvq_u32(vorrq_u32(vorrq_u32(a, b), vorrq_u32(c, d))) >= 0x80) break;
+    vst1q_u8(dst + pos, vcombine_u8(
+      vmovn_u16(vcombine_u16(vmovn_u32(a), vmovn_u32(b))),
+      vmovn_u16(vcombine_u16(vmovn_u32(c), vmovn_u32(d)))));
+  }
+#endif
+  for (; pos < len && (utf8proc_uint32_t)src[pos] < 0x80; pos++)
+    dst[pos] = (utf8proc_uint8_t)src[pos];
+  return pos;
+}
+
+/* the number of printable characters (0x20-0x7E, which have width 1) in
+   the ASCII string str[0..len), i.e. its width in columns */
+static utf8proc_ssize_t ascii_width(const utf8proc_uint8_t *str, utf8proc_ssize_t len) {
+  utf8proc_ssize_t pos = 0, controls = 0;
+#if defined(UTF8PROC_SSE2)
+  const __m128i space = _mm_set1_epi8(0x20), del = _mm_set1_epi8(0x7F);
+  while (pos + 16 <= len) {
+    /* count the controls of each lane in bytes, for at most 255 blocks */
+    __m128i counts = _mm_setzero_si128();
+    utf8proc_ssize_t end = len - pos < 255 * 16 ? len - ((len - pos) & 15) : pos + 255 * 16;
+    for (; pos < end; pos += 16) {
+      __m128i x = _mm_loadu_si128((const __m128i *)(str + pos));
+      counts = _mm_sub_epi8(counts, _mm_or_si128(_mm_cmplt_epi8(x, space), _mm_cmpeq_epi8(x, del)));
+    }
+    counts = _mm_sad_epu8(counts, _mm_setzero_si128());
+    controls += _mm_cvtsi128_si32(counts) + _mm_cvtsi128_si32(_mm_srli_si128(counts, 8));
+  }
+#elif defined(UTF8PROC_NEON)
+  while (pos + 16 <= len) {
+    uint8x16_t counts = vdupq_n_u8(0);
+    utf8proc_ssize_t end = len - pos < 255 * 16 ? len - ((len - pos) & 15) : pos + 255 * 16;
+    for (; pos < end; pos += 16) {
+      uint8x16_t x = vld1q_u8(str + pos);
+      counts = vsubq_u8(counts, vorrq_u8(vcltq_u8(x, vdupq_n_u8(0x20)), vceqq_u8(x, vdupq_n_u8(0x7F))));
+    }
+    controls += vaddlvq_u8(counts);
+  }
+#else
+  {
+    const size_t ones = (size_t)-1 / 0xFF;
+    for (; pos + (utf8proc_ssize_t)sizeof(size_t) <= len; pos += sizeof(size_t)) {
+      size_t word, printable;
+      memcpy(&word, str + pos, sizeof(size_t));
+      /* the high bit of each byte is set if it is >= 0x20 and != 0x7F;
+         no addition carries into the next byte since all bytes are < 0x80 */
+      printable = (word + ones * 0x60) & ((word ^ ones * 0x7F) + ones * 0x7F) & ones * 0x80;
+      controls += (utf8proc_ssize_t)((((printable >> 7) ^ ones) * ones) >> ((sizeof(size_t) - 1) * 8));
+    }
+  }
+#endif
+  for (; pos < len; pos++) controls += str[pos] < 0x20 || str[pos] == 0x7F;
+  return len - controls;
+}
+
+/* the length of the NUL-terminated `str` */
+static utf8proc_ssize_t nulterm_length(const utf8proc_uint8_t *str) {
+  return (utf8proc_ssize_t)strlen((const char *)str);
+}
+
+/* internal "unsafe" version of utf8proc_iterate for valid UTF-8 */
+static utf8proc_ssize_t unsafe_decode_char(const utf8proc_uint8_t *str, utf8proc_int32_t *dst) {
+  utf8proc_int32_t uc = str[0];
+  if (uc < 0x80) {
+    *dst = uc;
+    return 1;
+  } else if (uc < 0xE0) {
+    *dst = ((uc & 0x1F) << 6) | (str[1] & 0x3F);
+    return 2;
+  } else if (uc < 0xF0) {
+    *dst = ((uc & 0x0F) << 12) | ((str[1] & 0x3F) << 6) | (str[2] & 0x3F);
+    return 3;
+  }
+  *dst = ((uc & 0x07) << 18) | ((str[1] & 0x3F) << 12) |
+    ((str[2] & 0x3F) << 6) | (str[3] & 0x3F);
+  return 4;
+}
+
+/* UTF-8 validation in the style of Keiser & Lemire, "Validating UTF-8 In
+   Less Than One Instruction Per Byte" (2021): the error classes of each
+   pair of adjacent bytes are looked up by the high nibble of the first,
+   the low nibble of the first and the high nibble of the second byte, and
+   AND-ed, while the positions that must be the third or fourth byte of a
+   sequence are derived from the bytes two and three places earlier. */
+#if defined(UTF8PROC_SSSE3) || defined(UTF8PROC_NEON)
+#define UTF8_TOO_SHORT  (1 << 0) /* lead byte not followed by a continuation */
+#define UTF8_TOO_LONG   (1 << 1) /* continuation byte after ASCII */
+#define UTF8_OVERLONG_3 (1 << 2) /* E0 80..9F */
+#define UTF8_TOO_LARGE  (1 << 3) /* F4 90..BF, F5..FF */
+#define UTF8_SURROGATE  (1 << 4) /* ED A0..BF */
+#define UTF8_OVERLONG_2 (1 << 5) /* C0, C1 */
+#define UTF8_TOO_LARGE_1000 (1 << 6) /* F5..FF 80..8F */
+#define UTF8_OVERLONG_4 (1 << 6) /* F0 80..8F */
+#define UTF8_TWO_CONTS  (1 << 7) /* two continuation bytes, checked against
+                                    the positions that need them */
+#define UTF8_CARRY (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+/* indexed by the high and low nibbles of the first and the high nibble of
+   the second byte of each pair, and the bytes of a block that must not
+   end it */
+static const utf8proc_uint8_t utf8_validate_tables[4][16] = {
+  {
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+    UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+    UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4
+  }, {
+    UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_OVERLONG_2,
+    UTF8_CARRY,
+    UTF8_CARRY,
+    UTF8_CARRY | UTF8_TOO_LARGE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000
+  }, {
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 |
+    UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 |
+    UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE |
+    UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE |
+    UTF8_TOO_LARGE,
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT
+  }, {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1
+  }
+};
+#endif
+
+#if defined(UTF8PROC_SSSE3)
+/* the length of a prefix of str[0..len) that is valid UTF-8, found 16
+   bytes at a time; it may end in front of the first invalid sequence or a
+   few bytes earlier */
+UTF8PROC_SSSE3_TARGET
+static utf8proc_ssize_t validate_block_prefix(const utf8proc_uint8_t *str, utf8proc_ssize_t len) {
+  const __m128i byte_1_high = _mm_loadu_si128((const __m128i *) utf8_validate_tables[0]);
+  const __m128i byte_1_low = _mm_loadu_si128((const __m128i *) utf8_validate_tables[1]);
+  const __m128i byte_2_high = _mm_loadu_si128((const __m128i *) utf8_validate_tables[2]);
+  const __m128i incomplete = _mm_loadu_si128((const __m128i *) utf8_validate_tables[3]);
+  const __m128i nibble = _mm_set1_epi8(0x0F);
+  __m128i prev = _mm_setzero_si128();
+  utf8proc_ssize_t pos = 0;
+  for (; pos + 16 <= len; pos += 16) {
+    __m128i input = _mm_loadu_si128((const __m128i *)(str + pos));
+    __m128i error;
+    if (!_mm_movemask_epi8(input)) {
+      /* ASCII only: valid unless the previous block ended mid-sequence */
+      error = _mm_subs_epu8(prev, incomplete);
+    } else {
+      __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+      __m128i prev2 = _mm_alignr_epi8(input, prev, 14);
+      __m128i prev3 = _mm_alignr_epi8(input, prev, 13);
+      __m128i special = _mm_and_si128(_mm_and_si128(
+        _mm_shuffle_epi8(byte_1_high, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+        _mm_shuffle_epi8(byte_1_low, _mm_and_si128(prev1, nibble))),
+        _mm_shuffle_epi8(byte_2_high, _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+      __m128i must23 = _mm_and_si128(_mm_or_si128(
+        _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80))),
+        _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80)))),
+        _mm_set1_epi8((char)0x80));
+      error = _mm_xor_si128(must23, special);
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) != 0xFFFF) break;
+    prev = input;
+  }
+  return pos;
+}
+#elif defined(UTF8PROC_NEON)
+static utf8proc_ssize_t validate_block_prefix(const utf8proc_uint8_t *str, utf8proc_ssize_t len) {
+  const uint8x16_t byte_1_high = vld1q_u8(utf8_validate_tables[0]);
+  const uint8x16_t byte_1_low = vld1q_u8(utf8_validate_tables[1]);
+  const uint8x16_t byte_2_high = vld1q_u8(utf8_validate_tables[2]);
+  const uint8x16_t incomplete = vld1q_u8(utf8_validate_tables[3]);
+  uint8x16_t prev = vdupq_n_u8(0);
+  utf8proc_ssize_t pos = 0;
+  for (; pos + 16 <= len; pos += 16) {
+    uint8x16_t input = vld1q_u8(str + pos);
+    uint8x16_t error;
+    if (vmaxvq_u8(input) < 0x80) {
+      error = vqsubq_u8(prev, incomplete);
+    } else {
+      uint8x16_t prev1 = vextq_u8(prev, input, 15);
+      uint8x16_t prev2 = vextq_u8(prev, input, 14);
+      uint8x16_t prev3 = vextq_u8(prev, input, 13);
+      uint8x16_t special = vandq_u8(vandq_u8(
+        vqtbl1q_u8(byte_1_high, vshrq_n_u8(prev1, 4)),
+        vqtbl1q_u8(byte_1_low, vandq_u8(prev1, vdupq_n_u8(0x0F)))),
+        vqtbl1q_u8(byte_2_high, vshrq_n_u8(input, 4)));
+      uint8x16_t must23 = vandq_u8(vorrq_u8(
+        vqsubq_u8(prev2, vdupq_n_u8(0xE0 - 0x80)),
+        vqsubq_u8(prev3, vdupq_n_u8(0xF0 - 0x80))),
+        vdupq_n_u8(0x80));
+      error = veorq_u8(must23, special);
+    }
+    if (vmaxvq_u8(error)) break;
+    prev = input;
+  }
+  return pos;
+}
+#endif
+
+/* the offset of the first invalid sequence in str[0..len), or len */
+static utf8proc_ssize_t validate_prefix(const utf8proc_uint8_t *str, utf8proc_ssize_t len) {
+  utf8proc_ssize_t pos = 0, end;
+  utf8proc_int32_t uc;
+#if defined(UTF8PROC_SSSE3)
+  if (UTF8PROC_HAVE_SSSE3())
+#endif
+#if defined(UTF8PROC_SSSE3) || defined(UTF8PROC_NEON)
+  {
+    pos = end = validate_block_prefix(str, len);
+    /* resume in front of the last sequence the blocks might have cut off */
+    while (pos > 0 && end - pos < 3 && utf_cont(str[pos - 1])) pos--;
+    if (pos > 0 && str[pos - 1] >= 0xC0) pos--;
+  }
+#endif
+  while (pos < len) {
+    if (str[pos] < 0x80) {
+      pos += ascii_span(str + pos, len - pos);
+    } else {
+      end = utf8proc_iterate(str + pos, len - pos, &uc);
+      if (uc < 0) break;
+      pos += end;
+    }
+  }
+  return pos;
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_validate(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_ssize_t *error_offset
+) {
+  utf8proc_ssize_t pos;
+  if (strlen < 0) strlen = nulterm_length(str);
+  pos = validate_prefix(str, strlen);
+  if (error_offset) *error_offset = pos;
+  return pos < strlen ? UTF8PROC_ERROR_INVALIDUTF8 : strlen;
+}
+
+/* internal version of utf8proc_get_property, which the compiler may inline */
+static const utf8proc_property_t *checked_get_property(utf8proc_int32_t uc) {
+  return (utf8proc_uint32_t) uc >= 0x110000 ? utf8proc_properties : unsafe_get_property(uc);
 }
 
 UTF8PROC_DLLEXPORT const utf8proc_property_t *utf8proc_get_property(utf8proc_int32_t uc) {
-  return uc < 0 || uc >= 0x110000 ? utf8proc_properties : unsafe_get_property(uc);
+  return checked_get_property(uc);
 }
 
-/* return whether there is a grapheme break between boundclasses lbc and tbc
-   (according to the definition of extended grapheme clusters)
-
-  Rule numbering refers to TR29 Version 29 (Unicode 9.0.0):
-  http://www.unicode.org/reports/tr29/tr29-29.html
-
-  CAVEATS:
-   Please note that evaluation of GB10 (grapheme breaks between emoji zwj sequences)
-   and GB 12/13 (regional indicator code points) require knowledge of previous characters
-   and are thus not handled by this function. This may result in an incorrect break before
-   an E_Modifier class codepoint and an incorrectly missing break between two
-   REGIONAL_INDICATOR class code points if such support does not exist in the caller.
-
-   See the special support in grapheme_break_extended, for required bookkeeping by the caller.
-*/
-static utf8proc_bool grapheme_break_simple(int lbc, int tbc) {
-  return
-    (lbc == UTF8PROC_BOUNDCLASS_START) ? true :       // GB1
-    (lbc == UTF8PROC_BOUNDCLASS_CR &&                 // GB3
-     tbc == UTF8PROC_BOUNDCLASS_LF) ? false :         // ---
-    (lbc >= UTF8PROC_BOUNDCLASS_CR && lbc <= UTF8PROC_BOUNDCLASS_CONTROL) ? true :  // GB4
-    (tbc >= UTF8PROC_BOUNDCLASS_CR && tbc <= UTF8PROC_BOUNDCLASS_CONTROL) ? true :  // GB5
-    (lbc == UTF8PROC_BOUNDCLASS_L &&                  // GB6
-     (tbc == UTF8PROC_BOUNDCLASS_L ||                 // ---
-      tbc == UTF8PROC_BOUNDCLASS_V ||                 // ---
-      tbc == UTF8PROC_BOUNDCLASS_LV ||                // ---
-      tbc == UTF8PROC_BOUNDCLASS_LVT)) ? false :      // ---
-    ((lbc == UTF8PROC_BOUNDCLASS_LV ||                // GB7
-      lbc == UTF8PROC_BOUNDCLASS_V) &&                // ---
-     (tbc == UTF8PROC_BOUNDCLASS_V ||                 // ---
-      tbc == UTF8PROC_BOUNDCLASS_T)) ? false :        // ---
-    ((lbc == UTF8PROC_BOUNDCLASS_LVT ||               // GB8
-      lbc == UTF8PROC_BOUNDCLASS_T) &&                // ---
-     tbc == UTF8PROC_BOUNDCLASS_T) ? false :          // ---
-    (tbc == UTF8PROC_BOUNDCLASS_EXTEND ||             // GB9
-     tbc == UTF8PROC_BOUNDCLASS_ZWJ ||                // ---
-     tbc == UTF8PROC_BOUNDCLASS_SPACINGMARK ||        // GB9a
-     lbc == UTF8PROC_BOUNDCLASS_PREPEND) ? false :    // GB9b
-    (lbc == UTF8PROC_BOUNDCLASS_E_ZWG &&              // GB11 (requires additional handling below)
-     tbc == UTF8PROC_BOUNDCLASS_EXTENDED_PICTOGRAPHIC) ? false : // ----
-    (lbc == UTF8PROC_BOUNDCLASS_REGIONAL_INDICATOR &&          // GB12/13 (requires additional handling below)
-     tbc == UTF8PROC_BOUNDCLASS_REGIONAL_INDICATOR) ? false :  // ----
-    true; // GB999
+/* advance the grapheme-break state machine over a codepoint of boundclass
+   tbc and return whether there is a break before it.  The state is the
+   boundclass of the preceding codepoint, adjusted for GB11 and GB12/13;
+   the rules are compiled into utf8proc_grapheme_transitions by
+   data/data_generator.rb.  States outside the table behave like OTHER. */
+static utf8proc_bool grapheme_transition(utf8proc_int32_t *state, int tbc)
+{
+  utf8proc_uint32_t s = (utf8proc_uint32_t) *state;
+  utf8proc_uint8_t entry = utf8proc_grapheme_transitions[
+    s < sizeof(utf8proc_grapheme_transitions) / sizeof(utf8proc_grapheme_transitions[0])
+    ? s : UTF8PROC_BOUNDCLASS_OTHER][tbc];
+  *state = entry & 0x7F;
+  return entry >> 7;
 }
 
+/* return whether there is a grapheme break between boundclasses lbc and tbc
+   (according to the definition of extended grapheme clusters).  Without a
+   state, GB11 and GB12/13 only see the boundclass lbc. */
 static utf8proc_bool grapheme_break_extended(int lbc, int tbc, utf8proc_int32_t *state)
 {
-  int lbc_override = ((state && *state != UTF8PROC_BOUNDCLASS_START)
-                      ? *state : lbc);
-  utf8proc_bool break_permitted = grapheme_break_simple(lbc_override, tbc);
-  if (state) {
-    // Special support for GB 12/13 made possible by GB999. After two RI
-    // class codepoints we want to force a break. Do this by resetting the
-    // second RI's bound class to UTF8PROC_BOUNDCLASS_OTHER, to force a break
-    // after that character according to GB999 (unless of course such a break is
-    // forbidden by a different rule such as GB9).
-    if (*state == tbc && tbc == UTF8PROC_BOUNDCLASS_REGIONAL_INDICATOR)
-      *state = UTF8PROC_BOUNDCLASS_OTHER;
-    // Special support for GB11 (emoji extend* zwj / emoji)
-    else if (*state == UTF8PROC_BOUNDCLASS_EXTENDED_PICTOGRAPHIC) {
-      if (tbc == UTF8PROC_BOUNDCLASS_EXTEND) // fold EXTEND codepoints into emoji
-        *state = UTF8PROC_BOUNDCLASS_EXTENDED_PICTOGRAPHIC;
-      else if (tbc == UTF8PROC_BOUNDCLASS_ZWJ)
-        *state = UTF8PROC_BOUNDCLASS_E_ZWG; // state to record emoji+zwg combo
-      else
-        *state = tbc;
-    }
-    else
-      *state = tbc;
-  }
-  return break_permitted;
+  if (state && *state != UTF8PROC_BOUNDCLASS_START)
+    return grapheme_transition(state, tbc);
+  if (state) *state = tbc;
+  return utf8proc_grapheme_transitions[lbc][tbc] >> 7;
 }
 
 UTF8PROC_DLLEXPORT utf8proc_bool utf8proc_grapheme_break_stateful(
@@ -328,6 +820,218 @@ UTF8PROC_DLLEXPORT utf8proc_bool utf8proc_grapheme_break(
   return utf8proc_grapheme_break_stateful(c1, c2, NULL);
 }
 
+UTF8PROC_DLLEXPORT void utf8proc_grapheme_init(
+  utf8proc_grapheme_iterator_t *iter, const utf8proc_uint8_t *str, utf8proc_ssize_t strlen
+) {
+  iter->str = str;
+  iter->strlen = strlen < 0 ? nulterm_length(str) : strlen;
+  iter->pos = 0;
+  iter->next = 0;
+  iter->state = UTF8PROC_BOUNDCLASS_START;
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_grapheme_next(utf8proc_grapheme_iterator_t *iter) {
+  const utf8proc_uint8_t *str = iter->str;
+  utf8proc_ssize_t pos = iter->next, seqlen;
+  utf8proc_int32_t uc;
+  if (iter->pos >= iter->strlen) return 0;
+  if (!pos) {
+    /* the first cluster: GB1 */
+    seqlen = utf8proc_iterate(str, iter->strlen, &uc);
+    if (uc < 0) return UTF8PROC_ERROR_INVALIDUTF8;
+    grapheme_transition(&iter->state, unsafe_get_hot_property(uc)->boundclass);
+    pos = seqlen;
+  }
+  while (pos < iter->strlen) {
+    seqlen = utf8proc_iterate(str + pos, iter->strlen - pos, &uc);
+    if (uc < 0) return UTF8PROC_ERROR_INVALIDUTF8;
+    if (grapheme_transition(&iter->state, unsafe_get_hot_property(uc)->boundclass)) {
+      iter->next = pos + seqlen;
+      break;
+    }
+    pos += seqlen;
+  }
+  return iter->pos = pos;
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_grapheme_truncate(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_ssize_t n
+) {
+  utf8proc_grapheme_iterator_t iter;
+  utf8proc_ssize_t end = 0, result;
+  utf8proc_grapheme_init(&iter, str, strlen);
+  for (; n > 0; n--) {
+    result = utf8proc_grapheme_next(&iter);
+    if (result < 0) return result;
+    if (!result) break;
+    end = result;
+  }
+  return end;
+}
+
+/* actions of the segment iterator, in the top two bits of the entries of
+   utf8proc_word_transitions and utf8proc_sentence_transitions: no break in
+   front of the codepoint, a break, no break yet but remember the position
+   because the rule needs to see what follows, or a break at the position
+   remembered after all, starting over from there in state 0 */
+#define SEGMENT_NOBREAK 0
+#define SEGMENT_BREAK 1
+#define SEGMENT_MARK 2
+#define SEGMENT_FAIL 3
+
+/* advance iter over the next segment with the given state machine of
+   nclasses columns (the last one for the end of the string), whose class
+   of each codepoint is bits shift..shift+4 of utf8proc_segment_classes */
+static utf8proc_ssize_t segment_next(
+  utf8proc_segment_iterator_t *iter, const utf8proc_uint8_t *transitions, int nclasses, int shift
+) {
+  const utf8proc_uint8_t *str = iter->str;
+  utf8proc_ssize_t pos = iter->next, mark = 0, seqlen;
+  utf8proc_int32_t uc, state = iter->state;
+  int segclass, t;
+  if (iter->pos >= iter->strlen) return 0;
+  for (;;) {
+    if (pos < iter->strlen) {
+      seqlen = utf8proc_iterate(str + pos, iter->strlen - pos, &uc);
+      if (uc < 0) return UTF8PROC_ERROR_INVALIDUTF8;
+      segclass = (utf8proc_segment_classes[unsafe_property_index(uc)] >> shift) & 0x1F;
+    } else {
+      seqlen = 0;
+      segclass = nclasses - 1;
+    }
+    t = transitions[state * nclasses + segclass];
+    state = t & 0x3F;
+    switch (t >> 6) {
+      case SEGMENT_BREAK:
+        iter->state = state;
+        iter->next = pos + seqlen;
+        return iter->pos = pos;
+      case SEGMENT_MARK:
+        mark = pos;
+        break;
+      case SEGMENT_FAIL:
+        iter->state = 0;
+        iter->next = mark;
+        return iter->pos = mark;
+    }
+    pos += seqlen;
+  }
+}
+
+static void segment_init(
+  utf8proc_segment_iterator_t *iter, const utf8proc_uint8_t *str, utf8proc_ssize_t strlen
+) {
+  iter->str = str;
+  iter->strlen = strlen < 0 ? nulterm_length(str) : strlen;
+  iter->pos = 0;
+  iter->next = 0;
+  iter->state = 0;
+}
+
+UTF8PROC_DLLEXPORT void utf8proc_word_init(
+  utf8proc_segment_iterator_t *iter, const utf8proc_uint8_t *str, utf8proc_ssize_t strlen
+) {
+  segment_init(iter, str, strlen);
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_word_next(utf8proc_segment_iterator_t *iter) {
+  return segment_next(iter, utf8proc_word_transitions[0],
+                      sizeof(utf8proc_word_transitions[0]), 0);
+}
+
+UTF8PROC_DLLEXPORT void utf8proc_sentence_init(
+  utf8proc_segment_iterator_t *iter, const utf8proc_uint8_t *str, utf8proc_ssize_t strlen
+) {
+  segment_init(iter, str, strlen);
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_sentence_next(utf8proc_segment_iterator_t *iter) {
+  return segment_next(iter, utf8proc_sentence_transitions[0],
+                      sizeof(utf8proc_sentence_transitions[0]), 5);
+}
+
+/* charwidth << 5 | boundclass of uc, see utf8proc_width_boundclass */
+static int unsafe_get_width_boundclass(utf8proc_int32_t uc) {
+  /* ASSERT: uc >= 0 && uc < 0x110000 */
+  return utf8proc_width_boundclass[unsafe_property_index(uc)];
+}
+
+/* the length of the longest prefix of whole grapheme clusters of str[0..len)
+   that is at most maxwidth columns wide, whose width is stored in *width.
+   The width of a cluster is the largest charwidth of its codepoints. */
+static utf8proc_ssize_t strwidth_prefix(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t len, utf8proc_ssize_t maxwidth, utf8proc_ssize_t *width
+) {
+  utf8proc_ssize_t pos = 0, start = 0, n, w;
+  utf8proc_ssize_t total = 0; /* width of the clusters before start */
+  int cur = 0; /* width of the cluster at start so far */
+  utf8proc_ssize_t valid = 0; /* str[0..valid) is known to be valid */
+  utf8proc_int32_t state = UTF8PROC_BOUNDCLASS_START;
+  while (pos < len && total + cur <= maxwidth) {
+    utf8proc_int32_t uc;
+    utf8proc_ssize_t seqlen;
+    int wb;
+    if (pos >= valid) {
+      /* validate ahead in blocks, which is cheaper than utf8proc_iterate
+         and reads not much beyond the prefix; errors are reported only
+         once they are reached */
+      valid = pos + validate_prefix(str + pos, len - pos < 4096 ? len - pos : 4096);
+      if (valid == pos) return UTF8PROC_ERROR_INVALIDUTF8;
+    }
+    seqlen = unsafe_decode_char(str + pos, &uc);
+    wb = unsafe_get_width_boundclass(uc);
+    if (grapheme_transition(&state, wb & 0x1F)) {
+      total += cur;
+      start = pos;
+      cur = wb >> 5;
+    } else if (wb >> 5 > cur)
+      cur = wb >> 5;
+    pos += seqlen;
+    if (uc >= 0x80 || pos >= len || str[pos] >= 0x80) continue;
+    n = ascii_span(str + pos, len - pos);
+    /* There is a break before every byte of an ASCII run following ASCII,
+       except for the LF of CR LF, and as both have width 0 it does no harm
+       to break there too.  The last byte starts a cluster that may extend
+       beyond the run, for which we update the state. */
+    if (total + cur > maxwidth) break;
+    total += cur;
+    w = ascii_width(str + pos, n - 1);
+    if (total + w > maxwidth) {
+      for (; total < maxwidth || str[pos] < 0x20 || str[pos] == 0x7F; pos++)
+        total += str[pos] >= 0x20 && str[pos] != 0x7F;
+      *width = total;
+      return pos;
+    }
+    total += w;
+    pos += n - 1;
+    start = pos;
+    wb = unsafe_get_width_boundclass(str[pos++]);
+    state = wb & 0x1F;
+    cur = wb >> 5;
+  }
+  if (total + cur <= maxwidth) {
+    total += cur;
+    start = len;
+  }
+  *width = total;
+  return start;
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_strwidth(const utf8proc_uint8_t *str, utf8proc_ssize_t strlen) {
+  utf8proc_ssize_t width, result;
+  result = strwidth_prefix(str, strlen < 0 ? nulterm_length(str) : strlen, SSIZE_MAX, &width);
+  return result < 0 ? result : width;
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_strwidth_prefix(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_ssize_t maxwidth, utf8proc_ssize_t *width
+) {
+  utf8proc_ssize_t w;
+  utf8proc_ssize_t result = strwidth_prefix(str, strlen < 0 ? nulterm_length(str) : strlen, maxwidth, &w);
+  if (result >= 0 && width) *width = w;
+  return result;
+}
+
 static utf8proc_int32_t seqindex_decode_entry(const utf8proc_uint16_t **entry)
 {
   utf8proc_int32_t entry_cp = **entry;
@@ -349,6 +1053,8 @@ static utf8proc_ssize_t seqindex_write_char_decomposed(utf8proc_uint16_t seqinde
   utf8proc_ssize_t written = 0;
   const utf8proc_uint16_t *entry = &utf8proc_sequences[seqindex & 0x1FFF];
   int len = seqindex >> 13;
+  UTF8PROC_STAT(expansions, 1);
+  UTF8PROC_STAT(recursive_expansions, 1);
   if (len >= 7) {
     len = *entry;
     entry++;
@@ -366,30 +1072,30 @@ static utf8proc_ssize_t seqindex_write_char_decomposed(utf8proc_uint16_t seqinde
 
 UTF8PROC_DLLEXPORT utf8proc_int32_t utf8proc_tolower(utf8proc_int32_t c)
 {
-  utf8proc_int32_t cl = utf8proc_get_property(c)->lowercase_seqindex;
+  utf8proc_int32_t cl = checked_get_property(c)->lowercase_seqindex;
   return cl != UINT16_MAX ? seqindex_decode_index(cl) : c;
 }
 
 UTF8PROC_DLLEXPORT utf8proc_int32_t utf8proc_toupper(utf8proc_int32_t c)
 {
-  utf8proc_int32_t cu = utf8proc_get_property(c)->uppercase_seqindex;
+  utf8proc_int32_t cu = checked_get_property(c)->uppercase_seqindex;
   return cu != UINT16_MAX ? seqindex_decode_index(cu) : c;
 }
 
 UTF8PROC_DLLEXPORT utf8proc_int32_t utf8proc_totitle(utf8proc_int32_t c)
 {
-  utf8proc_int32_t cu = utf8proc_get_property(c)->titlecase_seqindex;
+  utf8proc_int32_t cu = checked_get_property(c)->titlecase_seqindex;
   return cu != UINT16_MAX ? seqindex_decode_index(cu) : c;
 }
 
 /* return a character width analogous to wcwidth (except portable and
    hopefully less buggy than most system wcwidth functions). */
 UTF8PROC_DLLEXPORT int utf8proc_charwidth(utf8proc_int32_t c) {
-  return utf8proc_get_property(c)->charwidth;
+  return checked_get_property(c)->charwidth;
 }
 
 UTF8PROC_DLLEXPORT utf8proc_category_t utf8proc_category(utf8proc_int32_t c) {
-  return utf8proc_get_property(c)->category;
+  return checked_get_property(c)->category;
 }
 
 UTF8PROC_DLLEXPORT const char *utf8proc_category_string(utf8proc_int32_t c) {
@@ -397,21 +1103,211 @@ UTF8PROC_DLLEXPORT const char *utf8proc_category_string(utf8proc_int32_t c) {
   return s[utf8proc_category(c)];
 }
 
-#define utf8proc_decompose_lump(replacement_uc) \
-  return utf8proc_decompose_char((replacement_uc), dst, bufsize, \
-  options & ~UTF8PROC_LUMP, last_boundclass)
+UTF8PROC_DLLEXPORT void utf8proc_get_property_batch(const utf8proc_int32_t *in, utf8proc_size_t n, const utf8proc_property_t **out) {
+  utf8proc_size_t i;
+  for (i = 0; i < n; i++) out[i] = checked_get_property(in[i]);
+}
 
-UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_decompose_char(utf8proc_int32_t uc, utf8proc_int32_t *dst, utf8proc_ssize_t bufsize, utf8proc_option_t options, int *last_boundclass) {
-  const utf8proc_property_t *property;
+UTF8PROC_DLLEXPORT void utf8proc_category_batch(const utf8proc_int32_t *in, utf8proc_size_t n, utf8proc_propval_t *out) {
+  utf8proc_size_t i;
+  for (i = 0; i < n; i++) out[i] = checked_get_property(in[i])->category;
+}
+
+UTF8PROC_DLLEXPORT void utf8proc_charwidth_batch(const utf8proc_int32_t *in, utf8proc_size_t n, int *out) {
+  utf8proc_size_t i;
+  for (i = 0; i < n; i++) out[i] = checked_get_property(in[i])->charwidth;
+}
+
+UTF8PROC_DLLEXPORT void utf8proc_boundclass_batch(const utf8proc_int32_t *in, utf8proc_size_t n, utf8proc_propval_t *out) {
+  utf8proc_size_t i;
+  for (i = 0; i < n; i++) out[i] = (utf8proc_propval_t) checked_get_property(in[i])->boundclass;
+}
+
+UTF8PROC_DLLEXPORT void utf8proc_combining_class_batch(const utf8proc_int32_t *in, utf8proc_size_t n, utf8proc_propval_t *out) {
+  utf8proc_size_t i;
+  for (i = 0; i < n; i++) out[i] = checked_get_property(in[i])->combining_class;
+}
+
+/* case mapping of a whole array through the given seqindex field */
+#define case_batch(field) \
+  utf8proc_size_t i; \
+  for (i = 0; i < n; i++) { \
+    utf8proc_int32_t c = in[i]; \
+    utf8proc_uint16_t seqindex = checked_get_property(c)->field; \
+    out[i] = seqindex != UINT16_MAX ? seqindex_decode_index(seqindex) : c; \
+  }
+
+UTF8PROC_DLLEXPORT void utf8proc_tolower_batch(const utf8proc_int32_t *in, utf8proc_size_t n, utf8proc_int32_t *out) {
+  case_batch(lowercase_seqindex)
+}
+
+UTF8PROC_DLLEXPORT void utf8proc_toupper_batch(const utf8proc_int32_t *in, utf8proc_size_t n, utf8proc_int32_t *out) {
+  case_batch(uppercase_seqindex)
+}
+
+UTF8PROC_DLLEXPORT void utf8proc_totitle_batch(const utf8proc_int32_t *in, utf8proc_size_t n, utf8proc_int32_t *out) {
+  case_batch(titlecase_seqindex)
+}
+
+/* the string case mappings */
+typedef enum {
+  CASE_LOWER,
+  CASE_UPPER,
+  CASE_FOLD
+} case_mapping_t;
+
+/* map the case of the UTF-8 string str[0..strlen) into buffer, as described
+   for utf8proc_tolower_utf8.  Codepoints are mapped directly from their
+   properties and ASCII runs in bulk, without expanding to UTF-32. */
+static utf8proc_ssize_t case_map_utf8(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen,
+  utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize, case_mapping_t mapping
+) {
+  utf8proc_ssize_t rpos = 0, wpos = 0;
+  utf8proc_bool inplace = buffer == str;
+  if (strlen < 0) strlen = nulterm_length(str);
+  /* validate first, so that invalid input is never modified in place */
+  if (validate_prefix(str, strlen) != strlen) return UTF8PROC_ERROR_INVALIDUTF8;
+  while (rpos < strlen) {
+    utf8proc_ssize_t seqlen = ascii_span(str + rpos, strlen - rpos);
+    utf8proc_int32_t uc;
+    utf8proc_uint16_t seqindex;
+    if (seqlen) {
+      if (wpos + seqlen <= bufsize) {
+        if (mapping == CASE_UPPER) ascii_copy_upper(str + rpos, buffer + wpos, seqlen);
+        else ascii_copy(str + rpos, buffer + wpos, seqlen, 1);
+      }
+      rpos += seqlen;
+      wpos += seqlen;
+      continue;
+    }
+    seqlen = unsafe_decode_char(str + rpos, &uc);
+    seqindex = mapping == CASE_LOWER ? unsafe_get_property(uc)->lowercase_seqindex :
+      mapping == CASE_UPPER ? unsafe_get_property(uc)->uppercase_seqindex :
+      unsafe_get_property(uc)->casefold_seqindex;
+    if (seqindex == UINT16_MAX) {
+      if (wpos + seqlen <= bufsize && buffer + wpos != str + rpos)
+        memmove(buffer + wpos, str + rpos, (size_t)seqlen);
+      wpos += seqlen;
+    } else {
+      /* simple case mappings are a single codepoint, case foldings a
+         sequence with its length in the top bits of the index */
+      const utf8proc_uint16_t *entry = &utf8proc_sequences[mapping == CASE_FOLD ? seqindex & 0x1FFF : seqindex];
+      int len = mapping == CASE_FOLD ? seqindex >> 13 : 0;
+      if (len >= 7) {
+        len = *entry;
+        entry++;
+      }
+      for (; len >= 0; entry++, len--) {
+        utf8proc_uint8_t encoded[4];
+        utf8proc_ssize_t enclen = unsafe_encode_char(seqindex_decode_entry(&entry), encoded);
+        /* in place, the output must not overtake the unread input */
+        if (inplace && wpos + enclen > rpos + seqlen) return UTF8PROC_ERROR_OVERFLOW;
+        if (wpos + enclen <= bufsize) memcpy(buffer + wpos, encoded, (size_t)enclen);
+        wpos += enclen;
+      }
+    }
+    rpos += seqlen;
+  }
+  if (wpos < bufsize) buffer[wpos] = 0;
+  return wpos;
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_tolower_utf8(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize
+) {
+  return case_map_utf8(str, strlen, buffer, bufsize, CASE_LOWER);
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_toupper_utf8(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize
+) {
+  return case_map_utf8(str, strlen, buffer, bufsize, CASE_UPPER);
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_casefold_utf8(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize
+) {
+  return case_map_utf8(str, strlen, buffer, bufsize, CASE_FOLD);
+}
+
+#ifndef UTF8PROC_NO_HOT_PROPERTIES
+/* Write the full decomposition of the codepoint whose expansion_index is
+   `index` for the given options, which must include UTF8PROC_CASEFOLD,
+   UTF8PROC_COMPOSE or UTF8PROC_DECOMPOSE, with a single copy instead of a
+   utf8proc_decompose_char call per codepoint of the sequence.  Returns 0
+   if the codepoint maps to itself or if the options have to look at the
+   codepoints of the sequence one by one. */
+static utf8proc_ssize_t write_expansion(utf8proc_uint16_t index, utf8proc_int32_t *dst, utf8proc_ssize_t bufsize, utf8proc_option_t options) {
+  const utf8proc_uint32_t *sequence;
+  utf8proc_ssize_t length, i;
+  int variant = 0;
+  if (options & (UTF8PROC_LUMP|UTF8PROC_STRIPMARK|UTF8PROC_CHARBOUND)) return 0;
+  if (options & (UTF8PROC_COMPOSE|UTF8PROC_DECOMPOSE)) {
+    variant = 1 + ((options & UTF8PROC_COMPAT) ? 1 : 0) + ((options & UTF8PROC_CASEFOLD) ? 2 : 0);
+  }
+  if (utf8proc_expansions[index][variant] == UINT16_MAX) return 0;
+  sequence = &utf8proc_expanded_sequences[utf8proc_expansions[index][variant]];
+  /* bit 31 of the length marks sequences with default ignorable codepoints */
+  if ((sequence[0] & 0x80000000u) && (options & UTF8PROC_IGNORE)) return 0;
+  length = (utf8proc_ssize_t)(sequence[0] & 0x7FFFFFFFu);
+  for (i = 0; i < length && i < bufsize; i++) dst[i] = (utf8proc_int32_t)sequence[i + 1];
+  UTF8PROC_STAT(expansions, 1);
+  return length;
+}
+#endif
+
+/* the codepoints that UTF8PROC_LUMP maps individually (see lump.md),
+   sorted for a binary search */
+static const utf8proc_int32_t lump_table[][2] = {
+  {0x02BC, 0x0027}, {0x02C4, 0x005E}, {0x02C6, 0x005E}, {0x02C8, 0x0027},
+  {0x02CB, 0x0060}, {0x02CD, 0x005F}, {0x2018, 0x0027}, {0x2019, 0x0027},
+  {0x2038, 0x005E}, {0x2039, 0x003C}, {0x203A, 0x003E}, {0x2044, 0x002F},
+  {0x2212, 0x002D}, {0x2215, 0x002F}, {0x2216, 0x005C}, {0x2223, 0x007C},
+  {0x2236, 0x003A}, {0x223C, 0x007E}, {0x2303, 0x005E}, {0x2329, 0x003C},
+  {0x232A, 0x003E}, {0x3008, 0x003C}, {0x3009, 0x003E}
+};
+
+#define LUMP_TABLE_SIZE ((int)(sizeof(lump_table) / sizeof(lump_table[0])))
+
+/* the ASCII replacement of uc (of general category `category`) under
+   UTF8PROC_LUMP, or -1 if it has none */
+static utf8proc_int32_t lump_char(utf8proc_int32_t uc, utf8proc_propval_t category, utf8proc_option_t options) {
+  int lo = 0, hi = LUMP_TABLE_SIZE;
+  switch (category) {
+    case UTF8PROC_CATEGORY_ZS: return 0x0020;
+    case UTF8PROC_CATEGORY_PD: return 0x002D;
+    case UTF8PROC_CATEGORY_PC: return 0x005F;
+    case UTF8PROC_CATEGORY_ZL:
+    case UTF8PROC_CATEGORY_ZP:
+      if ((options & UTF8PROC_NLF2LS) && (options & UTF8PROC_NLF2PS)) return 0x000A;
+      return -1;
+    default: break;
+  }
+  if (uc < lump_table[0][0] || uc > lump_table[LUMP_TABLE_SIZE - 1][0]) return -1;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (lump_table[mid][0] < uc) lo = mid + 1;
+    else hi = mid;
+  }
+  return (lo < LUMP_TABLE_SIZE && lump_table[lo][0] == uc) ? lump_table[lo][1] : -1;
+}
+
+/* The body of utf8proc_decompose_char.  The kernels below inline it with
+   constant options, so that the compiler drops the tests of all the flags
+   that the common normalization forms do not use. */
+static UTF8PROC_ALWAYS_INLINE utf8proc_ssize_t decompose_char_kernel(utf8proc_int32_t uc, utf8proc_int32_t *dst, utf8proc_ssize_t bufsize, utf8proc_option_t options, int *last_boundclass) {
+  const utf8proc_hot_property_t *property;
   utf8proc_propval_t category;
   utf8proc_int32_t hangul_sindex;
   if (uc < 0 || uc >= 0x110000) return UTF8PROC_ERROR_NOTASSIGNED;
-  property = unsafe_get_property(uc);
+  property = unsafe_get_hot_property(uc);
   category = property->category;
   hangul_sindex = uc - UTF8PROC_HANGUL_SBASE;
   if (options & (UTF8PROC_COMPOSE|UTF8PROC_DECOMPOSE)) {
     if (hangul_sindex >= 0 && hangul_sindex < UTF8PROC_HANGUL_SCOUNT) {
       utf8proc_int32_t hangul_tindex;
+      UTF8PROC_STAT(hangul_decompositions, 1);
       if (bufsize >= 1) {
         dst[0] = UTF8PROC_HANGUL_LBASE +
           hangul_sindex / UTF8PROC_HANGUL_NCOUNT;
@@ -434,36 +1330,23 @@ UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_decompose_char(utf8proc_int32_t uc,
     if (!category) return 0;
   }
   if (options & UTF8PROC_LUMP) {
-    if (category == UTF8PROC_CATEGORY_ZS) utf8proc_decompose_lump(0x0020);
-    if (uc == 0x2018 || uc == 0x2019 || uc == 0x02BC || uc == 0x02C8)
-      utf8proc_decompose_lump(0x0027);
-    if (category == UTF8PROC_CATEGORY_PD || uc == 0x2212)
-      utf8proc_decompose_lump(0x002D);
-    if (uc == 0x2044 || uc == 0x2215) utf8proc_decompose_lump(0x002F);
-    if (uc == 0x2236) utf8proc_decompose_lump(0x003A);
-    if (uc == 0x2039 || uc == 0x2329 || uc == 0x3008)
-      utf8proc_decompose_lump(0x003C);
-    if (uc == 0x203A || uc == 0x232A || uc == 0x3009)
-      utf8proc_decompose_lump(0x003E);
-    if (uc == 0x2216) utf8proc_decompose_lump(0x005C);
-    if (uc == 0x02C4 || uc == 0x02C6 || uc == 0x2038 || uc == 0x2303)
-      utf8proc_decompose_lump(0x005E);
-    if (category == UTF8PROC_CATEGORY_PC || uc == 0x02CD)
-      utf8proc_decompose_lump(0x005F);
-    if (uc == 0x02CB) utf8proc_decompose_lump(0x0060);
-    if (uc == 0x2223) utf8proc_decompose_lump(0x007C);
-    if (uc == 0x223C) utf8proc_decompose_lump(0x007E);
-    if ((options & UTF8PROC_NLF2LS) && (options & UTF8PROC_NLF2PS)) {
-      if (category == UTF8PROC_CATEGORY_ZL ||
-          category == UTF8PROC_CATEGORY_ZP)
-        utf8proc_decompose_lump(0x000A);
-    }
+    utf8proc_int32_t replacement_uc = lump_char(uc, category, options);
+    if (replacement_uc >= 0)
+      return utf8proc_decompose_char(replacement_uc, dst, bufsize,
+                                     options & ~UTF8PROC_LUMP, last_boundclass);
   }
   if (options & UTF8PROC_STRIPMARK) {
     if (category == UTF8PROC_CATEGORY_MN ||
       category == UTF8PROC_CATEGORY_MC ||
       category == UTF8PROC_CATEGORY_ME) return 0;
   }
+#ifndef UTF8PROC_NO_HOT_PROPERTIES
+  if (property->expansion_index != UINT16_MAX &&
+      (options & (UTF8PROC_CASEFOLD|UTF8PROC_COMPOSE|UTF8PROC_DECOMPOSE))) {
+    utf8proc_ssize_t written = write_expansion(property->expansion_index, dst, bufsize, options);
+    if (written) return written;
+  }
+#endif
   if (options & UTF8PROC_CASEFOLD) {
     if (property->casefold_seqindex != UINT16_MAX) {
       return seqindex_write_char_decomposed(property->casefold_seqindex, dst, bufsize, options, last_boundclass);
@@ -478,7 +1361,7 @@ UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_decompose_char(utf8proc_int32_t uc,
   if (options & UTF8PROC_CHARBOUND) {
     utf8proc_bool boundary;
     int tbc = property->boundclass;
-    boundary = grapheme_break_extended(*last_boundclass, tbc, last_boundclass);
+    boundary = grapheme_transition(last_boundclass, tbc);
     if (boundary) {
       if (bufsize >= 1) dst[0] = 0xFFFF;
       if (bufsize >= 2) dst[1] = uc;
@@ -489,81 +1372,321 @@ UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_decompose_char(utf8proc_int32_t uc,
   return 1;
 }
 
-UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_decompose(
-  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen,
-  utf8proc_int32_t *buffer, utf8proc_ssize_t bufsize, utf8proc_option_t options
-) {
-    return utf8proc_decompose_custom(str, strlen, buffer, bufsize, options, NULL, NULL);
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_decompose_char(utf8proc_int32_t uc, utf8proc_int32_t *dst, utf8proc_ssize_t bufsize, utf8proc_option_t options, int *last_boundclass) {
+  return decompose_char_kernel(uc, dst, bufsize, options, last_boundclass);
 }
 
-UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_decompose_custom(
-  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen,
-  utf8proc_int32_t *buffer, utf8proc_ssize_t bufsize, utf8proc_option_t options,
-  utf8proc_custom_func custom_func, void *custom_data
-) {
-  /* strlen will be ignored, if UTF8PROC_NULLTERM is set in options */
-  utf8proc_ssize_t wpos = 0;
-  if ((options & UTF8PROC_COMPOSE) && (options & UTF8PROC_DECOMPOSE))
-    return UTF8PROC_ERROR_INVALIDOPTS;
-  if ((options & UTF8PROC_STRIPMARK) &&
-      !(options & UTF8PROC_COMPOSE) && !(options & UTF8PROC_DECOMPOSE))
-    return UTF8PROC_ERROR_INVALIDOPTS;
-  {
-    utf8proc_int32_t uc;
-    utf8proc_ssize_t rpos = 0;
-    utf8proc_ssize_t decomp_result;
-    int boundclass = UTF8PROC_BOUNDCLASS_START;
-    while (1) {
-      if (options & UTF8PROC_NULLTERM) {
-        rpos += utf8proc_iterate(str + rpos, -1, &uc);
-        /* checking of return value is not necessary,
-           as 'uc' is < 0 in case of error */
-        if (uc < 0) return UTF8PROC_ERROR_INVALIDUTF8;
-        if (rpos < 0) return UTF8PROC_ERROR_OVERFLOW;
-        if (uc == 0) break;
-      } else {
-        if (rpos >= strlen) break;
-        rpos += utf8proc_iterate(str + rpos, strlen - rpos, &uc);
-        if (uc < 0) return UTF8PROC_ERROR_INVALIDUTF8;
-      }
-      if (custom_func != NULL) {
-        uc = custom_func(uc, custom_data);   /* user-specified custom mapping */
-      }
-      decomp_result = utf8proc_decompose_char(
-        uc, buffer + wpos, (bufsize > wpos) ? (bufsize - wpos) : 0, options,
-        &boundclass
-      );
-      if (decomp_result < 0) return decomp_result;
-      wpos += decomp_result;
-      /* prohibiting integer overflows due to too long strings: */
-      if (wpos < 0 ||
-          wpos > (utf8proc_ssize_t)(SSIZE_MAX/sizeof(utf8proc_int32_t)/2))
-        return UTF8PROC_ERROR_OVERFLOW;
-    }
-  }
-  if ((options & (UTF8PROC_COMPOSE|UTF8PROC_DECOMPOSE)) && bufsize >= wpos) {
-    utf8proc_ssize_t pos = 0;
-    while (pos < wpos-1) {
-      utf8proc_int32_t uc1, uc2;
-      const utf8proc_property_t *property1, *property2;
-      uc1 = buffer[pos];
-      uc2 = buffer[pos+1];
-      property1 = unsafe_get_property(uc1);
-      property2 = unsafe_get_property(uc2);
-      if (property1->combining_class > property2->combining_class &&
-          property2->combining_class > 0) {
-        buffer[pos] = uc2;
-        buffer[pos+1] = uc1;
-        if (pos > 0) pos--; else pos++;
-      } else {
-        pos++;
-      }
-    }
-  }
-  return wpos;
+typedef utf8proc_ssize_t (*decompose_char_func)(utf8proc_int32_t uc, utf8proc_int32_t *dst, utf8proc_ssize_t bufsize, utf8proc_option_t options, int *last_boundclass);
+
+/* NFC and NFD (decompose_char_kernel treats COMPOSE and DECOMPOSE alike) */
+static utf8proc_ssize_t decompose_canonical(utf8proc_int32_t uc, utf8proc_int32_t *dst, utf8proc_ssize_t bufsize, utf8proc_option_t options, int *last_boundclass) {
+  (void) options;
+  return decompose_char_kernel(uc, dst, bufsize, UTF8PROC_DECOMPOSE, last_boundclass);
 }
 
-UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_normalize_utf32(utf8proc_int32_t *buffer, utf8proc_ssize_t length, utf8proc_option_t options) {
+/* NFKC and NFKD */
+static utf8proc_ssize_t decompose_compat(utf8proc_int32_t uc, utf8proc_int32_t *dst, utf8proc_ssize_t bufsize, utf8proc_option_t options, int *last_boundclass) {
+  (void) options;
+  return decompose_char_kernel(uc, dst, bufsize, UTF8PROC_DECOMPOSE | UTF8PROC_COMPAT, last_boundclass);
+}
+
+/* NFKC_Casefold */
+static utf8proc_ssize_t decompose_compat_casefold(utf8proc_int32_t uc, utf8proc_int32_t *dst, utf8proc_ssize_t bufsize, utf8proc_option_t options, int *last_boundclass) {
+  (void) options;
+  return decompose_char_kernel(uc, dst, bufsize,
+    UTF8PROC_DECOMPOSE | UTF8PROC_COMPAT | UTF8PROC_CASEFOLD | UTF8PROC_IGNORE, last_boundclass);
+}
+
+/* the options that decompose_char_kernel looks at */
+#define DECOMPOSE_CHAR_OPTIONS (UTF8PROC_COMPOSE | UTF8PROC_DECOMPOSE | \
+  UTF8PROC_REJECTNA | UTF8PROC_IGNORE | UTF8PROC_STRIPNA | UTF8PROC_LUMP | \
+  UTF8PROC_STRIPMARK | UTF8PROC_CASEFOLD | UTF8PROC_COMPAT | UTF8PROC_CHARBOUND)
+
+/* the equivalent of utf8proc_decompose_char for the given options, chosen
+   once per string rather than testing the options for every codepoint */
+static decompose_char_func select_decompose_char(utf8proc_option_t options) {
+  switch (options & DECOMPOSE_CHAR_OPTIONS) {
+    case UTF8PROC_COMPOSE:
+    case UTF8PROC_DECOMPOSE:
+      return decompose_canonical;
+    case UTF8PROC_COMPOSE | UTF8PROC_COMPAT:
+    case UTF8PROC_DECOMPOSE | UTF8PROC_COMPAT:
+      return decompose_compat;
+    case UTF8PROC_COMPOSE | UTF8PROC_COMPAT | UTF8PROC_CASEFOLD | UTF8PROC_IGNORE:
+    case UTF8PROC_DECOMPOSE | UTF8PROC_COMPAT | UTF8PROC_CASEFOLD | UTF8PROC_IGNORE:
+      return decompose_compat_casefold;
+    default:
+      return utf8proc_decompose_char;
+  }
+}
+
+/* An upper bound for the number of codepoints that utf8proc_decompose_char
+   produces for a single codepoint (U+FDFA yields 36 with UTF8PROC_COMPAT
+   and UTF8PROC_CHARBOUND). */
+#define UTF8PROC_MAP_MAX_EXPANSION 64
+
+/* UAX #15 Stream-Safe Text Format: the longest run of non-starters that
+   UTF8PROC_STREAMSAFE leaves without a COMBINING GRAPHEME JOINER */
+#define UTF8PROC_MAX_NONSTARTERS 30
+
+/* Apply UTF8PROC_STREAMSAFE to the `length` codepoints decomposed from
+   one codepoint into `dst` (which must have room for one more), given the
+   number of non-starters `*nonstarters` in front of them.  Returns the new
+   length, including U+034F if one had to be inserted. */
+static utf8proc_ssize_t stream_safe(utf8proc_int32_t *dst, utf8proc_ssize_t length, utf8proc_ssize_t *nonstarters) {
+  utf8proc_ssize_t leading = 0, trailing = 0;
+  while (leading < length && unsafe_get_hot_property(dst[leading])->combining_class) leading++;
+  if (leading < length) {
+    while (unsafe_get_hot_property(dst[length - 1 - trailing])->combining_class) trailing++;
+  }
+  if (leading && *nonstarters + leading > UTF8PROC_MAX_NONSTARTERS) {
+    memmove(dst + 1, dst, (size_t)length * sizeof(utf8proc_int32_t));
+    dst[0] = 0x034F;
+    *nonstarters = 0;
+    length++;
+    if (leading == length - 1) trailing = leading;
+  } else if (leading == length) {
+    /* only non-starters, which continue the run */
+    trailing = *nonstarters + leading;
+  }
+  *nonstarters = trailing;
+  return length;
+}
+
+/* Canonical ordering works on packed marks, (combining class << 21) |
+   codepoint, so that each combining class is looked up once. */
+#define CANONICAL_KEY(packed) ((packed) >> 21)
+
+/* reverse buffer[0..length) */
+static void reverse_marks(utf8proc_int32_t *buffer, utf8proc_ssize_t length) {
+  utf8proc_ssize_t i, j;
+  for (i = 0, j = length - 1; i < j; i++, j--) {
+    utf8proc_int32_t tmp = buffer[i];
+    buffer[i] = buffer[j];
+    buffer[j] = tmp;
+  }
+}
+
+/* stably merge the sorted packed marks buffer[0..length1) and
+   buffer[length1..length1+length2) in place, by rotations (which keeps
+   the sort free of allocations at O(n log^2 n) for a run of n marks) */
+static void merge_marks(utf8proc_int32_t *buffer, utf8proc_ssize_t length1, utf8proc_ssize_t length2) {
+  while (length1 > 0 && length2 > 0) {
+    utf8proc_ssize_t cut1, cut2, lo, hi;
+    if (length1 + length2 == 2) {
+      if (CANONICAL_KEY(buffer[1]) < CANONICAL_KEY(buffer[0])) reverse_marks(buffer, 2);
+      return;
+    }
+    if (length1 > length2) {
+      /* split the left half, and the right one in front of the first
+         greater or equal mark */
+      cut1 = length1 / 2;
+      lo = length1; hi = length1 + length2;
+      while (lo < hi) {
+        utf8proc_ssize_t mid = lo + (hi - lo) / 2;
+        if (CANONICAL_KEY(buffer[mid]) < CANONICAL_KEY(buffer[cut1])) lo = mid + 1; else hi = mid;
+      }
+      cut2 = lo;
+    } else {
+      /* split the right half, and the left one behind the last smaller or
+         equal mark */
+      cut2 = length1 + length2 / 2;
+      lo = 0; hi = length1;
+      while (lo < hi) {
+        utf8proc_ssize_t mid = lo + (hi - lo) / 2;
+        if (CANONICAL_KEY(buffer[cut2]) < CANONICAL_KEY(buffer[mid])) hi = mid; else lo = mid + 1;
+      }
+      cut1 = lo;
+    }
+    /* rotate buffer[cut1..cut2) so that the right part comes first */
+    reverse_marks(buffer + cut1, length1 - cut1);
+    reverse_marks(buffer + length1, cut2 - length1);
+    reverse_marks(buffer + cut1, cut2 - cut1);
+    lo = cut1 + (cut2 - length1); /* where the two merged halves meet now */
+    merge_marks(buffer, cut1, lo - cut1);
+    /* continue with the second half without recursing */
+    buffer += lo;
+    length2 = length1 + length2 - cut2;
+    length1 = cut2 - lo;
+  }
+}
+
+/* stably sort the packed marks buffer[0..length) by combining class */
+static void sort_marks(utf8proc_int32_t *buffer, utf8proc_ssize_t length) {
+  if (length <= 16) {
+    utf8proc_ssize_t i, j;
+    for (i = 1; i < length; i++) {
+      utf8proc_int32_t mark = buffer[i];
+      for (j = i; j > 0 && CANONICAL_KEY(buffer[j - 1]) > CANONICAL_KEY(mark); j--)
+        buffer[j] = buffer[j - 1];
+      buffer[j] = mark;
+    }
+  } else {
+    utf8proc_ssize_t half = length / 2;
+    sort_marks(buffer, half);
+    sort_marks(buffer + half, length - half);
+    if (CANONICAL_KEY(buffer[half - 1]) > CANONICAL_KEY(buffer[half]))
+      merge_marks(buffer, half, length - half);
+  }
+}
+
+/* sort the combining marks of the decomposed sequence in `buffer` into
+   canonical order (starters never move): each run of marks between two
+   starters is sorted on its own.  As this reads the properties of every
+   codepoint anyway, it also stores the bitwise OR of all codepoints in
+   `*bits` and returns whether any of them can compose with a preceding
+   codepoint, i.e. whether a composition pass could change anything. */
+static utf8proc_bool canonical_order(utf8proc_int32_t *buffer, utf8proc_ssize_t length, utf8proc_int32_t *bits) {
+  utf8proc_ssize_t pos = 0;
+  utf8proc_int32_t all = 0;
+  utf8proc_bool composable = false;
+  while (pos < length) {
+    utf8proc_ssize_t start;
+    const utf8proc_hot_property_t *property = unsafe_get_hot_property(buffer[pos]);
+    utf8proc_propval_t ccc = property->combining_class;
+    utf8proc_bool sorted = true;
+    all |= buffer[pos];
+    if (property->comb_index >= 0x8000 && property->comb_index != UINT16_MAX)
+      composable = true;
+    if (!ccc) {
+      /* Hangul vowels and trailing consonants are composed arithmetically */
+      if ((utf8proc_uint32_t)(buffer[pos] - UTF8PROC_HANGUL_VBASE) < UTF8PROC_HANGUL_VCOUNT ||
+          (utf8proc_uint32_t)(buffer[pos] - UTF8PROC_HANGUL_TBASE - 1) < UTF8PROC_HANGUL_TCOUNT - 1)
+        composable = true;
+      pos++;
+      continue;
+    }
+    /* the run of marks starting at `pos`, packed with their classes */
+    start = pos;
+    buffer[pos] |= (utf8proc_int32_t)ccc << 21;
+    while (++pos < length) {
+      property = unsafe_get_hot_property(buffer[pos]);
+      if (!property->combining_class) break;
+      all |= buffer[pos];
+      if (property->comb_index >= 0x8000 && property->comb_index != UINT16_MAX)
+        composable = true;
+      if (property->combining_class < ccc) sorted = false;
+      ccc = property->combining_class;
+      buffer[pos] |= (utf8proc_int32_t)ccc << 21;
+    }
+    if (!sorted) {
+      UTF8PROC_STAT(reordered_runs, 1);
+      UTF8PROC_STAT(reordered_marks, pos - start);
+      sort_marks(buffer + start, pos - start);
+    }
+    for (; start < pos; start++) buffer[start] &= 0x1FFFFF;
+  }
+  *bits = all;
+  return composable;
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_decompose(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen,
+  utf8proc_int32_t *buffer, utf8proc_ssize_t bufsize, utf8proc_option_t options
+) {
+    return utf8proc_decompose_custom(str, strlen, buffer, bufsize, options, NULL, NULL);
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_decompose_custom(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen,
+  utf8proc_int32_t *buffer, utf8proc_ssize_t bufsize, utf8proc_option_t options,
+  utf8proc_custom_func custom_func, void *custom_data
+) {
+  /* strlen will be ignored, if UTF8PROC_NULLTERM is set in options */
+  utf8proc_ssize_t wpos = 0;
+  if ((options & UTF8PROC_COMPOSE) && (options & UTF8PROC_DECOMPOSE))
+    return UTF8PROC_ERROR_INVALIDOPTS;
+  if (options & UTF8PROC_DATA_UNSUPPORTED)
+    return UTF8PROC_ERROR_INVALIDOPTS;
+  if ((options & UTF8PROC_STRIPMARK) &&
+      !(options & UTF8PROC_COMPOSE) && !(options & UTF8PROC_DECOMPOSE))
+    return UTF8PROC_ERROR_INVALIDOPTS;
+  if (options & UTF8PROC_NULLTERM) strlen = nulterm_length(str);
+  {
+    utf8proc_int32_t uc;
+    utf8proc_ssize_t rpos = 0;
+    utf8proc_ssize_t decomp_result;
+    int boundclass = UTF8PROC_BOUNDCLASS_START;
+    utf8proc_ssize_t nonstarters = 0;
+    utf8proc_bool bulk_ascii = custom_func == NULL && !(options & UTF8PROC_CHARBOUND);
+    decompose_char_func decompose_char = select_decompose_char(options);
+    /* validate up front, so that the loop can decode without checks */
+    utf8proc_ssize_t valid = (options & UTF8PROC_PREVALIDATED) ? strlen : validate_prefix(str, strlen);
+    while (rpos < strlen) {
+      if (bulk_ascii && str[rpos] < 0x80) {
+        decomp_result = ascii_span(str + rpos, strlen - rpos);
+        if (wpos < bufsize)
+          ascii_widen(str + rpos, buffer + wpos,
+                      decomp_result < bufsize - wpos ? decomp_result : bufsize - wpos,
+                      (options & UTF8PROC_CASEFOLD) != 0);
+        rpos += decomp_result;
+        nonstarters = 0;
+        UTF8PROC_STAT(ascii_bytes, decomp_result);
+        UTF8PROC_STAT(codepoints_in, decomp_result);
+      } else {
+        utf8proc_int32_t tmp[UTF8PROC_MAP_MAX_EXPANSION + 1];
+        utf8proc_int32_t *dst = buffer + wpos;
+        if (rpos >= valid) {
+          UTF8PROC_STAT(invalid_utf8, 1);
+          return UTF8PROC_ERROR_INVALIDUTF8;
+        }
+        rpos += unsafe_decode_char(str + rpos, &uc);
+        UTF8PROC_STAT(codepoints_in, 1);
+        if (custom_func != NULL) {
+          uc = custom_func(uc, custom_data);   /* user-specified custom mapping */
+        }
+        /* stream_safe needs the whole decomposition, and room for a CGJ in
+           front of it: near the end of `buffer`, decompose into `tmp` */
+        if ((options & UTF8PROC_STREAMSAFE) && bufsize - wpos <= UTF8PROC_MAP_MAX_EXPANSION) dst = tmp;
+        decomp_result = decompose_char(
+          uc, dst, (dst == tmp) ? UTF8PROC_MAP_MAX_EXPANSION : (bufsize > wpos) ? (bufsize - wpos) : 0,
+          options, &boundclass
+        );
+        if (decomp_result < 0) return decomp_result;
+        if (options & UTF8PROC_STREAMSAFE) {
+          decomp_result = stream_safe(dst, decomp_result, &nonstarters);
+          if (dst == tmp && wpos < bufsize) {
+            utf8proc_ssize_t n = decomp_result < bufsize - wpos ? decomp_result : bufsize - wpos;
+            memcpy(buffer + wpos, tmp, (size_t)n * sizeof(utf8proc_int32_t));
+          }
+        }
+      }
+      wpos += decomp_result;
+      /* prohibiting integer overflows due to too long strings: */
+      if (wpos < 0 ||
+          wpos > (utf8proc_ssize_t)(SSIZE_MAX/sizeof(utf8proc_int32_t)/2))
+        return UTF8PROC_ERROR_OVERFLOW;
+    }
+  }
+  if ((options & (UTF8PROC_COMPOSE|UTF8PROC_DECOMPOSE)) && bufsize >= wpos) {
+    utf8proc_int32_t bits;
+    canonical_order(buffer, wpos, &bits);
+  }
+  UTF8PROC_STAT(bytes_in, strlen);
+  UTF8PROC_STAT(codepoints_out, wpos);
+  return wpos;
+}
+
+/* slot of `key` in the perfect hash of compositions, see data_generator.rb */
+static utf8proc_size_t composition_hash(utf8proc_uint32_t key, utf8proc_uint32_t salt) {
+  utf8proc_uint32_t y = (key + salt) * 2654435769u;
+  y ^= key * 0x31415926u;
+  return (utf8proc_size_t)(((utf8proc_uint64_t)y * UTF8PROC_COMPOSITION_COUNT) >> 32);
+}
+
+/* the primary composite of `starter` and `mark`, or 0 if there is none (or,
+   if `stable` is set, if it is excluded from composition) */
+static utf8proc_int32_t unsafe_compose_pair(utf8proc_int32_t starter, utf8proc_int32_t mark, utf8proc_bool stable) {
+  utf8proc_uint32_t key = ((utf8proc_uint32_t)starter << 16) ^ (utf8proc_uint32_t)mark;
+  const utf8proc_uint32_t *entry =
+    utf8proc_compositions[composition_hash(key, utf8proc_composition_salts[composition_hash(key, 0)])];
+  if (entry[0] != (utf8proc_uint32_t)starter || entry[1] != (utf8proc_uint32_t)mark) return 0;
+  if (entry[2] & 0x80000000u) return stable ? 0 : (utf8proc_int32_t)(entry[2] & 0x7FFFFFFF);
+  return (utf8proc_int32_t)entry[2];
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_normalize_utf32(utf8proc_int32_t *buffer, utf8proc_ssize_t length, utf8proc_option_t options) {
   /* UTF8PROC_NULLTERM option will be ignored, 'length' is never ignored */
   if (options & (UTF8PROC_NLF2LS | UTF8PROC_NLF2PS | UTF8PROC_STRIPCC)) {
     utf8proc_ssize_t rpos;
@@ -599,14 +1722,14 @@ UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_normalize_utf32(utf8proc_int32_t *b
   if (options & UTF8PROC_COMPOSE) {
     utf8proc_int32_t *starter = NULL;
     utf8proc_int32_t current_char;
-    const utf8proc_property_t *starter_property = NULL, *current_property;
+    const utf8proc_hot_property_t *starter_property = NULL, *current_property;
     utf8proc_propval_t max_combining_class = -1;
     utf8proc_ssize_t rpos;
     utf8proc_ssize_t wpos = 0;
     utf8proc_int32_t composition;
     for (rpos = 0; rpos < length; rpos++) {
       current_char = buffer[rpos];
-      current_property = unsafe_get_property(current_char);
+      current_property = unsafe_get_hot_property(current_char);
       if (starter && current_property->combining_class > max_combining_class) {
         /* combination perhaps possible */
         utf8proc_int32_t hangul_lindex;
@@ -620,6 +1743,7 @@ UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_normalize_utf32(utf8proc_int32_t *b
               (hangul_lindex * UTF8PROC_HANGUL_VCOUNT + hangul_vindex) *
               UTF8PROC_HANGUL_TCOUNT;
             starter_property = NULL;
+            UTF8PROC_STAT(hangul_compositions, 1);
             continue;
           }
         }
@@ -628,34 +1752,27 @@ UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_normalize_utf32(utf8proc_int32_t *b
             (hangul_sindex % UTF8PROC_HANGUL_TCOUNT) == 0) {
           utf8proc_int32_t hangul_tindex;
           hangul_tindex = current_char - UTF8PROC_HANGUL_TBASE;
-          if (hangul_tindex >= 0 && hangul_tindex < UTF8PROC_HANGUL_TCOUNT) {
+          if (hangul_tindex > 0 && hangul_tindex < UTF8PROC_HANGUL_TCOUNT) {
             *starter += hangul_tindex;
             starter_property = NULL;
+            UTF8PROC_STAT(hangul_compositions, 1);
             continue;
           }
         }
         if (!starter_property) {
-          starter_property = unsafe_get_property(*starter);
+          starter_property = unsafe_get_hot_property(*starter);
         }
         if (starter_property->comb_index < 0x8000 &&
             current_property->comb_index != UINT16_MAX &&
             current_property->comb_index >= 0x8000) {
-          int sidx = starter_property->comb_index;
-          int idx = current_property->comb_index & 0x3FFF;
-          if (idx >= utf8proc_combinations[sidx] && idx <= utf8proc_combinations[sidx + 1] ) {
-            idx += sidx + 2 - utf8proc_combinations[sidx];
-            if (current_property->comb_index & 0x4000) {
-              composition = (utf8proc_combinations[idx] << 16) | utf8proc_combinations[idx+1];
-            } else
-              composition = utf8proc_combinations[idx];
-
-            if (composition > 0 && (!(options & UTF8PROC_STABLE) ||
-                !(unsafe_get_property(composition)->comp_exclusion))) {
-              *starter = composition;
-              starter_property = NULL;
-              continue;
-            }
+          composition = unsafe_compose_pair(*starter, current_char, (options & UTF8PROC_STABLE) != 0);
+          if (composition) {
+            *starter = composition;
+            starter_property = NULL;
+            UTF8PROC_STAT(composition_hits, 1);
+            continue;
           }
+          UTF8PROC_STAT(composition_misses, 1);
         }
       }
       buffer[wpos] = current_char;
@@ -675,28 +1792,160 @@ UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_normalize_utf32(utf8proc_int32_t *b
   return length;
 }
 
+/* encode the `length` codepoints of `src` as UTF-8 into `dst`, which may
+   alias `src` as no UTF-8 sequence is longer than its codepoint.  `bits`
+   is the bitwise OR of all codepoints (or -1 if unknown), which selects a
+   loop without the general encoder for ASCII and for text below U+0800
+   (ASCII and Latin-1, Greek, Cyrillic, Hebrew, Arabic, ...). */
+static utf8proc_ssize_t encode_utf32(const utf8proc_int32_t *src, utf8proc_ssize_t length,
+                                     utf8proc_uint8_t *dst, utf8proc_int32_t bits, utf8proc_option_t options) {
+  utf8proc_ssize_t rpos = 0, wpos = 0;
+  if ((utf8proc_uint32_t)bits < 0x80) {
+    return ascii_narrow(src, length, dst);
+  } else if ((utf8proc_uint32_t)bits < 0x800) {
+    while (rpos < length) {
+      utf8proc_int32_t uc = src[rpos];
+      if (uc < 0x80) {
+        utf8proc_ssize_t n = ascii_narrow(src + rpos, length - rpos, dst + wpos);
+        rpos += n;
+        wpos += n;
+      } else {
+        dst[wpos++] = (utf8proc_uint8_t)(0xC0 + (uc >> 6));
+        dst[wpos++] = (utf8proc_uint8_t)(0x80 + (uc & 0x3F));
+        rpos++;
+      }
+    }
+  } else {
+    utf8proc_ssize_t (*encode)(utf8proc_int32_t, utf8proc_uint8_t *) =
+      (options & UTF8PROC_CHARBOUND) ? unsafe_encode_char : utf8proc_encode_char;
+    while (rpos < length) {
+      utf8proc_int32_t uc = src[rpos];
+      if (uc >= 0 && uc < 0x80) {
+        utf8proc_ssize_t n = ascii_narrow(src + rpos, length - rpos, dst + wpos);
+        rpos += n;
+        wpos += n;
+      } else {
+        wpos += encode(uc, dst + wpos);
+        rpos++;
+      }
+    }
+  }
+  return wpos;
+}
+
 UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_reencode(utf8proc_int32_t *buffer, utf8proc_ssize_t length, utf8proc_option_t options) {
   /* UTF8PROC_NULLTERM option will be ignored, 'length' is never ignored
      ASSERT: 'buffer' has one spare byte of free space at the end! */
+  utf8proc_ssize_t pos;
+  utf8proc_int32_t bits = 0;
   length = utf8proc_normalize_utf32(buffer, length, options);
   if (length < 0) return length;
-  {
-    utf8proc_ssize_t rpos, wpos = 0;
-    utf8proc_int32_t uc;
-    if (options & UTF8PROC_CHARBOUND) {
-        for (rpos = 0; rpos < length; rpos++) {
-            uc = buffer[rpos];
-            wpos += unsafe_encode_char(uc, ((utf8proc_uint8_t *)buffer) + wpos);
-        }
+  for (pos = 0; pos < length; pos++) bits |= buffer[pos];
+  length = encode_utf32(buffer, length, (utf8proc_uint8_t *)buffer, bits, options);
+  ((utf8proc_uint8_t *)buffer)[length] = 0;
+  return length;
+}
+
+/* the Quick_Check value of `property` for the normalization form of `options` */
+static int unsafe_quick_check_value(const utf8proc_hot_property_t *property, utf8proc_option_t options) {
+  if (options & UTF8PROC_COMPOSE)
+    return (options & UTF8PROC_COMPAT) ? property->nfkc_qc : property->nfc_qc;
+  else
+    return (options & UTF8PROC_COMPAT) ? property->nfkd_qc : property->nfd_qc;
+}
+
+/* whether `options` select a plain normalization form (NFC, NFD, NFKC or
+   NFKD without any further transformation) that Quick_Check applies to */
+static utf8proc_bool quick_check_applies(utf8proc_option_t options) {
+  if (options & UTF8PROC_DATA_UNSUPPORTED) return false;
+  if (options & ~(UTF8PROC_NULLTERM | UTF8PROC_STABLE | UTF8PROC_COMPAT |
+                  UTF8PROC_COMPOSE | UTF8PROC_DECOMPOSE | UTF8PROC_PREVALIDATED)) return false;
+  if (options & UTF8PROC_COMPOSE) /* the data assumes stable compositions */
+    return !(options & UTF8PROC_DECOMPOSE) && (options & UTF8PROC_STABLE);
+  return (options & UTF8PROC_DECOMPOSE) != 0;
+}
+
+/* UAX #15 quick check of `str`.  Returns a utf8proc_quick_check_t value, or
+   UTF8PROC_ERROR_INVALIDUTF8.  `*stable` is set to the length of the prefix
+   that is known to be normalized and to end in front of a starter that
+   normalizes independently of that prefix (the whole string for YES).  If
+   `stop_at_maybe` is set, the scan ends at the first MAYBE. */
+static utf8proc_ssize_t quick_check_prefix(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_option_t options,
+  utf8proc_bool stop_at_maybe, utf8proc_ssize_t *stable
+) {
+  utf8proc_ssize_t rpos = 0, seqlen;
+  utf8proc_ssize_t result = UTF8PROC_QC_YES;
+  utf8proc_propval_t last_combining_class = 0;
+  utf8proc_int32_t uc;
+  *stable = 0;
+  if (options & UTF8PROC_NULLTERM) strlen = nulterm_length(str);
+  while (rpos < strlen) {
+    const utf8proc_hot_property_t *property;
+    int qc;
+    if (str[rpos] < 0x80) {
+      /* ASCII starters are YES in every normalization form */
+      seqlen = ascii_span(str + rpos, strlen - rpos);
+      if (result == UTF8PROC_QC_YES) *stable = rpos + seqlen - 1;
+      last_combining_class = 0;
+      rpos += seqlen;
+      continue;
+    }
+    if (options & UTF8PROC_PREVALIDATED) {
+      seqlen = unsafe_decode_char(str + rpos, &uc);
     } else {
-        for (rpos = 0; rpos < length; rpos++) {
-            uc = buffer[rpos];
-            wpos += utf8proc_encode_char(uc, ((utf8proc_uint8_t *)buffer) + wpos);
-        }
+      seqlen = utf8proc_iterate(str + rpos, strlen - rpos, &uc);
+      if (uc < 0) return UTF8PROC_ERROR_INVALIDUTF8;
+    }
+    property = unsafe_get_hot_property(uc);
+    qc = unsafe_quick_check_value(property, options);
+    if (property->combining_class) {
+      if (last_combining_class > property->combining_class) return UTF8PROC_QC_NO;
+    } else if (qc == UTF8PROC_QC_YES && result == UTF8PROC_QC_YES) {
+      *stable = rpos;
     }
-    ((utf8proc_uint8_t *)buffer)[wpos] = 0;
-    return wpos;
+    if (qc == UTF8PROC_QC_NO) return UTF8PROC_QC_NO;
+    if (qc == UTF8PROC_QC_MAYBE) {
+      result = UTF8PROC_QC_MAYBE;
+      if (stop_at_maybe) return result;
+    }
+    last_combining_class = property->combining_class;
+    rpos += seqlen;
   }
+  if (result == UTF8PROC_QC_YES) *stable = rpos;
+  return result;
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_quick_check(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_option_t options
+) {
+  utf8proc_ssize_t stable;
+  if (!quick_check_applies(options | UTF8PROC_STABLE))
+    return UTF8PROC_ERROR_INVALIDOPTS;
+  return quick_check_prefix(str, strlen, options, false, &stable);
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_isnormalized(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_option_t options
+) {
+  utf8proc_ssize_t stable = 0, result, length;
+  utf8proc_uint8_t *mapped;
+  if (options & UTF8PROC_NULLTERM) {
+    strlen = nulterm_length(str);
+    options &= ~UTF8PROC_NULLTERM;
+  }
+  if (quick_check_applies(options)) {
+    result = quick_check_prefix(str, strlen, options, true, &stable);
+    if (result == UTF8PROC_QC_YES) return true;
+    if (result == UTF8PROC_QC_NO) return false;
+  }
+  /* resolve by normalizing everything after the known-normalized prefix */
+  length = strlen - stable;
+  result = utf8proc_map(str + stable, length, &mapped, options);
+  if (result < 0) return result;
+  length = (result == length && !memcmp(mapped, str + stable, (size_t)result));
+  free(mapped);
+  return length;
 }
 
 UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_map(
@@ -705,36 +1954,1288 @@ UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_map(
     return utf8proc_map_custom(str, strlen, dstptr, options, NULL, NULL);
 }
 
+/* Number of decomposed codepoints collected before utf8proc_map_custom
+   tries to flush its window through utf8proc_normalize_utf32.  The window
+   only grows beyond this for long runs of codepoints that may interact
+   with their predecessors (e.g. combining marks). */
+#define UTF8PROC_MAP_WINDOW 256
+
+/* return whether the decomposed codepoint `uc` can neither be reordered,
+   composed, nor otherwise merged (CR LF, or an adjacent mark exposed by
+   UTF8PROC_STRIPCC) with the codepoints preceding it, so that the
+   normalization of a decomposed string may be split in front of it */
+static utf8proc_bool unsafe_is_window_boundary(utf8proc_int32_t uc) {
+  const utf8proc_hot_property_t *property;
+  if (uc < 0x00A0 && (uc < 0x0020 || uc >= 0x007F)) return false;
+  if (uc >= UTF8PROC_HANGUL_VBASE &&
+      uc < UTF8PROC_HANGUL_VBASE + UTF8PROC_HANGUL_VCOUNT) return false;
+  if (uc > UTF8PROC_HANGUL_TBASE &&
+      uc < UTF8PROC_HANGUL_TBASE + UTF8PROC_HANGUL_TCOUNT) return false;
+  property = unsafe_get_hot_property(uc);
+  return !property->combining_class &&
+    (property->comb_index == UINT16_MAX || property->comb_index < 0x8000);
+}
+
+static void *default_alloc(size_t size, void *data) {
+  (void) data;
+  return malloc(size);
+}
+
+static void *default_realloc(void *ptr, size_t size, void *data) {
+  (void) data;
+  return realloc(ptr, size);
+}
+
+static void default_free(void *ptr, void *data) {
+  (void) data;
+  free(ptr);
+}
+
+static const utf8proc_allocator_t default_allocator = {
+  default_alloc, default_realloc, default_free, NULL
+};
+
+/* destination of utf8proc_map_custom & friends: either a buffer grown with
+   `allocator`, or (if `allocator` is NULL) a fixed caller-owned buffer of
+   `size` bytes, in which case bytes beyond `size` are only counted.  For
+   utf8proc_map_borrow, `data` stays NULL for as long as the output equals
+   the first `length` of the `borrowlen` bytes of `borrow`.  For
+   utf8proc_map_inplace, `data` is the input itself and `unread` the first
+   byte of it that map_feed has not decoded yet: output goes to `data`
+   for as long as it stays in front of `unread`, and otherwise piles up
+   in the side buffer `spill` (allocated with `allocator`) until it fits
+   in front of `unread` again. */
+typedef struct {
+  utf8proc_uint8_t *data;
+  utf8proc_ssize_t length, size;
+  const utf8proc_allocator_t *allocator;
+  const utf8proc_uint8_t *borrow;
+  utf8proc_ssize_t borrowlen;
+  const utf8proc_uint8_t *unread;
+  utf8proc_uint8_t *spill;
+  utf8proc_ssize_t spilllen, spillsize;
+} map_sink;
+
+/* move the side buffer of an in-place `sink` back in front of `unread`,
+   if it fits there */
+static void map_inplace_drain(map_sink *sink) {
+  if (sink->spilllen && sink->data + sink->length + sink->spilllen <= sink->unread) {
+    memcpy(sink->data + sink->length, sink->spill, (size_t)sink->spilllen);
+    sink->length += sink->spilllen;
+    sink->spilllen = 0;
+  }
+}
+
+/* room for the next `n` output bytes of an in-place `sink`, which may
+   extend `ahead` bytes beyond `unread` (for bytes that are copied forward
+   from there), or NULL if the side buffer cannot grow */
+static utf8proc_uint8_t *map_inplace_room(map_sink *sink, utf8proc_ssize_t n, utf8proc_ssize_t ahead) {
+  utf8proc_uint8_t *dst;
+  map_inplace_drain(sink);
+  if (!sink->spilllen && sink->data + sink->length + n - ahead <= sink->unread) {
+    dst = sink->data + sink->length;
+    sink->length += n;
+    return dst;
+  }
+  if (n > sink->spillsize - sink->spilllen) {
+    utf8proc_ssize_t newsize = sink->spillsize ? sink->spillsize : 256;
+    utf8proc_uint8_t *newptr;
+    while (n > newsize - sink->spilllen) {
+      if (newsize > (utf8proc_ssize_t)(SSIZE_MAX/2)) return NULL;
+      newsize *= 2;
+    }
+    newptr = (utf8proc_uint8_t *) sink->allocator->realloc_func(
+      sink->spill, (size_t)newsize, sink->allocator->data);
+    if (!newptr) return NULL;
+    sink->spill = newptr;
+    sink->spillsize = newsize;
+  }
+  dst = sink->spill + sink->spilllen;
+  sink->spilllen += n;
+  return dst;
+}
+
+/* the length of the UTF-8 encoding of src[0..length) */
+static utf8proc_ssize_t encoded_length(const utf8proc_int32_t *src, utf8proc_ssize_t length, utf8proc_option_t options) {
+  utf8proc_ssize_t pos, n = 0;
+  for (pos = 0; pos < length; pos++) {
+    utf8proc_int32_t uc = src[pos];
+    if (uc < 0) continue;
+    n += uc < 0x80 ? 1 : uc < 0x800 ? 2 :
+      ((options & UTF8PROC_CHARBOUND) && (uc == 0xFFFF || uc == 0xFFFE)) ? 1 :
+      uc < 0x10000 ? 3 : uc < 0x110000 ? 4 : 0;
+  }
+  return n;
+}
+
+/* stop borrowing: copy the output so far into a buffer of `sink` with
+   room for at least `needed` bytes and a NULL terminator */
+static utf8proc_ssize_t map_unborrow(map_sink *sink, utf8proc_ssize_t needed) {
+  utf8proc_ssize_t size = sink->borrowlen + 1;
+  if (size < needed + 1) size = needed + 1;
+  if (size < 16) size = 16;
+  sink->data = (utf8proc_uint8_t *) sink->allocator->alloc_func((size_t)size, sink->allocator->data);
+  if (!sink->data) return UTF8PROC_ERROR_NOMEM;
+  memcpy(sink->data, sink->borrow, (size_t)sink->length);
+  sink->size = size;
+  sink->borrow = NULL;
+  return 0;
+}
+
+/* normalize the `length` decomposed codepoints in `window` and append
+   them as UTF-8 to `sink` */
+static utf8proc_ssize_t map_flush_window(
+  utf8proc_int32_t *window, utf8proc_ssize_t length, utf8proc_option_t options,
+  map_sink *sink
+) {
+  utf8proc_ssize_t rpos, start = 0, wpos = sink->length;
+  utf8proc_int32_t bits = -1;
+  utf8proc_ssize_t (*encode)(utf8proc_int32_t, utf8proc_uint8_t *) =
+    (options & UTF8PROC_CHARBOUND) ? unsafe_encode_char : utf8proc_encode_char;
+  if (options & (UTF8PROC_COMPOSE|UTF8PROC_DECOMPOSE)) {
+    if (!canonical_order(window, length, &bits) && (options & UTF8PROC_COMPOSE)) {
+      /* nothing in the window composes, e.g. ASCII or precomposed Latin-1 */
+      options &= ~UTF8PROC_COMPOSE;
+      UTF8PROC_STAT(compositions_skipped, 1);
+    }
+  }
+  length = utf8proc_normalize_utf32(window, length, options);
+  if (length < 0) return length;
+  /* newline mapping and composition can create larger codepoints */
+  if (options & (UTF8PROC_NLF2LS|UTF8PROC_NLF2PS|UTF8PROC_STRIPCC|UTF8PROC_COMPOSE))
+    bits = -1;
+  if (sink->unread) {
+    utf8proc_ssize_t n = encoded_length(window, length, options);
+    utf8proc_uint8_t *dst = map_inplace_room(sink, n, 0);
+    if (!dst) return UTF8PROC_ERROR_NOMEM;
+    encode_utf32(window, length, dst, bits, options);
+    UTF8PROC_STAT(bytes_out, n);
+    return sink->length + sink->spilllen;
+  }
+  if (sink->borrow) {
+    /* only compare, for as long as the output equals the input */
+    utf8proc_uint8_t tmp[4];
+    for (rpos = 0; rpos < length; rpos++) {
+      utf8proc_ssize_t n = encode(window[rpos], tmp);
+      if (n > sink->borrowlen - wpos || memcmp(tmp, sink->borrow + wpos, (size_t)n)) break;
+      wpos += n;
+    }
+    UTF8PROC_STAT(bytes_out, wpos - sink->length);
+    sink->length = wpos;
+    if (rpos == length) return wpos;
+    start = map_unborrow(sink, wpos + 4 * (length - rpos));
+    if (start < 0) return start;
+    start = rpos;
+  }
+  if (length - start > (sink->size - wpos - 1) / 4 && sink->allocator) {
+    utf8proc_ssize_t newsize = sink->size;
+    utf8proc_uint8_t *newptr;
+    while (length - start > (newsize - wpos - 1) / 4) {
+      if (newsize > (utf8proc_ssize_t)(SSIZE_MAX/2)) return UTF8PROC_ERROR_OVERFLOW;
+      newsize *= 2;
+    }
+    newptr = (utf8proc_uint8_t *) sink->allocator->realloc_func(
+      sink->data, (size_t)newsize, sink->allocator->data);
+    if (!newptr) return UTF8PROC_ERROR_NOMEM;
+    sink->data = newptr;
+    sink->size = newsize;
+  }
+  if (length - start <= (sink->size - wpos - 1) / 4) {
+    wpos += encode_utf32(window + start, length - start, sink->data + wpos, bits, options);
+  } else {
+    /* fixed buffer too small: write what fits, count the rest */
+    utf8proc_uint8_t tmp[4];
+    for (rpos = start; rpos < length; rpos++) {
+      utf8proc_ssize_t n = encode(window[rpos], tmp);
+      if (wpos + n <= sink->size) memcpy(sink->data + wpos, tmp, (size_t)n);
+      wpos += n;
+    }
+  }
+  if (wpos < 0) return UTF8PROC_ERROR_OVERFLOW;
+  UTF8PROC_STAT(bytes_out, wpos - sink->length);
+  sink->length = wpos;
+  return wpos;
+}
+
+/* append `length` bytes of `str` to `sink`; if `lower` is set, `str` is
+   ASCII and A-Z are appended as a-z */
+static utf8proc_ssize_t map_append(map_sink *sink, const utf8proc_uint8_t *str, utf8proc_ssize_t length, utf8proc_bool lower) {
+  utf8proc_ssize_t wpos = sink->length;
+  if (sink->unread) {
+    /* `str` is the unread input, which is copied forward */
+    utf8proc_uint8_t *dst = map_inplace_room(sink, length, length);
+    if (!dst) return UTF8PROC_ERROR_NOMEM;
+    if (lower) ascii_copy(str, dst, length, true);
+    else if (dst != str) memmove(dst, str, (size_t)length);
+    UTF8PROC_STAT(bytes_out, length);
+    return sink->length + sink->spilllen;
+  }
+  if (sink->borrow) {
+    utf8proc_ssize_t i = 0;
+    if (str == sink->borrow + wpos && !lower) {
+      i = length;
+    } else {
+      while (i < length && wpos + i < sink->borrowlen &&
+             sink->borrow[wpos + i] == (lower ? ascii_tolower(str[i]) : str[i])) i++;
+    }
+    if (i == length) {
+      UTF8PROC_STAT(bytes_out, length);
+      sink->length = wpos + length;
+      return sink->length;
+    }
+    i = map_unborrow(sink, wpos + length);
+    if (i < 0) return i;
+  }
+  if (length > sink->size - wpos - 1 && sink->allocator) {
+    utf8proc_ssize_t newsize = sink->size;
+    utf8proc_uint8_t *newptr;
+    while (length > newsize - wpos - 1) {
+      if (newsize > (utf8proc_ssize_t)(SSIZE_MAX/2)) return UTF8PROC_ERROR_OVERFLOW;
+      newsize *= 2;
+    }
+    newptr = (utf8proc_uint8_t *) sink->allocator->realloc_func(
+      sink->data, (size_t)newsize, sink->allocator->data);
+    if (!newptr) return UTF8PROC_ERROR_NOMEM;
+    sink->data = newptr;
+    sink->size = newsize;
+  }
+  if (wpos < sink->size)
+    ascii_copy(str, sink->data + wpos, length < sink->size - wpos ? length : sink->size - wpos, lower);
+  UTF8PROC_STAT(bytes_out, length);
+  sink->length = wpos + length;
+  return sink->length;
+}
+
+static utf8proc_ssize_t check_map_options(utf8proc_option_t options) {
+  if ((options & UTF8PROC_COMPOSE) && (options & UTF8PROC_DECOMPOSE))
+    return UTF8PROC_ERROR_INVALIDOPTS;
+  if (options & UTF8PROC_DATA_UNSUPPORTED)
+    return UTF8PROC_ERROR_INVALIDOPTS;
+  if ((options & UTF8PROC_STRIPMARK) &&
+      !(options & UTF8PROC_COMPOSE) && !(options & UTF8PROC_DECOMPOSE))
+    return UTF8PROC_ERROR_INVALIDOPTS;
+  return 0;
+}
+
+/* State of the single pass behind all of the utf8proc_map variants and
+   utf8proc_stream_t: codepoints are decomposed into a small window, which
+   is normalized and re-encoded as soon as it ends in front of a codepoint
+   that cannot interact with its predecessors (see
+   unsafe_is_window_boundary).  This gives the same result as
+   utf8proc_decompose_custom followed by utf8proc_reencode, without
+   decomposing twice or holding the whole string as UTF-32.  The window
+   is part of the state, and only a long run of combining marks makes it
+   grow through `allocator`. */
+typedef struct {
+  utf8proc_option_t options;
+  utf8proc_custom_func custom_func;
+  void *custom_data;
+  const utf8proc_allocator_t *allocator;
+  utf8proc_int32_t *window;
+  utf8proc_ssize_t wlen, wsize;
+  utf8proc_ssize_t total; /* decomposed codepoints, to detect overflows */
+  int boundclass;
+  utf8proc_ssize_t nonstarters; /* for UTF8PROC_STREAMSAFE */
+  /* ASCII followed by ASCII is final unless CR LF or exposed marks matter */
+  utf8proc_bool bulk_ascii;
+  decompose_char_func decompose_char; /* see select_decompose_char */
+  utf8proc_int32_t fixed_window[2*UTF8PROC_MAP_WINDOW];
+} map_state;
+
+static void map_state_init(
+  map_state *state, utf8proc_option_t options,
+  utf8proc_custom_func custom_func, void *custom_data,
+  const utf8proc_allocator_t *allocator
+) {
+  state->options = options;
+  state->custom_func = custom_func;
+  state->custom_data = custom_data;
+  state->allocator = allocator;
+  state->window = state->fixed_window;
+  state->wlen = 0;
+  state->wsize = 2*UTF8PROC_MAP_WINDOW;
+  state->total = 0;
+  state->boundclass = UTF8PROC_BOUNDCLASS_START;
+  state->nonstarters = 0;
+  state->bulk_ascii = custom_func == NULL &&
+    !(options & (UTF8PROC_CHARBOUND | UTF8PROC_NLF2LS | UTF8PROC_NLF2PS | UTF8PROC_STRIPCC));
+  state->decompose_char = select_decompose_char(options);
+}
+
+static void map_state_free(map_state *state) {
+  if (state->window != state->fixed_window)
+    state->allocator->free_func(state->window, state->allocator->data);
+}
+
+/* decompose the (complete) UTF-8 sequences of str[0..strlen) into the
+   window of `state`, flushing it to `sink` whenever it is safe to do so */
+static utf8proc_ssize_t map_feed(
+  map_state *state, const utf8proc_uint8_t *str, utf8proc_ssize_t strlen,
+  map_sink *sink
+) {
+  utf8proc_option_t options = state->options;
+  utf8proc_ssize_t rpos = 0, result = 0;
+  utf8proc_ssize_t valid = (options & UTF8PROC_PREVALIDATED) ? strlen : validate_prefix(str, strlen);
+  utf8proc_ssize_t streamsafe = (options & UTF8PROC_STREAMSAFE) != 0;
+  utf8proc_int32_t uc;
+  while (rpos < strlen) {
+    utf8proc_ssize_t mark = state->wlen;
+    int last_boundclass = state->boundclass;
+    if (state->bulk_ascii && str[rpos] < 0x80) {
+      /* everything but the last byte of an ASCII run (which might still
+         compose with what follows) goes straight to the sink */
+      utf8proc_ssize_t n = ascii_span(str + rpos, strlen - rpos) - 1;
+      if (n >= 16) {
+        if (sink->unread) sink->unread = str + rpos;
+        result = map_flush_window(state->window, state->wlen, options, sink);
+        if (result < 0) return result;
+        state->wlen = 0;
+        result = map_append(sink, str + rpos, n, (options & UTF8PROC_CASEFOLD) != 0);
+        if (result < 0) return result;
+        rpos += n;
+        state->nonstarters = 0;
+        UTF8PROC_STAT(ascii_bytes, n);
+        UTF8PROC_STAT(codepoints_in, n);
+        UTF8PROC_STAT(codepoints_out, n);
+        continue;
+      }
+    }
+    if (rpos >= valid) {
+      UTF8PROC_STAT(invalid_utf8, 1);
+      return UTF8PROC_ERROR_INVALIDUTF8;
+    }
+    rpos += unsafe_decode_char(str + rpos, &uc);
+    UTF8PROC_STAT(codepoints_in, 1);
+    if (state->custom_func != NULL) {
+      uc = state->custom_func(uc, state->custom_data);   /* user-specified custom mapping */
+    }
+    result = state->decompose_char(uc, state->window + mark, state->wsize - mark,
+                                   options, &state->boundclass);
+    if (result < 0) return result;
+    if (result + streamsafe > state->wsize - mark) {
+      /* grow the window and decompose again, with the same grapheme state */
+      const utf8proc_allocator_t *allocator = state->allocator;
+      utf8proc_ssize_t newsize = state->wsize;
+      utf8proc_int32_t *newptr;
+      while (result + streamsafe > newsize - mark) newsize *= 2;
+      if (state->window == state->fixed_window) {
+        newptr = (utf8proc_int32_t *) allocator->alloc_func(
+          (size_t)newsize * sizeof(utf8proc_int32_t), allocator->data);
+        if (newptr) memcpy(newptr, state->window, (size_t)mark * sizeof(utf8proc_int32_t));
+      } else {
+        newptr = (utf8proc_int32_t *) allocator->realloc_func(
+          state->window, (size_t)newsize * sizeof(utf8proc_int32_t), allocator->data);
+      }
+      if (!newptr) return UTF8PROC_ERROR_NOMEM;
+      state->window = newptr;
+      state->wsize = newsize;
+      state->boundclass = last_boundclass;
+      result = state->decompose_char(uc, state->window + mark, state->wsize - mark,
+                                     options, &state->boundclass);
+    }
+    if (streamsafe) result = stream_safe(state->window + mark, result, &state->nonstarters);
+    UTF8PROC_STAT(codepoints_out, result);
+    state->wlen += result;
+    state->total += result;
+    /* prohibiting integer overflows due to too long strings: */
+    if (state->total < 0 ||
+        state->total > (utf8proc_ssize_t)(SSIZE_MAX/sizeof(utf8proc_int32_t)/2))
+      return UTF8PROC_ERROR_OVERFLOW;
+    if (mark >= UTF8PROC_MAP_WINDOW && mark < state->wlen &&
+        unsafe_is_window_boundary(state->window[mark])) {
+      if (sink->unread) sink->unread = str + rpos;
+      result = map_flush_window(state->window, mark, options, sink);
+      if (result < 0) return result;
+      memmove(state->window, state->window + mark,
+              (size_t)(state->wlen - mark) * sizeof(utf8proc_int32_t));
+      state->wlen -= mark;
+    }
+  }
+  if (sink->unread) sink->unread = str + strlen;
+  UTF8PROC_STAT(bytes_in, strlen);
+  return result;
+}
+
+/* flush the window of `state` to `sink`: all of it at the end of the
+   input, and otherwise everything in front of its last boundary */
+static utf8proc_ssize_t map_settle(map_state *state, map_sink *sink, utf8proc_bool final) {
+  utf8proc_ssize_t mark = state->wlen, result;
+  if (!final) {
+    while (mark > 0 && !unsafe_is_window_boundary(state->window[mark - 1])) mark--;
+    if (--mark <= 0) return sink->length;
+  }
+  result = map_flush_window(state->window, mark, state->options, sink);
+  if (result < 0) return result;
+  memmove(state->window, state->window + mark,
+          (size_t)(state->wlen - mark) * sizeof(utf8proc_int32_t));
+  state->wlen -= mark;
+  return result;
+}
+
+/* Scratch buffers of the _ctx variants of the utf8proc_map functions:
+   the output of utf8proc_map_custom_ctx, the codepoints of
+   utf8proc_decompose_custom_ctx, and a window of map_state that had to
+   grow beyond its fixed_window (for long runs of combining marks), which
+   map_window reuses instead of growing a new one every time. */
+struct utf8proc_context_struct {
+  utf8proc_uint8_t *output;
+  utf8proc_ssize_t outsize;
+  utf8proc_int32_t *buffer;
+  utf8proc_ssize_t bufsize;
+  utf8proc_int32_t *window;
+  utf8proc_ssize_t wsize;
+  utf8proc_allocator_t allocator;
+};
+
+/* map `str` into `sink`; if `context` is not NULL, `allocator` must be its
+   allocator, and the window of the map_state is kept in `context` */
+static utf8proc_ssize_t map_window(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_option_t options,
+  utf8proc_custom_func custom_func, void *custom_data,
+  map_sink *sink, const utf8proc_allocator_t *allocator, utf8proc_context_t *context
+) {
+  map_state state;
+  utf8proc_ssize_t rpos = 0, result;
+  result = check_map_options(options);
+  if (result < 0) return result;
+  if (options & UTF8PROC_NULLTERM) strlen = nulterm_length(str);
+  if (custom_func == NULL && quick_check_applies(options)) {
+    /* copy the prefix that is already normalized */
+    quick_check_prefix(str, strlen, options, true, &rpos);
+    result = map_append(sink, str, rpos, false);
+    if (result < 0) return result;
+    UTF8PROC_STAT(bytes_in, rpos);
+    UTF8PROC_STAT(quick_check_bytes, rpos);
+  }
+  map_state_init(&state, options, custom_func, custom_data, allocator);
+  if (context && context->window) {
+    state.window = context->window;
+    state.wsize = context->wsize;
+  }
+  result = map_feed(&state, str + rpos, strlen - rpos, sink);
+  if (result >= 0) result = map_settle(&state, sink, true);
+  if (result >= 0 && sink->length < sink->size) sink->data[sink->length] = 0;
+  if (context && state.window != state.fixed_window) {
+    context->window = state.window;
+    context->wsize = state.wsize;
+  } else {
+    map_state_free(&state);
+  }
+  return result;
+}
+
 UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_map_custom(
   const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_uint8_t **dstptr, utf8proc_option_t options,
   utf8proc_custom_func custom_func, void *custom_data
 ) {
-  utf8proc_int32_t *buffer;
+  return utf8proc_map_allocator(str, strlen, dstptr, options, custom_func, custom_data, NULL);
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_map_allocator(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_uint8_t **dstptr, utf8proc_option_t options,
+  utf8proc_custom_func custom_func, void *custom_data, const utf8proc_allocator_t *allocator
+) {
+  map_sink sink;
   utf8proc_ssize_t result;
   *dstptr = NULL;
-  result = utf8proc_decompose_custom(str, strlen, NULL, 0, options, custom_func, custom_data);
-  if (result < 0) return result;
-  buffer = (utf8proc_int32_t *) malloc(result * sizeof(utf8proc_int32_t) + 1);
-  if (!buffer) return UTF8PROC_ERROR_NOMEM;
-  result = utf8proc_decompose_custom(str, strlen, buffer, result, options, custom_func, custom_data);
+  if (!allocator) allocator = &default_allocator;
+  sink.length = 0;
+  sink.size = (!(options & UTF8PROC_NULLTERM) && strlen > 0 &&
+               strlen < (utf8proc_ssize_t)(SSIZE_MAX/2)) ? strlen + 1 : 64;
+  if (sink.size < 16) sink.size = 16;
+  sink.allocator = allocator;
+  sink.borrow = NULL;
+  sink.unread = NULL;
+  sink.data = (utf8proc_uint8_t *) allocator->alloc_func((size_t)sink.size, allocator->data);
+  if (!sink.data) return UTF8PROC_ERROR_NOMEM;
+  result = map_window(str, strlen, options, custom_func, custom_data, &sink, allocator, NULL);
   if (result < 0) {
-    free(buffer);
+    allocator->free_func(sink.data, allocator->data);
     return result;
   }
-  result = utf8proc_reencode(buffer, result, options);
+  {
+    utf8proc_uint8_t *newptr;
+    newptr = (utf8proc_uint8_t *) allocator->realloc_func(
+      sink.data, (size_t)sink.length+1, allocator->data);
+    if (newptr) sink.data = newptr;
+  }
+  *dstptr = sink.data;
+  return sink.length;
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_map_borrow(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_uint8_t **dstptr, utf8proc_option_t options,
+  utf8proc_custom_func custom_func, void *custom_data, const utf8proc_allocator_t *allocator
+) {
+  map_sink sink;
+  utf8proc_ssize_t result;
+  *dstptr = NULL;
+  if (!allocator) allocator = &default_allocator;
+  if (options & UTF8PROC_NULLTERM) {
+    strlen = nulterm_length(str);
+    options &= ~UTF8PROC_NULLTERM;
+  }
+  sink.data = NULL;
+  sink.length = 0;
+  sink.size = 0;
+  sink.allocator = allocator;
+  sink.borrow = str;
+  sink.unread = NULL;
+  sink.borrowlen = strlen;
+  result = map_window(str, strlen, options, custom_func, custom_data, &sink, allocator, NULL);
+  /* the output may also be a proper prefix of the input */
+  if (result >= 0 && sink.borrow && sink.length < strlen)
+    result = map_unborrow(&sink, sink.length);
   if (result < 0) {
-    free(buffer);
+    if (sink.data) allocator->free_func(sink.data, allocator->data);
     return result;
   }
-  {
-    utf8proc_int32_t *newptr;
-    newptr = (utf8proc_int32_t *) realloc(buffer, (size_t)result+1);
-    if (newptr) buffer = newptr;
+  if (sink.data) {
+    sink.data[sink.length] = 0;
+    *dstptr = sink.data;
+  }
+  return sink.length;
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_map_buffer(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen,
+  utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize, utf8proc_option_t options
+) {
+  return utf8proc_map_buffer_custom(str, strlen, buffer, bufsize, options, NULL, NULL);
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_map_buffer_custom(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen,
+  utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize, utf8proc_option_t options,
+  utf8proc_custom_func custom_func, void *custom_data
+) {
+  map_sink sink;
+  utf8proc_ssize_t result;
+  sink.data = buffer;
+  sink.length = 0;
+  sink.size = (buffer && bufsize > 0) ? bufsize : 0;
+  sink.allocator = NULL;
+  sink.borrow = NULL;
+  sink.unread = NULL;
+  result = map_window(str, strlen, options, custom_func, custom_data, &sink, &default_allocator, NULL);
+  return result < 0 ? result : sink.length;
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_context_new(
+  utf8proc_context_t **contextptr, const utf8proc_allocator_t *allocator
+) {
+  utf8proc_context_t *context;
+  *contextptr = NULL;
+  if (!allocator) allocator = &default_allocator;
+  context = (utf8proc_context_t *) allocator->alloc_func(sizeof(utf8proc_context_t), allocator->data);
+  if (!context) return UTF8PROC_ERROR_NOMEM;
+  context->output = NULL;
+  context->outsize = 0;
+  context->buffer = NULL;
+  context->bufsize = 0;
+  context->window = NULL;
+  context->wsize = 0;
+  context->allocator = *allocator;
+  *contextptr = context;
+  return 0;
+}
+
+UTF8PROC_DLLEXPORT void utf8proc_context_trim(utf8proc_context_t *context) {
+  const utf8proc_allocator_t *allocator = &context->allocator;
+  if (context->output) allocator->free_func(context->output, allocator->data);
+  if (context->buffer) allocator->free_func(context->buffer, allocator->data);
+  if (context->window) allocator->free_func(context->window, allocator->data);
+  context->output = NULL;
+  context->outsize = 0;
+  context->buffer = NULL;
+  context->bufsize = 0;
+  context->window = NULL;
+  context->wsize = 0;
+}
+
+UTF8PROC_DLLEXPORT void utf8proc_context_free(utf8proc_context_t *context) {
+  utf8proc_allocator_t allocator;
+  if (!context) return;
+  allocator = context->allocator;
+  utf8proc_context_trim(context);
+  allocator.free_func(context, allocator.data);
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_map_custom_ctx(
+  utf8proc_context_t *context, const utf8proc_uint8_t *str, utf8proc_ssize_t strlen,
+  const utf8proc_uint8_t **dstptr, utf8proc_option_t options,
+  utf8proc_custom_func custom_func, void *custom_data
+) {
+  const utf8proc_allocator_t *allocator = &context->allocator;
+  map_sink sink;
+  utf8proc_ssize_t result, size;
+  *dstptr = NULL;
+  /* start with room for the input, like utf8proc_map_allocator */
+  size = (!(options & UTF8PROC_NULLTERM) && strlen > 0 &&
+          strlen < (utf8proc_ssize_t)(SSIZE_MAX/4)) ? strlen + 1 : 64;
+  if (context->outsize < size) {
+    utf8proc_uint8_t *newptr;
+    if (size < 2 * context->outsize) size = 2 * context->outsize;
+    /* the old contents are not needed */
+    if (context->output) allocator->free_func(context->output, allocator->data);
+    context->outsize = 0;
+    newptr = (utf8proc_uint8_t *) allocator->alloc_func((size_t)size, allocator->data);
+    context->output = newptr;
+    if (!newptr) return UTF8PROC_ERROR_NOMEM;
+    context->outsize = size;
+  }
+  sink.data = context->output;
+  sink.length = 0;
+  sink.size = context->outsize;
+  sink.allocator = allocator;
+  sink.borrow = NULL;
+  sink.unread = NULL;
+  result = map_window(str, strlen, options, custom_func, custom_data, &sink, allocator, context);
+  /* the output buffer may have grown, even if there was an error */
+  context->output = sink.data;
+  context->outsize = sink.size;
+  if (result < 0) return result;
+  *dstptr = sink.data;
+  return sink.length;
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_decompose_custom_ctx(
+  utf8proc_context_t *context, const utf8proc_uint8_t *str, utf8proc_ssize_t strlen,
+  const utf8proc_int32_t **dstptr, utf8proc_option_t options,
+  utf8proc_custom_func custom_func, void *custom_data
+) {
+  const utf8proc_allocator_t *allocator = &context->allocator;
+  utf8proc_ssize_t result;
+  *dstptr = NULL;
+  result = utf8proc_decompose_custom(str, strlen, context->buffer, context->bufsize,
+                                     options, custom_func, custom_data);
+  if (result < 0) return result;
+  if (result > context->bufsize || !context->buffer) {
+    /* grow the buffer and decompose again */
+    utf8proc_ssize_t size = 2 * context->bufsize;
+    if (size < result) size = result;
+    if (size < 16) size = 16;
+    if (context->buffer) allocator->free_func(context->buffer, allocator->data);
+    context->bufsize = 0;
+    context->buffer = (utf8proc_int32_t *) allocator->alloc_func(
+      (size_t)size * sizeof(utf8proc_int32_t), allocator->data);
+    if (!context->buffer) return UTF8PROC_ERROR_NOMEM;
+    context->bufsize = size;
+    result = utf8proc_decompose_custom(str, strlen, context->buffer, context->bufsize,
+                                       options, custom_func, custom_data);
+    if (result < 0) return result;
+  }
+  *dstptr = context->buffer;
+  return result;
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_map_inplace(
+  utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_ssize_t bufsize, utf8proc_option_t options
+) {
+  map_state state;
+  map_sink sink;
+  utf8proc_ssize_t rpos = 0, result;
+  result = check_map_options(options);
+  if (result < 0) return result;
+  if (options & UTF8PROC_NULLTERM) {
+    strlen = nulterm_length(str);
+    options &= ~UTF8PROC_NULLTERM;
+  }
+  if (bufsize < strlen) bufsize = strlen;
+  if (!(options & UTF8PROC_PREVALIDATED)) {
+    /* validate first, so that invalid input is never modified */
+    if (validate_prefix(str, strlen) != strlen) {
+      UTF8PROC_STAT(invalid_utf8, 1);
+      return UTF8PROC_ERROR_INVALIDUTF8;
+    }
+    options |= UTF8PROC_PREVALIDATED;
+  }
+  if (quick_check_applies(options)) {
+    /* the prefix that is already normalized stays where it is */
+    quick_check_prefix(str, strlen, options, true, &rpos);
+    UTF8PROC_STAT(bytes_in, rpos);
+    UTF8PROC_STAT(bytes_out, rpos);
+    UTF8PROC_STAT(quick_check_bytes, rpos);
+  }
+  sink.data = str;
+  sink.length = rpos;
+  sink.size = bufsize;
+  sink.allocator = &default_allocator;
+  sink.borrow = NULL;
+  sink.unread = str + rpos;
+  sink.spill = NULL;
+  sink.spilllen = sink.spillsize = 0;
+  map_state_init(&state, options, NULL, NULL, &default_allocator);
+  result = map_feed(&state, str + rpos, strlen - rpos, &sink);
+  if (result >= 0) {
+    /* all input has been read: the rest of `str` is free */
+    sink.unread = str + bufsize;
+    result = map_settle(&state, &sink, true);
+  }
+  if (result >= 0) {
+    map_inplace_drain(&sink);
+    result = sink.length + sink.spilllen;
+    if (result < sink.length) {
+      result = UTF8PROC_ERROR_OVERFLOW;
+    } else if (sink.spilllen) {
+      /* too long: keep as much of the result as fits */
+      memcpy(str + sink.length, sink.spill, (size_t)(bufsize - sink.length));
+    } else if (result < bufsize) {
+      str[result] = 0;
+    }
+  }
+  map_state_free(&state);
+  if (sink.spill) default_free(sink.spill, NULL);
+  return result;
+}
+
+/* Chunk size of utf8proc_map_parallel: big enough that the overhead of a
+   task is negligible, small enough to balance the load of a pool. */
+#define UTF8PROC_PARALLEL_CHUNK (1 << 20)
+
+/* the first offset >= `pos` in front of which `str` can be split, such that
+   mapping both parts on their own gives the same result as mapping the
+   whole string (see unsafe_is_window_boundary), or `strlen` if there is
+   none */
+static utf8proc_ssize_t parallel_split(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_ssize_t pos,
+  utf8proc_option_t options, utf8proc_custom_func custom_func, void *custom_data
+) {
+  while (pos < strlen) {
+    utf8proc_int32_t uc, dst[UTF8PROC_MAP_MAX_EXPANSION];
+    utf8proc_ssize_t seqlen;
+    int boundclass = UTF8PROC_BOUNDCLASS_START;
+    if (custom_func == NULL && str[pos] >= 0x20 && str[pos] < 0x7F) return pos;
+    seqlen = utf8proc_iterate(str + pos, strlen - pos, &uc);
+    if (seqlen < 0) {
+      pos++;
+      continue;
+    }
+    if (custom_func != NULL) uc = custom_func(uc, custom_data);
+    if (utf8proc_decompose_char(uc, dst, UTF8PROC_MAP_MAX_EXPANSION, options, &boundclass) > 0 &&
+        unsafe_is_window_boundary(dst[0]))
+      return pos;
+    pos += seqlen;
+  }
+  return strlen;
+}
+
+typedef struct {
+  const utf8proc_uint8_t *str;
+  utf8proc_option_t options;
+  utf8proc_custom_func custom_func;
+  void *custom_data;
+  utf8proc_ssize_t *bounds;     /* chunk i is str[bounds[i]..bounds[i+1]) */
+  utf8proc_uint8_t **results;
+  utf8proc_ssize_t *lengths;
+} parallel_map_job;
+
+static void parallel_map_task(void *context, utf8proc_size_t index) {
+  parallel_map_job *job = (parallel_map_job *) context;
+  job->lengths[index] = utf8proc_map_custom(
+    job->str + job->bounds[index], job->bounds[index + 1] - job->bounds[index],
+    &job->results[index], job->options, job->custom_func, job->custom_data);
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_map_parallel(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_uint8_t **dstptr, utf8proc_option_t options,
+  utf8proc_custom_func custom_func, void *custom_data,
+  utf8proc_parallel_func parallel, void *parallel_data
+) {
+  parallel_map_job job;
+  utf8proc_ssize_t result, length = 0, count = 0, i;
+  *dstptr = NULL;
+  result = check_map_options(options);
+  if (result < 0) return result;
+  if (options & UTF8PROC_NULLTERM) {
+    strlen = nulterm_length(str);
+    options &= ~UTF8PROC_NULLTERM;
+  }
+  /* grapheme boundaries depend on everything in front of them */
+  if (parallel == NULL || (options & UTF8PROC_CHARBOUND) || strlen < 2 * UTF8PROC_PARALLEL_CHUNK)
+    return utf8proc_map_custom(str, strlen, dstptr, options, custom_func, custom_data);
+
+  i = strlen / UTF8PROC_PARALLEL_CHUNK + 1;
+  job.bounds = (utf8proc_ssize_t *) malloc((size_t)(i + 1) * sizeof(utf8proc_ssize_t));
+  job.results = (utf8proc_uint8_t **) calloc((size_t)i, sizeof(utf8proc_uint8_t *));
+  job.lengths = (utf8proc_ssize_t *) malloc((size_t)i * sizeof(utf8proc_ssize_t));
+  if (!job.bounds || !job.results || !job.lengths) result = UTF8PROC_ERROR_NOMEM;
+  if (result >= 0) {
+    job.bounds[0] = 0;
+    while (job.bounds[count] < strlen) {
+      utf8proc_ssize_t next = job.bounds[count] + UTF8PROC_PARALLEL_CHUNK;
+      next = strlen - next < UTF8PROC_PARALLEL_CHUNK / 2 ? strlen :
+        parallel_split(str, strlen, next, options, custom_func, custom_data);
+      job.bounds[++count] = next;
+    }
+    job.str = str;
+    job.options = options;
+    job.custom_func = custom_func;
+    job.custom_data = custom_data;
+    parallel(parallel_map_task, &job, (utf8proc_size_t)count, parallel_data);
+  }
+
+  /* the first error is the one utf8proc_map would have stopped at */
+  for (i = 0; i < count && result >= 0; i++) {
+    if (job.lengths[i] < 0) result = job.lengths[i];
+    else if (length > (utf8proc_ssize_t)(SSIZE_MAX/2) - job.lengths[i]) result = UTF8PROC_ERROR_OVERFLOW;
+    else length += job.lengths[i];
+  }
+  if (result >= 0) {
+    *dstptr = (utf8proc_uint8_t *) malloc((size_t)length + 1);
+    if (!*dstptr) {
+      result = UTF8PROC_ERROR_NOMEM;
+    } else {
+      length = 0;
+      for (i = 0; i < count; i++) {
+        memcpy(*dstptr + length, job.results[i], (size_t)job.lengths[i]);
+        length += job.lengths[i];
+      }
+      (*dstptr)[length] = 0;
+      result = length;
+    }
+  }
+  for (i = 0; i < count; i++) free(job.results[i]);
+  free(job.bounds);
+  free(job.results);
+  free(job.lengths);
+  return result;
+}
+
+struct utf8proc_stream_struct {
+  map_state state;
+  map_sink sink;                 /* output of the current call */
+  utf8proc_uint8_t pending[4];   /* incomplete UTF-8 sequence at the end of the last chunk */
+  utf8proc_ssize_t pending_len;
+  utf8proc_ssize_t error;
+  utf8proc_allocator_t allocator;
+};
+
+/* the length of the incomplete UTF-8 sequence at the end of str[0..len) */
+static utf8proc_ssize_t partial_sequence_length(const utf8proc_uint8_t *str, utf8proc_ssize_t len) {
+  utf8proc_ssize_t i;
+  for (i = 1; i <= 3 && i <= len; i++) {
+    utf8proc_ssize_t seqlen = utf8proc_utf8class[str[len - i]];
+    if (seqlen) return seqlen > i ? i : 0;
+  }
+  return 0;
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_stream_new(
+  utf8proc_stream_t **streamptr, utf8proc_option_t options,
+  utf8proc_custom_func custom_func, void *custom_data, const utf8proc_allocator_t *allocator
+) {
+  utf8proc_stream_t *stream;
+  utf8proc_ssize_t result;
+  *streamptr = NULL;
+  result = check_map_options(options);
+  if (result < 0) return result;
+  if (!allocator) allocator = &default_allocator;
+  stream = (utf8proc_stream_t *) allocator->alloc_func(sizeof(utf8proc_stream_t), allocator->data);
+  if (!stream) return UTF8PROC_ERROR_NOMEM;
+  stream->allocator = *allocator;
+  map_state_init(&stream->state, options, custom_func, custom_data, &stream->allocator);
+  stream->sink.length = 0;
+  stream->sink.size = 64;
+  stream->sink.allocator = &stream->allocator;
+  stream->sink.borrow = NULL;
+  stream->sink.unread = NULL;
+  stream->sink.data = (utf8proc_uint8_t *) allocator->alloc_func((size_t)stream->sink.size, allocator->data);
+  if (!stream->sink.data) {
+    allocator->free_func(stream, allocator->data);
+    return UTF8PROC_ERROR_NOMEM;
+  }
+  stream->pending_len = 0;
+  stream->error = 0;
+  *streamptr = stream;
+  return 0;
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_stream_feed(
+  utf8proc_stream_t *stream, const utf8proc_uint8_t *str, utf8proc_ssize_t strlen,
+  const utf8proc_uint8_t **dstptr
+) {
+  utf8proc_ssize_t result = 0, partial;
+  *dstptr = NULL;
+  if (stream->error) return stream->error;
+  stream->sink.length = 0;
+  stream->state.total = 0;
+  if (stream->state.options & UTF8PROC_NULLTERM) strlen = nulterm_length(str);
+  if (stream->pending_len) {
+    /* complete the sequence that the last chunk ended in */
+    utf8proc_ssize_t need = utf8proc_utf8class[stream->pending[0]] - stream->pending_len;
+    if (need > strlen) need = strlen;
+    memcpy(stream->pending + stream->pending_len, str, (size_t)need);
+    stream->pending_len += need;
+    str += need;
+    strlen -= need;
+    if (stream->pending_len == utf8proc_utf8class[stream->pending[0]]) {
+      result = map_feed(&stream->state, stream->pending, stream->pending_len, &stream->sink);
+      stream->pending_len = 0;
+    }
+  }
+  if (result >= 0 && !stream->pending_len) {
+    partial = partial_sequence_length(str, strlen);
+    result = map_feed(&stream->state, str, strlen - partial, &stream->sink);
+    memcpy(stream->pending, str + strlen - partial, (size_t)partial);
+    stream->pending_len = partial;
+  }
+  if (result >= 0) result = map_settle(&stream->state, &stream->sink, false);
+  if (result < 0) return stream->error = result;
+  stream->sink.data[stream->sink.length] = 0;
+  *dstptr = stream->sink.data;
+  return stream->sink.length;
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_stream_finish(
+  utf8proc_stream_t *stream, const utf8proc_uint8_t **dstptr
+) {
+  utf8proc_ssize_t result;
+  *dstptr = NULL;
+  if (stream->error) return stream->error;
+  stream->sink.length = 0;
+  if (stream->pending_len) return stream->error = UTF8PROC_ERROR_INVALIDUTF8;
+  result = map_settle(&stream->state, &stream->sink, true);
+  if (result < 0) return stream->error = result;
+  stream->state.boundclass = UTF8PROC_BOUNDCLASS_START;
+  stream->state.nonstarters = 0;
+  stream->sink.data[stream->sink.length] = 0;
+  *dstptr = stream->sink.data;
+  return stream->sink.length;
+}
+
+UTF8PROC_DLLEXPORT void utf8proc_stream_free(utf8proc_stream_t *stream) {
+  utf8proc_allocator_t allocator;
+  if (!stream) return;
+  allocator = stream->allocator;
+  map_state_free(&stream->state);
+  allocator.free_func(stream->sink.data, allocator.data);
+  allocator.free_func(stream, allocator.data);
+}
+
+/* Size of the output buffer of a map_reader, which only has to grow for a
+   long run of combining marks. */
+#define UTF8PROC_MAP_READER_BUFFER 4096
+
+/* Pull-style counterpart of map_window: map_reader_fill produces the
+   mapped form of `str` a few codepoints at a time, so that consumers like
+   utf8proc_compare can stop early and never hold the whole result.  The
+   output lands in `buffer` (or, for the known-normalized prefix, is `str`
+   itself), which is switched for a growing one only if the window of
+   `state` has become too large to be flushed into it.  A `segmented`
+   reader reads one non-ASCII sequence at a time and settles the window
+   after each read, instead of letting it grow to a few hundred
+   codepoints, so that it does hardly any work ahead of its consumer. */
+typedef struct {
+  map_state state;
+  map_sink sink;
+  const utf8proc_uint8_t *str;
+  utf8proc_ssize_t strlen, pos;
+  const utf8proc_uint8_t *out;   /* output that has not been consumed yet */
+  utf8proc_ssize_t outlen;
+  utf8proc_bool final, segmented;
+  /* With UTF8PROC_CHARBOUND, a segmented reader records for each 0xFFFF
+     in the window and each 0xFF byte in the output (oldest first) whether
+     it is a U+FFFF (bit set) or a grapheme boundary.  The window keeps at
+     most one of them after map_settle, and the next codepoint adds at most
+     UTF8PROC_MAP_MAX_EXPANSION/2 boundaries and a U+FFFF, so 64 bits are
+     enough. */
+  utf8proc_uint64_t ffff;
+  int nffff;
+  utf8proc_uint8_t buffer[UTF8PROC_MAP_READER_BUFFER];
+} map_reader;
+
+static void map_reader_init(
+  map_reader *reader, const utf8proc_uint8_t *str, utf8proc_ssize_t strlen,
+  utf8proc_option_t options, utf8proc_custom_func custom_func, void *custom_data,
+  const utf8proc_allocator_t *allocator, utf8proc_bool segmented
+) {
+  utf8proc_ssize_t stable = 0;
+  if (options & UTF8PROC_NULLTERM) {
+    strlen = nulterm_length(str);
+    options &= ~UTF8PROC_NULLTERM;
+  }
+  if (custom_func == NULL && quick_check_applies(options))
+    quick_check_prefix(str, strlen, options, true, &stable);
+  map_state_init(&reader->state, options, custom_func, custom_data, allocator);
+  reader->sink.data = reader->buffer;
+  reader->sink.length = 0;
+  reader->sink.size = UTF8PROC_MAP_READER_BUFFER;
+  reader->sink.allocator = NULL;
+  reader->sink.borrow = NULL;
+  reader->sink.unread = NULL;
+  reader->str = str;
+  reader->strlen = strlen;
+  reader->pos = stable;
+  reader->out = str;
+  reader->outlen = stable;
+  reader->final = false;
+  reader->segmented = segmented;
+  reader->ffff = 0;
+  reader->nffff = 0;
+}
+
+static void map_reader_free(map_reader *reader) {
+  const utf8proc_allocator_t *allocator = reader->sink.allocator;
+  map_state_free(&reader->state);
+  if (allocator) allocator->free_func(reader->sink.data, allocator->data);
+}
+
+/* record the 0xFFFF among the last `count` codepoints of the window of
+   `reader`, which one codepoint decomposed into: as utf8proc_decompose_char
+   writes a boundary in front of a codepoint, only the last one can be a
+   U+FFFF, which has no decomposition */
+static void map_reader_note_ffff(map_reader *reader, utf8proc_ssize_t count) {
+  const utf8proc_int32_t *added = reader->state.window + reader->state.wlen - count;
+  utf8proc_ssize_t i;
+  for (i = 0; i < count; i++) {
+    if (added[i] != 0xFFFF) continue;
+    if (i == count - 1) reader->ffff |= (utf8proc_uint64_t)1 << reader->nffff;
+    reader->nffff++;
+  }
+}
+
+/* make more output of `reader` available in reader->out once the previous
+   output is consumed; returns its length, 0 at the end of the output, or a
+   negative error code */
+static utf8proc_ssize_t map_reader_fill(map_reader *reader) {
+  map_state *state = &reader->state;
+  map_sink *sink = &reader->sink;
+  utf8proc_ssize_t result = 0, total;
+  if (reader->outlen > 0) return reader->outlen;
+  sink->length = 0;
+  state->total = 0;
+  while (sink->length == 0 && !reader->final) {
+    if (reader->pos < reader->strlen) {
+      const utf8proc_uint8_t *str = reader->str + reader->pos;
+      utf8proc_ssize_t avail = reader->strlen - reader->pos;
+      utf8proc_ssize_t n, seqlen, room = (sink->size - 1) / 4 - state->wlen;
+      if (room < UTF8PROC_MAP_MAX_EXPANSION) {
+        if (!sink->allocator) {
+          /* the fixed buffer might not hold the next flush of the window */
+          const utf8proc_allocator_t *allocator = state->allocator;
+          utf8proc_uint8_t *data = (utf8proc_uint8_t *) allocator->alloc_func(
+            (size_t)sink->size * 2, allocator->data);
+          if (!data) return UTF8PROC_ERROR_NOMEM;
+          sink->data = data;
+          sink->size *= 2;
+          sink->allocator = allocator;
+        }
+        room = UTF8PROC_MAP_MAX_EXPANSION;
+      }
+      if (state->bulk_ascii && *str < 0x80) {
+        /* ASCII maps to one codepoint per byte */
+        n = ascii_span(str, avail);
+        if (n > room) n = room;
+      } else {
+        /* as many sequences as surely fit, up to the next ASCII run */
+        for (n = 0; n < avail && room >= UTF8PROC_MAP_MAX_EXPANSION; n += seqlen) {
+          if ((state->bulk_ascii && str[n] < 0x80) || (reader->segmented && n)) break;
+          seqlen = utf8proc_utf8class[str[n]];
+          if (!seqlen || seqlen > avail - n) {
+            if (!n) n = 1; /* rejected by map_feed */
+            break;
+          }
+          room -= UTF8PROC_MAP_MAX_EXPANSION;
+        }
+      }
+      /* the window is flushed by map_feed once it is long enough */
+      total = state->total;
+      result = map_feed(state, str, n, sink);
+      if (result >= 0 && reader->segmented) {
+        /* without bulk_ascii, that was a single codepoint */
+        if (state->options & UTF8PROC_CHARBOUND) map_reader_note_ffff(reader, state->total - total);
+        result = map_settle(state, sink, false);
+      }
+      reader->pos += n;
+    } else {
+      result = map_settle(state, sink, true);
+      reader->final = true;
+    }
+    if (result < 0) return result;
+  }
+  reader->out = sink->data;
+  reader->outlen = sink->length;
+  return sink->length;
+}
+
+/* consume the first `n` bytes of the output of `reader` */
+static void map_reader_skip(map_reader *reader, utf8proc_ssize_t n) {
+  utf8proc_ssize_t i;
+  for (i = 0; i < n && reader->nffff; i++) {
+    if (reader->out[i] == 0xFF) {
+      reader->ffff >>= 1;
+      reader->nffff--;
+    }
+  }
+  reader->out += n;
+  reader->outlen -= n;
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_compare(
+  const utf8proc_uint8_t *str1, utf8proc_ssize_t strlen1,
+  const utf8proc_uint8_t *str2, utf8proc_ssize_t strlen2,
+  utf8proc_option_t options, int *order
+) {
+  map_reader reader1, reader2;
+  utf8proc_ssize_t result, len1, len2;
+  result = check_map_options(options);
+  if (result < 0) return result;
+  map_reader_init(&reader1, str1, strlen1, options, NULL, NULL, &default_allocator, false);
+  map_reader_init(&reader2, str2, strlen2, options, NULL, NULL, &default_allocator, false);
+  for (;;) {
+    utf8proc_ssize_t n;
+    int diff;
+    len1 = result = map_reader_fill(&reader1);
+    if (result < 0) break;
+    len2 = result = map_reader_fill(&reader2);
+    if (result < 0) break;
+    if (!len1 || !len2) {
+      *order = (len1 > 0) - (len2 > 0);
+      result = 0;
+      break;
+    }
+    n = len1 < len2 ? len1 : len2;
+    diff = memcmp(reader1.out, reader2.out, (size_t)n);
+    if (diff) {
+      *order = diff < 0 ? -1 : 1;
+      result = 0;
+      break;
+    }
+    map_reader_skip(&reader1, n);
+    map_reader_skip(&reader2, n);
   }
-  *dstptr = (utf8proc_uint8_t *)buffer;
+  map_reader_free(&reader1);
+  map_reader_free(&reader2);
   return result;
 }
 
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_equal(
+  const utf8proc_uint8_t *str1, utf8proc_ssize_t strlen1,
+  const utf8proc_uint8_t *str2, utf8proc_ssize_t strlen2,
+  utf8proc_option_t options
+) {
+  int order;
+  utf8proc_ssize_t result = utf8proc_compare(str1, strlen1, str2, strlen2, options, &order);
+  return result < 0 ? result : order == 0;
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_hash(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_option_t options,
+  utf8proc_uint64_t *hash
+) {
+  /* 64-bit FNV-1a */
+  utf8proc_uint64_t h = 0xcbf29ce484222325ULL;
+  map_reader reader;
+  utf8proc_ssize_t result, length = 0;
+  result = check_map_options(options);
+  if (result < 0) return result;
+  map_reader_init(&reader, str, strlen, options, NULL, NULL, &default_allocator, false);
+  while ((result = map_reader_fill(&reader)) > 0) {
+    utf8proc_ssize_t i;
+    for (i = 0; i < result; i++) {
+      h ^= reader.out[i];
+      h *= 0x100000001b3ULL;
+    }
+    length += result;
+    map_reader_skip(&reader, result);
+  }
+  map_reader_free(&reader);
+  if (result < 0) return result;
+  *hash = h;
+  return length;
+}
+
+struct utf8proc_reader_struct {
+  map_reader reader;
+  utf8proc_ssize_t error;
+  utf8proc_allocator_t allocator;
+};
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_reader_new(
+  utf8proc_reader_t **readerptr, const utf8proc_uint8_t *str, utf8proc_ssize_t strlen,
+  utf8proc_option_t options, utf8proc_custom_func custom_func, void *custom_data,
+  const utf8proc_allocator_t *allocator
+) {
+  utf8proc_reader_t *reader;
+  utf8proc_ssize_t result;
+  *readerptr = NULL;
+  result = check_map_options(options);
+  if (result < 0) return result;
+  if (!allocator) allocator = &default_allocator;
+  reader = (utf8proc_reader_t *) allocator->alloc_func(sizeof(utf8proc_reader_t), allocator->data);
+  if (!reader) return UTF8PROC_ERROR_NOMEM;
+  reader->allocator = *allocator;
+  reader->error = 0;
+  map_reader_init(&reader->reader, str, strlen, options, custom_func, custom_data,
+                  &reader->allocator, true);
+  *readerptr = reader;
+  return 0;
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_reader_next(utf8proc_reader_t *reader, utf8proc_int32_t *codepoint) {
+  utf8proc_ssize_t result;
+  if (reader->error) return reader->error;
+  result = map_reader_fill(&reader->reader);
+  if (result < 0) return reader->error = result;
+  if (result == 0) return 0;
+  if (reader->reader.out[0] >= 0xFE) {
+    /* what unsafe_encode_char made of U+FFFE, or of U+FFFF or a boundary */
+    if (reader->reader.out[0] == 0xFE) *codepoint = 0xFFFE;
+    else *codepoint = (reader->reader.ffff & 1) ? 0xFFFF : -1;
+    result = 1;
+  } else {
+    result = unsafe_decode_char(reader->reader.out, codepoint);
+  }
+  map_reader_skip(&reader->reader, result);
+  return result;
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_reader_read(
+  utf8proc_reader_t *reader, utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize
+) {
+  utf8proc_ssize_t length = 0, result;
+  if (reader->error) return reader->error;
+  while (length < bufsize) {
+    result = map_reader_fill(&reader->reader);
+    if (result < 0) {
+      /* report the error with the next call if some output was read */
+      reader->error = result;
+      return length ? length : result;
+    }
+    if (result == 0) break;
+    if (result > bufsize - length) result = bufsize - length;
+    memcpy(buffer + length, reader->reader.out, (size_t)result);
+    map_reader_skip(&reader->reader, result);
+    length += result;
+  }
+  return length;
+}
+
+UTF8PROC_DLLEXPORT void utf8proc_reader_free(utf8proc_reader_t *reader) {
+  utf8proc_allocator_t allocator;
+  if (!reader) return;
+  allocator = reader->allocator;
+  map_reader_free(&reader->reader);
+  allocator.free_func(reader, allocator.data);
+}
+
+UTF8PROC_DLLEXPORT utf8proc_bool utf8proc_stats_get(utf8proc_stats_t *stats) {
+#ifdef UTF8PROC_STATS
+  *stats = utf8proc_stats;
+  return 1;
+#else
+  memset(stats, 0, sizeof(*stats));
+  return 0;
+#endif
+}
+
+UTF8PROC_DLLEXPORT void utf8proc_stats_reset(void) {
+#ifdef UTF8PROC_STATS
+  memset(&utf8proc_stats, 0, sizeof(utf8proc_stats));
+#endif
+}
+
 UTF8PROC_DLLEXPORT utf8proc_uint8_t *utf8proc_NFD(const utf8proc_uint8_t *str) {
   utf8proc_uint8_t *retval;
   utf8proc_map(str, 0, &retval, UTF8PROC_NULLTERM | UTF8PROC_STABLE |
@@ -769,3 +3270,63 @@ UTF8PROC_DLLEXPORT utf8proc_uint8_t *utf8proc_NFKC_Casefold(const utf8proc_uint8
     UTF8PROC_COMPOSE | UTF8PROC_COMPAT | UTF8PROC_CASEFOLD | UTF8PROC_IGNORE);
   return retval;
 }
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_NFD_buffer(const utf8proc_uint8_t *str, utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize) {
+  return utf8proc_map_buffer(str, 0, buffer, bufsize, UTF8PROC_NULLTERM | UTF8PROC_STABLE |
+    UTF8PROC_DECOMPOSE);
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_NFC_buffer(const utf8proc_uint8_t *str, utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize) {
+  return utf8proc_map_buffer(str, 0, buffer, bufsize, UTF8PROC_NULLTERM | UTF8PROC_STABLE |
+    UTF8PROC_COMPOSE);
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_NFKD_buffer(const utf8proc_uint8_t *str, utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize) {
+  return utf8proc_map_buffer(str, 0, buffer, bufsize, UTF8PROC_NULLTERM | UTF8PROC_STABLE |
+    UTF8PROC_DECOMPOSE | UTF8PROC_COMPAT);
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_NFKC_buffer(const utf8proc_uint8_t *str, utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize) {
+  return utf8proc_map_buffer(str, 0, buffer, bufsize, UTF8PROC_NULLTERM | UTF8PROC_STABLE |
+    UTF8PROC_COMPOSE | UTF8PROC_COMPAT);
+}
+
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_NFKC_Casefold_buffer(const utf8proc_uint8_t *str, utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize) {
+  return utf8proc_map_buffer(str, 0, buffer, bufsize, UTF8PROC_NULLTERM | UTF8PROC_STABLE |
+    UTF8PROC_COMPOSE | UTF8PROC_COMPAT | UTF8PROC_CASEFOLD | UTF8PROC_IGNORE);
+}
+
+UTF8PROC_DLLEXPORT const utf8proc_uint8_t *utf8proc_NFD_ctx(utf8proc_context_t *context, const utf8proc_uint8_t *str) {
+  const utf8proc_uint8_t *retval;
+  utf8proc_map_custom_ctx(context, str, 0, &retval, UTF8PROC_NULLTERM | UTF8PROC_STABLE |
+    UTF8PROC_DECOMPOSE, NULL, NULL);
+  return retval;
+}
+
+UTF8PROC_DLLEXPORT const utf8proc_uint8_t *utf8proc_NFC_ctx(utf8proc_context_t *context, const utf8proc_uint8_t *str) {
+  const utf8proc_uint8_t *retval;
+  utf8proc_map_custom_ctx(context, str, 0, &retval, UTF8PROC_NULLTERM | UTF8PROC_STABLE |
+    UTF8PROC_COMPOSE, NULL, NULL);
+  return retval;
+}
+
+UTF8PROC_DLLEXPORT const utf8proc_uint8_t *utf8proc_NFKD_ctx(utf8proc_context_t *context, const utf8proc_uint8_t *str) {
+  const utf8proc_uint8_t *retval;
+  utf8proc_map_custom_ctx(context, str, 0, &retval, UTF8PROC_NULLTERM | UTF8PROC_STABLE |
+    UTF8PROC_DECOMPOSE | UTF8PROC_COMPAT, NULL, NULL);
+  return retval;
+}
+
+UTF8PROC_DLLEXPORT const utf8proc_uint8_t *utf8proc_NFKC_ctx(utf8proc_context_t *context, const utf8proc_uint8_t *str) {
+  const utf8proc_uint8_t *retval;
+  utf8proc_map_custom_ctx(context, str, 0, &retval, UTF8PROC_NULLTERM | UTF8PROC_STABLE |
+    UTF8PROC_COMPOSE | UTF8PROC_COMPAT, NULL, NULL);
+  return retval;
+}
+
+UTF8PROC_DLLEXPORT const utf8proc_uint8_t *utf8proc_NFKC_Casefold_ctx(utf8proc_context_t *context, const utf8proc_uint8_t *str) {
+  const utf8proc_uint8_t *retval;
+  utf8proc_map_custom_ctx(context, str, 0, &retval, UTF8PROC_NULLTERM | UTF8PROC_STABLE |
+    UTF8PROC_COMPOSE | UTF8PROC_COMPAT | UTF8PROC_CASEFOLD | UTF8PROC_IGNORE, NULL, NULL);
+  return retval;
+}
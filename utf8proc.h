@@ -41,11 +41,19 @@
  *    - canonicalize Unicode compatibility characters (@ref UTF8PROC_COMPAT)
  *    - strip "ignorable" (@ref UTF8PROC_IGNORE) characters, control characters (@ref UTF8PROC_STRIPCC), or combining characters such as accents (@ref UTF8PROC_STRIPMARK)
  *    - case-folding (@ref UTF8PROC_CASEFOLD)
+ * - Direct case conversion of UTF-8 strings: @ref utf8proc_tolower_utf8, @ref utf8proc_toupper_utf8, @ref utf8proc_casefold_utf8
  * - Unicode normalization: @ref utf8proc_NFD, @ref utf8proc_NFC, @ref utf8proc_NFKD, @ref utf8proc_NFKC
- * - Detecting grapheme boundaries (@ref utf8proc_grapheme_break and @ref UTF8PROC_CHARBOUND)
- * - Character-width computation: @ref utf8proc_charwidth
+ * - Checking for normalized strings without normalizing them: @ref utf8proc_quick_check, @ref utf8proc_isnormalized
+ * - Comparing and hashing strings as mapped, without building the mapped strings: @ref utf8proc_compare, @ref utf8proc_equal, @ref utf8proc_hash
+ * - Detecting grapheme boundaries (@ref utf8proc_grapheme_break and @ref UTF8PROC_CHARBOUND) and iterating over grapheme clusters (@ref utf8proc_grapheme_next)
+ * - Iterating over words (@ref utf8proc_word_next) and sentences (@ref utf8proc_sentence_next)
+ * - Character-width computation: @ref utf8proc_charwidth, and for strings @ref utf8proc_strwidth
  * - Classification of characters by Unicode category: @ref utf8proc_category and @ref utf8proc_category_string
+ * - Property lookups for whole arrays of codepoints, e.g. @ref utf8proc_category_batch
  * - Encode (@ref utf8proc_encode_char) and decode (@ref utf8proc_iterate) Unicode codepoints to/from UTF-8.
+ * - Fast validation of UTF-8 strings: @ref utf8proc_validate
+ * - Incremental normalization of chunked input: @ref utf8proc_stream_t, and of output pulled on demand: @ref utf8proc_reader_t
+ * - Normalizing many strings without allocating memory for each: @ref utf8proc_context_t
  */
 
 /** @file */
@@ -86,6 +94,7 @@ typedef short utf8proc_int16_t;
 typedef unsigned short utf8proc_uint16_t;
 typedef int utf8proc_int32_t;
 typedef unsigned int utf8proc_uint32_t;
+typedef unsigned __int64 utf8proc_uint64_t;
 #  ifdef _WIN64
 typedef __int64 utf8proc_ssize_t;
 typedef unsigned __int64 utf8proc_size_t;
@@ -114,6 +123,7 @@ typedef int16_t utf8proc_int16_t;
 typedef uint16_t utf8proc_uint16_t;
 typedef int32_t utf8proc_int32_t;
 typedef uint32_t utf8proc_uint32_t;
+typedef uint64_t utf8proc_uint64_t;
 typedef size_t utf8proc_size_t;
 typedef ptrdiff_t utf8proc_ssize_t;
 typedef bool utf8proc_bool;
@@ -209,6 +219,22 @@ typedef enum {
    * Strip unassigned codepoints.
    */
   UTF8PROC_STRIPNA    = (1<<14),
+  /**
+   * Produces Stream-Safe Text (UAX#15): U+034F COMBINING GRAPHEME JOINER
+   * is inserted in front of any codepoint whose decomposition would
+   * extend a run of more than 30 non-starters, so that no normalization
+   * segment grows beyond a fixed size.  This is applied while decomposing
+   * strings (e.g. by @ref utf8proc_decompose_custom, @ref utf8proc_map or
+   * @ref utf8proc_stream_t), but not by @ref utf8proc_decompose_char.
+   */
+  UTF8PROC_STREAMSAFE = (1<<15),
+  /**
+   * The input is known to be valid UTF-8 (for example because it was
+   * checked with @ref utf8proc_validate when it entered the program), so
+   * that decomposition, mapping and quick checks decode it without
+   * validating it again.  The result is undefined for invalid input.
+   */
+  UTF8PROC_PREVALIDATED = (1<<16),
 } utf8proc_option_t;
 
 /** @name Error codes
@@ -274,6 +300,15 @@ typedef struct utf8proc_property_struct {
    * @see utf8proc_boundclass_t.
    */
   unsigned boundclass:8;
+  /**
+   * Quick_Check properties (UAX #15) for the normalization forms
+   * NFC, NFD, NFKC and NFKD.
+   * @see utf8proc_quick_check_t.
+   */
+  unsigned nfc_qc:2;
+  unsigned nfd_qc:2;
+  unsigned nfkc_qc:2;
+  unsigned nfkd_qc:2;
 } utf8proc_property_t;
 
 /** Unicode categories. */
@@ -388,6 +423,13 @@ typedef enum {
   UTF8PROC_BOUNDCLASS_E_ZWG = 20, /* UTF8PROC_BOUNDCLASS_EXTENDED_PICTOGRAPHIC + ZWJ */
 } utf8proc_boundclass_t;
 
+/** Quick_Check property values (UAX #15). */
+typedef enum {
+  UTF8PROC_QC_YES   = 0, /**< Yes: the codepoint may occur unchanged in the normalization form */
+  UTF8PROC_QC_NO    = 1, /**< No: the codepoint never occurs in the normalization form */
+  UTF8PROC_QC_MAYBE = 2, /**< Maybe: depends on the context (it may compose with a preceding codepoint) */
+} utf8proc_quick_check_t;
+
 /**
  * Function pointer type passed to @ref utf8proc_map_custom and
  * @ref utf8proc_decompose_custom, which is used to specify a user-defined
@@ -395,6 +437,75 @@ typedef enum {
  */
 typedef utf8proc_int32_t (*utf8proc_custom_func)(utf8proc_int32_t codepoint, void *data);
 
+/**
+ * A thread pool for @ref utf8proc_map_parallel: the function must call
+ * `task(context, i)` once for every `i` from 0 to `count - 1`, possibly
+ * concurrently and in any order, and return once all calls have returned.
+ * `data` is passed through from @ref utf8proc_map_parallel.
+ */
+typedef void (*utf8proc_parallel_func)(
+  void (*task)(void *context, utf8proc_size_t index), void *context,
+  utf8proc_size_t count, void *data);
+
+/**
+ * Memory allocation functions used by @ref utf8proc_map_allocator in place
+ * of `malloc`, `realloc` and `free` (e.g. to allocate from an arena or
+ * pool).  The `data` pointer is passed through to each of the functions.
+ */
+typedef struct utf8proc_allocator_struct {
+  /** Allocates `size` bytes, returning `NULL` on failure. */
+  void *(*alloc_func)(size_t size, void *data);
+  /** Resizes the memory at `ptr` to `size` bytes, returning `NULL` on failure. */
+  void *(*realloc_func)(void *ptr, size_t size, void *data);
+  /** Releases memory obtained from `alloc_func` or `realloc_func`. */
+  void (*free_func)(void *ptr, void *data);
+  /** User data passed to the functions above. */
+  void *data;
+} utf8proc_allocator_t;
+
+/**
+ * State of a grapheme-cluster iterator, see @ref utf8proc_grapheme_init.
+ * The fields are private.
+ */
+typedef struct utf8proc_grapheme_iterator_struct {
+  const utf8proc_uint8_t *str;
+  utf8proc_ssize_t strlen;
+  /** byte offset of the last boundary returned (the start of the next cluster) */
+  utf8proc_ssize_t pos;
+  /** byte offset behind the first codepoint of the next cluster, if already read */
+  utf8proc_ssize_t next;
+  utf8proc_int32_t state;
+} utf8proc_grapheme_iterator_t;
+
+/**
+ * State of a word or sentence iterator, see @ref utf8proc_word_init and
+ * @ref utf8proc_sentence_init.  The fields are private.
+ */
+typedef struct utf8proc_segment_iterator_struct {
+  const utf8proc_uint8_t *str;
+  utf8proc_ssize_t strlen;
+  /** byte offset of the last boundary returned (the start of the next segment) */
+  utf8proc_ssize_t pos;
+  /** byte offset of the next codepoint to read */
+  utf8proc_ssize_t next;
+  utf8proc_int32_t state;
+} utf8proc_segment_iterator_t;
+
+/**
+ * Opaque state of an incremental normalizer, see @ref utf8proc_stream_new.
+ */
+typedef struct utf8proc_stream_struct utf8proc_stream_t;
+
+/**
+ * Opaque state of a pull-style normalizer, see @ref utf8proc_reader_new.
+ */
+typedef struct utf8proc_reader_struct utf8proc_reader_t;
+
+/**
+ * Opaque scratch buffers reused across calls, see @ref utf8proc_context_new.
+ */
+typedef struct utf8proc_context_struct utf8proc_context_t;
+
 /**
  * Array containing the byte lengths of a UTF-8 encoded codepoint based
  * on the first byte.
@@ -426,6 +537,24 @@ UTF8PROC_DLLEXPORT const char *utf8proc_errmsg(utf8proc_ssize_t errcode);
  */
 UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_iterate(const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_int32_t *codepoint_ref);
 
+/**
+ * Checks whether `str` is valid UTF-8, by the same rules as
+ * @ref utf8proc_iterate (no overlong sequences, no surrogates, nothing
+ * beyond U+10FFFF), but much faster than iterating through it.
+ *
+ * @param str the string to check
+ * @param strlen the length of `str` in bytes, or a negative value if `str`
+ *               is NUL-terminated
+ * @param error_offset if not `NULL`, set to the byte offset of the first
+ *                     invalid sequence, or to the length of `str` if there
+ *                     is none
+ *
+ * @return
+ * The length of `str` in bytes if it is valid, and
+ * @ref UTF8PROC_ERROR_INVALIDUTF8 otherwise.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_validate(const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_ssize_t *error_offset);
+
 /**
  * Check if a codepoint is valid (regardless of whether it has been
  * assigned a value by the current Unicode standard).
@@ -581,6 +710,46 @@ UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_normalize_utf32(utf8proc_int32_t *b
  */
 UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_reencode(utf8proc_int32_t *buffer, utf8proc_ssize_t length, utf8proc_option_t options);
 
+/**
+ * Performs the Quick_Check algorithm of UAX #15 to determine whether the
+ * UTF-8 string `str` is in the normalization form selected by `options`,
+ * without normalizing it.
+ *
+ * @param str the UTF-8 string (NULL terminated if @ref UTF8PROC_NULLTERM is set).
+ * @param strlen the length of `str` in bytes (ignored with @ref UTF8PROC_NULLTERM).
+ * @param options @ref UTF8PROC_COMPOSE (NFC) or @ref UTF8PROC_DECOMPOSE (NFD),
+ *                optionally combined with @ref UTF8PROC_COMPAT (NFKC/NFKD),
+ *                @ref UTF8PROC_NULLTERM, @ref UTF8PROC_STABLE and
+ *                @ref UTF8PROC_PREVALIDATED.  The standard (stable)
+ *                normalization forms are always checked.
+ *
+ * @return
+ * @ref UTF8PROC_QC_YES if `str` is normalized, @ref UTF8PROC_QC_NO if it is
+ * not, and @ref UTF8PROC_QC_MAYBE if this can only be determined by
+ * normalizing it (see @ref utf8proc_isnormalized).  Otherwise a negative
+ * error code is returned: @ref UTF8PROC_ERROR_INVALIDOPTS for other options,
+ * or @ref UTF8PROC_ERROR_INVALIDUTF8 if invalid UTF-8 is encountered before
+ * the answer is known.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_quick_check(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_option_t options
+);
+
+/**
+ * Returns 1 if @ref utf8proc_map would return the UTF-8 string `str`
+ * unchanged for the given `options`, and 0 otherwise, or a negative error
+ * code (@ref utf8proc_errmsg).
+ *
+ * For the normalization forms (see @ref utf8proc_quick_check), the
+ * Quick_Check properties are used to avoid normalizing the string, except
+ * for the part following the first @ref UTF8PROC_QC_MAYBE codepoint.  As
+ * with @ref utf8proc_quick_check, invalid UTF-8 following a codepoint that
+ * proves that `str` is not normalized is not necessarily detected.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_isnormalized(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_option_t options
+);
+
 /**
  * Given a pair of consecutive codepoints, return whether a grapheme break is
  * permitted between them (as defined by the extended grapheme clusters in UAX#29).
@@ -608,6 +777,83 @@ UTF8PROC_DLLEXPORT utf8proc_bool utf8proc_grapheme_break(
     utf8proc_int32_t codepoint1, utf8proc_int32_t codepoint2);
 
 
+/**
+ * Starts iterating over the extended grapheme clusters (UAX#29) of the
+ * UTF-8 string `str` of `strlen` bytes (or NUL-terminated if `strlen` is
+ * negative), with the same boundaries as @ref UTF8PROC_CHARBOUND.  The
+ * iterator allocates nothing and reads each codepoint and its properties
+ * only once.
+ */
+UTF8PROC_DLLEXPORT void utf8proc_grapheme_init(
+  utf8proc_grapheme_iterator_t *iter, const utf8proc_uint8_t *str, utf8proc_ssize_t strlen
+);
+
+/**
+ * Advances `iter` over the next grapheme cluster.
+ *
+ * @return
+ * The byte offset of the end of that cluster (i.e. of the next grapheme
+ * boundary), 0 if the end of the string has been reached, or
+ * @ref UTF8PROC_ERROR_INVALIDUTF8.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_grapheme_next(utf8proc_grapheme_iterator_t *iter);
+
+/**
+ * Returns the length in bytes of the longest prefix of the UTF-8 string
+ * `str` (of `strlen` bytes, or NUL-terminated if `strlen` is negative)
+ * that consists of at most `n` whole grapheme clusters, or
+ * @ref UTF8PROC_ERROR_INVALIDUTF8.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_grapheme_truncate(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_ssize_t n
+);
+
+/**
+ * Starts iterating over the words of the UTF-8 string `str` of `strlen`
+ * bytes (or NUL-terminated if `strlen` is negative), i.e. over the
+ * segments between the word boundaries of the default rules of UAX#29.
+ * Note that spaces and punctuation are segments of their own, so a caller
+ * looking for words will usually skip the segments without letters or
+ * digits.  Like the grapheme iterator, this allocates nothing and looks up
+ * the properties of each codepoint only once, but it reads ahead as far as
+ * the rules require (e.g. past a `.` between letters, which only joins
+ * them if a letter follows).
+ */
+UTF8PROC_DLLEXPORT void utf8proc_word_init(
+  utf8proc_segment_iterator_t *iter, const utf8proc_uint8_t *str, utf8proc_ssize_t strlen
+);
+
+/**
+ * Advances `iter` over the next word.
+ *
+ * @return
+ * The byte offset of the end of that word (i.e. of the next word boundary),
+ * 0 if the end of the string has been reached, or
+ * @ref UTF8PROC_ERROR_INVALIDUTF8.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_word_next(utf8proc_segment_iterator_t *iter);
+
+/**
+ * Starts iterating over the sentences of the UTF-8 string `str` of `strlen`
+ * bytes (or NUL-terminated if `strlen` is negative), with the default
+ * sentence boundaries of UAX#29, in the same way as @ref utf8proc_word_init.
+ * As the default rules know no abbreviations, "Mr. Smith" is two sentences.
+ */
+UTF8PROC_DLLEXPORT void utf8proc_sentence_init(
+  utf8proc_segment_iterator_t *iter, const utf8proc_uint8_t *str, utf8proc_ssize_t strlen
+);
+
+/**
+ * Advances `iter` over the next sentence, which includes the spaces and
+ * paragraph separator that follow it.
+ *
+ * @return
+ * The byte offset of the end of that sentence (i.e. of the next sentence
+ * boundary), 0 if the end of the string has been reached, or
+ * @ref UTF8PROC_ERROR_INVALIDUTF8.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_sentence_next(utf8proc_segment_iterator_t *iter);
+
 /**
  * Given a codepoint `c`, return the codepoint of the corresponding
  * lower-case character, if any; otherwise (if there is no lower-case
@@ -629,6 +875,49 @@ UTF8PROC_DLLEXPORT utf8proc_int32_t utf8proc_toupper(utf8proc_int32_t c);
  */
 UTF8PROC_DLLEXPORT utf8proc_int32_t utf8proc_totitle(utf8proc_int32_t c);
 
+/**
+ * Converts the UTF-8 string `str` of `strlen` bytes (or NUL-terminated if
+ * `strlen` is negative) to lower case, mapping each codepoint as
+ * @ref utf8proc_tolower does, and writes the NUL-terminated result to
+ * `buffer` of `bufsize` bytes.
+ *
+ * @return
+ * In case of success the length (in bytes, excluding the NULL terminator)
+ * of the new string is returned, otherwise a negative error code.  As for
+ * @ref utf8proc_map_buffer, if the returned length is not smaller than
+ * `bufsize`, the result did not fit; call again with a buffer of at least
+ * the returned length plus one bytes.
+ *
+ * `buffer` may be `str` itself (but must not otherwise overlap it) to
+ * convert in place, which always succeeds if `bufsize` exceeds `strlen` and
+ * no codepoint maps to a longer encoding.  Otherwise
+ * @ref UTF8PROC_ERROR_OVERFLOW is returned once the result would overwrite
+ * unread input, and `str` is then left partially converted.  Invalid UTF-8
+ * is rejected with @ref UTF8PROC_ERROR_INVALIDUTF8 before anything is
+ * written.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_tolower_utf8(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize
+);
+
+/**
+ * Like @ref utf8proc_tolower_utf8, but converts to upper case as
+ * @ref utf8proc_toupper does.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_toupper_utf8(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize
+);
+
+/**
+ * Like @ref utf8proc_tolower_utf8, but applies full Unicode case folding,
+ * with the same result as @ref utf8proc_map with just
+ * @ref UTF8PROC_CASEFOLD (some codepoints fold to several, e.g. U+00DF to
+ * "ss").
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_casefold_utf8(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize
+);
+
 /**
  * Given a codepoint, return a character width analogous to `wcwidth(codepoint)`,
  * except that a width of 0 is returned for non-printable codepoints
@@ -639,6 +928,28 @@ UTF8PROC_DLLEXPORT utf8proc_int32_t utf8proc_totitle(utf8proc_int32_t c);
  * (analogous to `isprint` or `iscntrl`), use @ref utf8proc_category. */
 UTF8PROC_DLLEXPORT int utf8proc_charwidth(utf8proc_int32_t codepoint);
 
+/**
+ * Return the width in columns of the UTF-8 string `str` of `strlen` bytes
+ * (or NUL-terminated if `strlen` is negative), or
+ * @ref UTF8PROC_ERROR_INVALIDUTF8.  Each grapheme cluster counts once,
+ * with the largest @ref utf8proc_charwidth of its codepoints, so that
+ * combining sequences and emoji ZWJ sequences are not counted repeatedly.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_strwidth(const utf8proc_uint8_t *str, utf8proc_ssize_t strlen);
+
+/**
+ * Return the length in bytes of the longest prefix of the UTF-8 string
+ * `str` (of `strlen` bytes, or NUL-terminated if `strlen` is negative)
+ * that consists of whole grapheme clusters and fits into `maxwidth`
+ * columns, as measured by @ref utf8proc_strwidth, or
+ * @ref UTF8PROC_ERROR_INVALIDUTF8 if invalid UTF-8 is encountered before the
+ * end of the prefix (or within the codepoint following it).  If `width` is
+ * not `NULL`, the width of the prefix is stored in `*width`.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_strwidth_prefix(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_ssize_t maxwidth, utf8proc_ssize_t *width
+);
+
 /**
  * Return the Unicode category for the codepoint (one of the
  * @ref utf8proc_category_t constants.)
@@ -651,6 +962,34 @@ UTF8PROC_DLLEXPORT utf8proc_category_t utf8proc_category(utf8proc_int32_t codepo
  */
 UTF8PROC_DLLEXPORT const char *utf8proc_category_string(utf8proc_int32_t codepoint);
 
+/**
+ * @name Batch property lookup
+ *
+ * Array versions of @ref utf8proc_get_property and the functions above,
+ * for processing many codepoints without a function call per codepoint.
+ * Each one fills `out[i]` from `in[i]` for `i < n`, treating invalid
+ * codepoints just like the single-codepoint functions.  The case mappings
+ * may work in place (`out == in`); the arrays must not otherwise overlap.
+ */
+/** @{ */
+/** Array version of @ref utf8proc_get_property. */
+UTF8PROC_DLLEXPORT void utf8proc_get_property_batch(const utf8proc_int32_t *in, utf8proc_size_t n, const utf8proc_property_t **out);
+/** Array version of @ref utf8proc_category (the values are @ref utf8proc_category_t constants). */
+UTF8PROC_DLLEXPORT void utf8proc_category_batch(const utf8proc_int32_t *in, utf8proc_size_t n, utf8proc_propval_t *out);
+/** Array version of @ref utf8proc_charwidth. */
+UTF8PROC_DLLEXPORT void utf8proc_charwidth_batch(const utf8proc_int32_t *in, utf8proc_size_t n, int *out);
+/** The @ref utf8proc_boundclass_t grapheme boundary classes of `in`. */
+UTF8PROC_DLLEXPORT void utf8proc_boundclass_batch(const utf8proc_int32_t *in, utf8proc_size_t n, utf8proc_propval_t *out);
+/** The canonical combining classes of `in`. */
+UTF8PROC_DLLEXPORT void utf8proc_combining_class_batch(const utf8proc_int32_t *in, utf8proc_size_t n, utf8proc_propval_t *out);
+/** Array version of @ref utf8proc_tolower. */
+UTF8PROC_DLLEXPORT void utf8proc_tolower_batch(const utf8proc_int32_t *in, utf8proc_size_t n, utf8proc_int32_t *out);
+/** Array version of @ref utf8proc_toupper. */
+UTF8PROC_DLLEXPORT void utf8proc_toupper_batch(const utf8proc_int32_t *in, utf8proc_size_t n, utf8proc_int32_t *out);
+/** Array version of @ref utf8proc_totitle. */
+UTF8PROC_DLLEXPORT void utf8proc_totitle_batch(const utf8proc_int32_t *in, utf8proc_size_t n, utf8proc_int32_t *out);
+/** @} */
+
 /**
  * Maps the given UTF-8 string pointed to by `str` to a new UTF-8
  * string, allocated dynamically by `malloc` and returned via `dstptr`.
@@ -685,6 +1024,424 @@ UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_map_custom(
   utf8proc_custom_func custom_func, void *custom_data
 );
 
+/**
+ * Like @ref utf8proc_map_custom, but obtains (and, on error, releases) all
+ * memory through `allocator` instead of `malloc`, `realloc` and `free`.
+ * If `allocator` is `NULL`, the standard functions are used.
+ *
+ * @note The new UTF-8 string returned via `dstptr` must be deallocated
+ * with the `free_func` of `allocator`.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_map_allocator(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_uint8_t **dstptr, utf8proc_option_t options,
+  utf8proc_custom_func custom_func, void *custom_data, const utf8proc_allocator_t *allocator
+);
+
+/**
+ * Like @ref utf8proc_map_allocator, but without allocating or copying
+ * anything if the result is byte-identical to the input: in that case
+ * `*dstptr` is set to `NULL` and the length of `str` is returned, so that
+ * the caller can keep using `str` itself.  Otherwise `*dstptr` receives a
+ * new NULL-terminated string, to be deallocated with the `free_func` of
+ * `allocator` (or `free` if `allocator` is `NULL`).
+ *
+ * For the normalization forms (see @ref utf8proc_quick_check), a string that
+ * is already normalized is recognized by its Quick_Check properties.  For
+ * other options the output is compared with the input while it is being
+ * produced, and memory is only allocated from the first difference on.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_map_borrow(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_uint8_t **dstptr, utf8proc_option_t options,
+  utf8proc_custom_func custom_func, void *custom_data, const utf8proc_allocator_t *allocator
+);
+
+/**
+ * Like @ref utf8proc_map, but writes the resulting UTF-8 string into the
+ * caller-owned `buffer` of `bufsize` bytes instead of allocating it.
+ *
+ * In case of success the length (in bytes, excluding the NULL terminator)
+ * of the new string is returned, otherwise a negative error code is
+ * returned.  If the returned length is not smaller than `bufsize`, the
+ * result did not fit (and `buffer` holds undefined data); call again with a
+ * buffer of at least the returned length plus one bytes.  Passing a `NULL`
+ * `buffer` with a `bufsize` of 0 just computes the required length.
+ *
+ * No memory is allocated, except in the rare case of a sequence of
+ * hundreds of combining characters in a row.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_map_buffer(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen,
+  utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize, utf8proc_option_t options
+);
+
+/**
+ * Like @ref utf8proc_map_buffer, but also takes a `custom_func` mapping
+ * function (see @ref utf8proc_map_custom).
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_map_buffer_custom(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen,
+  utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize, utf8proc_option_t options,
+  utf8proc_custom_func custom_func, void *custom_data
+);
+
+/**
+ * Like @ref utf8proc_map, but overwrites the `strlen` bytes of `str` with the
+ * result, where `str` has room for `bufsize` bytes (at least `strlen`).
+ *
+ * The input is validated first, unless @ref UTF8PROC_PREVALIDATED is set,
+ * and each normalized piece is then written straight back over the input
+ * already read.  Only where the output would overtake the unread input
+ * (e.g. for NFD or a case fold that grows the UTF-8 encoding) does it pile
+ * up in a side buffer until it fits again, so that transformations that do
+ * not lengthen the string (NFC of decomposed text, @ref UTF8PROC_STRIPCC,
+ * @ref UTF8PROC_STRIPMARK, @ref UTF8PROC_IGNORE...) allocate no memory and
+ * copy no byte twice.  With @ref UTF8PROC_NULLTERM, the length of `str` is
+ * determined by its NULL terminator.
+ *
+ * In case of success the length of the result is returned, and it is NULL
+ * terminated if it is shorter than `bufsize`.  If the result is longer than
+ * `bufsize`, its length is returned as well, and `str` holds its first
+ * `bufsize` bytes (not NULL terminated, and possibly ending in the middle
+ * of a UTF-8 sequence).  Otherwise a negative error code is returned (see
+ * @ref utf8proc_errmsg): `str` is left untouched for invalid options and
+ * @ref UTF8PROC_ERROR_INVALIDUTF8, and holds undefined data after any other
+ * error (@ref UTF8PROC_ERROR_NOTASSIGNED with @ref UTF8PROC_REJECTNA,
+ * @ref UTF8PROC_ERROR_NOMEM or @ref UTF8PROC_ERROR_OVERFLOW), as the part of
+ * the result in front of the offending codepoint may already have been
+ * written over it.  As the validation comes first, invalid UTF-8 is reported
+ * as @ref UTF8PROC_ERROR_INVALIDUTF8 even where @ref utf8proc_map returns
+ * @ref UTF8PROC_ERROR_NOTASSIGNED for an unassigned codepoint in front of it.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_map_inplace(
+  utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_ssize_t bufsize, utf8proc_option_t options
+);
+
+/**
+ * Like @ref utf8proc_map_custom, but maps long strings (of a few MB or more)
+ * in chunks of about 1 MB on the thread pool `parallel`, which is called
+ * once with `parallel_data`.  The chunks are split in front of codepoints
+ * that cannot interact with the codepoints preceding them, so that the
+ * result is identical to that of @ref utf8proc_map_custom, which is used
+ * directly for short strings, with @ref UTF8PROC_CHARBOUND, or if
+ * `parallel` is `NULL`.  `custom_func` must be safe to call from several
+ * threads at once, and may be called more than once for a codepoint.
+ *
+ * @note The memory of the new UTF-8 string will have been allocated
+ * with `malloc`, and should therefore be deallocated with `free`.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_map_parallel(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_uint8_t **dstptr, utf8proc_option_t options,
+  utf8proc_custom_func custom_func, void *custom_data,
+  utf8proc_parallel_func parallel, void *parallel_data
+);
+
+/** @name Incremental normalization
+ *
+ * A @ref utf8proc_stream_t maps a string that arrives in chunks of
+ * arbitrary size (which may even split UTF-8 sequences) just like
+ * @ref utf8proc_map would map the whole string at once: the concatenated
+ * output of @ref utf8proc_stream_feed and @ref utf8proc_stream_finish is
+ * the result of @ref utf8proc_map on the concatenated input.  Only the
+ * trailing codepoints that could still interact with further input (the
+ * last starter and its combining marks, or an incomplete UTF-8 sequence)
+ * are held back, so memory use does not grow with the length of the input.
+ */
+/** @{ */
+/**
+ * Creates a new incremental normalizer in `*streamptr`, mapping with
+ * `options` (and, unless it is `NULL`, `custom_func`) like
+ * @ref utf8proc_map_custom.  With @ref UTF8PROC_NULLTERM, each chunk is
+ * NUL-terminated.  All memory of the normalizer is obtained through
+ * `allocator`, or with `malloc` and friends if `allocator` is `NULL`.
+ *
+ * Returns 0 on success, or a negative error code (in which case
+ * `*streamptr` is set to `NULL`).
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_stream_new(
+  utf8proc_stream_t **streamptr, utf8proc_option_t options,
+  utf8proc_custom_func custom_func, void *custom_data, const utf8proc_allocator_t *allocator
+);
+
+/**
+ * Feeds the next `strlen` bytes of input in `str` to `stream`, and points
+ * `*dstptr` to the output that has become final.  That output is
+ * NULL terminated and owned by `stream`; it remains valid until the next
+ * call with `stream`.
+ *
+ * Returns the length of the output in bytes, or a negative error code.
+ * After an error (e.g. @ref UTF8PROC_ERROR_INVALIDUTF8), all further calls
+ * with `stream` return the same error.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_stream_feed(
+  utf8proc_stream_t *stream, const utf8proc_uint8_t *str, utf8proc_ssize_t strlen,
+  const utf8proc_uint8_t **dstptr
+);
+
+/**
+ * Ends the input of `stream`, and points `*dstptr` to the output held
+ * back so far, with the same return values as @ref utf8proc_stream_feed.
+ * Afterwards, `stream` starts over with a new string.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_stream_finish(
+  utf8proc_stream_t *stream, const utf8proc_uint8_t **dstptr
+);
+
+/** Releases `stream` and all memory owned by it. */
+UTF8PROC_DLLEXPORT void utf8proc_stream_free(utf8proc_stream_t *stream);
+/** @} */
+
+/** @name Comparison and hashing
+ *
+ * These functions treat strings as @ref utf8proc_map with the same
+ * `options` would map them, e.g. compare them case- and
+ * normalization-insensitively with the options of
+ * @ref utf8proc_NFKC_Casefold, but without building the mapped strings:
+ * the inputs are mapped a few codepoints at a time, and the comparison
+ * stops at the first difference.  Apart from the rare case of a sequence
+ * of hundreds of combining characters in a row, no memory is allocated.
+ * With @ref UTF8PROC_NULLTERM, each input is NUL-terminated.
+ */
+/** @{ */
+/**
+ * Compares the mapped forms of `str1` and `str2` (of `strlen1` and
+ * `strlen2` bytes), and sets `*order` to -1, 0 or 1 if the first is
+ * smaller than, equal to, or greater than the second.  Mapped strings are
+ * ordered like `memcmp` orders their UTF-8 encodings, which is the order of
+ * their codepoints.
+ *
+ * Returns 0 on success, or a negative error code.  Errors (such as invalid
+ * UTF-8) behind the first difference are not detected.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_compare(
+  const utf8proc_uint8_t *str1, utf8proc_ssize_t strlen1,
+  const utf8proc_uint8_t *str2, utf8proc_ssize_t strlen2,
+  utf8proc_option_t options, int *order
+);
+
+/**
+ * Like @ref utf8proc_compare, but returns whether the mapped forms of
+ * `str1` and `str2` are equal (1 or 0), or a negative error code.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_equal(
+  const utf8proc_uint8_t *str1, utf8proc_ssize_t strlen1,
+  const utf8proc_uint8_t *str2, utf8proc_ssize_t strlen2,
+  utf8proc_option_t options
+);
+
+/**
+ * Sets `*hash` to the 64-bit FNV-1a hash of the UTF-8 string that
+ * @ref utf8proc_map would return for `str` and `options`, so strings that
+ * @ref utf8proc_equal considers equal have equal hashes.  The hash does not
+ * depend on the platform, but may change with the Unicode version.
+ *
+ * Returns the length of the mapped string in bytes, or a negative error
+ * code (in which case `*hash` is not set).
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_hash(
+  const utf8proc_uint8_t *str, utf8proc_ssize_t strlen, utf8proc_option_t options,
+  utf8proc_uint64_t *hash
+);
+/** @} */
+
+/** @name Pull-style normalization
+ *
+ * A @ref utf8proc_reader_t produces the result of @ref utf8proc_map_custom
+ * for a string on demand, a codepoint or a few bytes at a time, so that
+ * consumers that stop early (prefix matching, tokenizers, ...) only pay
+ * for the part of the output they read.  It only looks ahead as far as
+ * needed for canonical reordering and composition: one starter and its
+ * combining marks (or a run of ASCII characters).
+ */
+/** @{ */
+/**
+ * Creates a new reader in `*readerptr` for the mapped form of the
+ * `strlen` bytes of `str` (or, with @ref UTF8PROC_NULLTERM, the
+ * NUL-terminated `str`), with the same `options`, `custom_func` and
+ * `custom_data` as @ref utf8proc_map_custom.  `str` is not copied and must
+ * remain valid until the reader is freed.  All memory of the reader is
+ * obtained through `allocator`, or with `malloc` and friends if
+ * `allocator` is `NULL`.
+ *
+ * Returns 0 on success, or a negative error code (in which case
+ * `*readerptr` is set to `NULL`).
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_reader_new(
+  utf8proc_reader_t **readerptr, const utf8proc_uint8_t *str, utf8proc_ssize_t strlen,
+  utf8proc_option_t options, utf8proc_custom_func custom_func, void *custom_data,
+  const utf8proc_allocator_t *allocator
+);
+
+/**
+ * Reads the next codepoint of the mapped string from `reader` into
+ * `*codepoint`.  With @ref UTF8PROC_CHARBOUND, grapheme boundaries (which
+ * @ref utf8proc_decompose writes as 0xFFFF, and @ref utf8proc_map_custom
+ * as a single 0xFF byte) are read as -1.  A U+FFFF or U+FFFE in the
+ * mapped string, which @ref utf8proc_map_custom then encodes as a single
+ * 0xFF or 0xFE byte as well, is still read as 0xFFFF or 0xFFFE.
+ *
+ * Returns the length of the codepoint in the UTF-8 output of
+ * @ref utf8proc_map_custom, 0 at the end of the string, or a negative
+ * error code.  Calls can be mixed with @ref utf8proc_reader_read as long
+ * as that does not stop in the middle of a UTF-8 sequence.  After an
+ * error, all further calls with `reader` return the same error.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_reader_next(utf8proc_reader_t *reader, utf8proc_int32_t *codepoint);
+
+/**
+ * Reads up to `bufsize` further bytes of the mapped string as UTF-8 from
+ * `reader` into `buffer` (which is not NUL-terminated, and may end in the
+ * middle of a UTF-8 sequence).
+ *
+ * Returns the number of bytes read, which is only smaller than `bufsize`
+ * at the end of the string, or a negative error code.  An error that
+ * occurs after some bytes have been read is returned by the next call.
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_reader_read(
+  utf8proc_reader_t *reader, utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize
+);
+
+/** Releases `reader` and all memory owned by it. */
+UTF8PROC_DLLEXPORT void utf8proc_reader_free(utf8proc_reader_t *reader);
+/** @} */
+
+/** @name Reusable scratch buffers
+ *
+ * A @ref utf8proc_context_t owns the memory that a mapping needs besides
+ * its input: the UTF-8 output, the UTF-32 buffer of
+ * @ref utf8proc_decompose_custom_ctx and the window in which long runs of
+ * combining marks are reordered.  Its buffers grow geometrically and are
+ * kept between calls, so that once they are large enough for the strings
+ * at hand, the `_ctx` variants of the mapping functions below allocate no
+ * memory at all.  Results are owned by the context and remain valid until
+ * the next call with it.  @ref utf8proc_NFD_ctx etcetera return the same
+ * normalized strings as @ref utf8proc_NFD etcetera (or `NULL` on an
+ * error) in this way.  A context has no locks: each thread should use
+ * its own (or only one thread at a time may use it).
+ */
+/** @{ */
+/**
+ * Creates a new context without any buffers in `*contextptr`, which
+ * obtains all of its memory through `allocator`, or with `malloc` and
+ * friends if `allocator` is `NULL`.
+ *
+ * Returns 0 on success, or a negative error code (in which case
+ * `*contextptr` is set to `NULL`).
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_context_new(
+  utf8proc_context_t **contextptr, const utf8proc_allocator_t *allocator
+);
+
+/**
+ * Releases the buffers of `context` (e.g. after an unusually long string),
+ * which are allocated again as needed by the next call with it.
+ */
+UTF8PROC_DLLEXPORT void utf8proc_context_trim(utf8proc_context_t *context);
+
+/** Releases `context` and all memory owned by it. */
+UTF8PROC_DLLEXPORT void utf8proc_context_free(utf8proc_context_t *context);
+
+/**
+ * Like @ref utf8proc_map_custom, but maps into the output buffer of
+ * `context`: `*dstptr` is pointed to the NULL-terminated result, which
+ * remains valid until the next call with `context`.
+ *
+ * Returns the length of the result in bytes, or a negative error code
+ * (in which case `*dstptr` is set to `NULL`).
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_map_custom_ctx(
+  utf8proc_context_t *context, const utf8proc_uint8_t *str, utf8proc_ssize_t strlen,
+  const utf8proc_uint8_t **dstptr, utf8proc_option_t options,
+  utf8proc_custom_func custom_func, void *custom_data
+);
+
+/**
+ * Like @ref utf8proc_decompose_custom, but decomposes into the UTF-32
+ * buffer of `context`, which is grown as needed: `*dstptr` is pointed to
+ * the resulting codepoints, which remain valid until the next call with
+ * `context`.  When the buffer has to grow, `str` is decomposed (and
+ * `custom_func` called) a second time.
+ *
+ * Returns the number of codepoints, or a negative error code (in which
+ * case `*dstptr` is set to `NULL`).
+ */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_decompose_custom_ctx(
+  utf8proc_context_t *context, const utf8proc_uint8_t *str, utf8proc_ssize_t strlen,
+  const utf8proc_int32_t **dstptr, utf8proc_option_t options,
+  utf8proc_custom_func custom_func, void *custom_data
+);
+
+/** NFD normalization (@ref UTF8PROC_DECOMPOSE). */
+UTF8PROC_DLLEXPORT const utf8proc_uint8_t *utf8proc_NFD_ctx(utf8proc_context_t *context, const utf8proc_uint8_t *str);
+/** NFC normalization (@ref UTF8PROC_COMPOSE). */
+UTF8PROC_DLLEXPORT const utf8proc_uint8_t *utf8proc_NFC_ctx(utf8proc_context_t *context, const utf8proc_uint8_t *str);
+/** NFKD normalization (@ref UTF8PROC_DECOMPOSE and @ref UTF8PROC_COMPAT). */
+UTF8PROC_DLLEXPORT const utf8proc_uint8_t *utf8proc_NFKD_ctx(utf8proc_context_t *context, const utf8proc_uint8_t *str);
+/** NFKC normalization (@ref UTF8PROC_COMPOSE and @ref UTF8PROC_COMPAT). */
+UTF8PROC_DLLEXPORT const utf8proc_uint8_t *utf8proc_NFKC_ctx(utf8proc_context_t *context, const utf8proc_uint8_t *str);
+/** NFKC_Casefold normalization (see @ref utf8proc_NFKC_Casefold). */
+UTF8PROC_DLLEXPORT const utf8proc_uint8_t *utf8proc_NFKC_Casefold_ctx(utf8proc_context_t *context, const utf8proc_uint8_t *str);
+/** @} */
+
+/** @name Instrumentation
+ *
+ * If utf8proc is compiled with `UTF8PROC_STATS` defined, the decomposition,
+ * normalization and mapping functions count what they do in thread-local
+ * counters, to tell from the outside where the time of a normalization
+ * goes (expansion, reordering, composition, the ASCII and quick-check
+ * shortcuts, ...).  Without it, nothing is counted and the counters stay
+ * zero.  Work done by the thread pool of @ref utf8proc_map_parallel is
+ * counted in the threads that run the tasks.
+ */
+/** @{ */
+/** Counters of the work done by the calling thread, see @ref utf8proc_stats_get. */
+typedef struct utf8proc_stats_struct {
+  /** UTF-8 bytes read by @ref utf8proc_decompose_custom and the utf8proc_map variants. */
+  utf8proc_uint64_t bytes_in;
+  /** UTF-8 bytes written by the utf8proc_map variants. */
+  utf8proc_uint64_t bytes_out;
+  /** Codepoints read (the ratio of `codepoints_out` to this is the expansion ratio). */
+  utf8proc_uint64_t codepoints_in;
+  /** Codepoints produced by decomposition, before composition. */
+  utf8proc_uint64_t codepoints_out;
+  /** Bytes passed through the bulk ASCII paths, without a per-codepoint lookup. */
+  utf8proc_uint64_t ascii_bytes;
+  /** Bytes copied unchanged because the quick check found them normalized. */
+  utf8proc_uint64_t quick_check_bytes;
+  /** Codepoints replaced by a decomposition or case folding sequence. */
+  utf8proc_uint64_t expansions;
+  /** Codepoints expanded codepoint by codepoint, because the precomputed
+      full decomposition does not apply to the options. */
+  utf8proc_uint64_t recursive_expansions;
+  /** Hangul syllables decomposed arithmetically. */
+  utf8proc_uint64_t hangul_decompositions;
+  /** Runs of combining marks that had to be sorted into canonical order. */
+  utf8proc_uint64_t reordered_runs;
+  /** Combining marks in those runs. */
+  utf8proc_uint64_t reordered_marks;
+  /** Pairs of a starter and a mark looked up in the composition table and found. */
+  utf8proc_uint64_t composition_hits;
+  /** Pairs looked up in the composition table and not found. */
+  utf8proc_uint64_t composition_misses;
+  /** Hangul jamo composed arithmetically. */
+  utf8proc_uint64_t hangul_compositions;
+  /** Windows of utf8proc_map() & friends whose composition pass was
+      skipped, as none of their codepoints composes with its predecessor. */
+  utf8proc_uint64_t compositions_skipped;
+  /** Strings rejected with @ref UTF8PROC_ERROR_INVALIDUTF8. */
+  utf8proc_uint64_t invalid_utf8;
+} utf8proc_stats_t;
+
+/**
+ * Copies the counters of the calling thread to `*stats`.  Returns 1 if
+ * utf8proc was compiled with `UTF8PROC_STATS`, and otherwise 0 (with all
+ * counters zero).
+ */
+UTF8PROC_DLLEXPORT utf8proc_bool utf8proc_stats_get(utf8proc_stats_t *stats);
+
+/** Sets all counters of the calling thread to zero. */
+UTF8PROC_DLLEXPORT void utf8proc_stats_reset(void);
+/** @} */
+
 /** @name Unicode normalization
  *
  * Returns a pointer to newly allocated memory of a NFD, NFC, NFKD, NFKC or
@@ -708,6 +1465,27 @@ UTF8PROC_DLLEXPORT utf8proc_uint8_t *utf8proc_NFKC(const utf8proc_uint8_t *str);
 UTF8PROC_DLLEXPORT utf8proc_uint8_t *utf8proc_NFKC_Casefold(const utf8proc_uint8_t *str);
 /** @} */
 
+/** @name Unicode normalization into a caller-owned buffer
+ *
+ * Write a NFD, NFC, NFKD, NFKC or NFKC_Casefold normalized version of the
+ * null-terminated string `str` into `buffer` (of `bufsize` bytes).  These are
+ * shortcuts to calling @ref utf8proc_map_buffer with the same flags as
+ * @ref utf8proc_NFD etcetera, and return the same values as
+ * @ref utf8proc_map_buffer.
+ */
+/** @{ */
+/** NFD normalization (@ref UTF8PROC_DECOMPOSE). */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_NFD_buffer(const utf8proc_uint8_t *str, utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize);
+/** NFC normalization (@ref UTF8PROC_COMPOSE). */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_NFC_buffer(const utf8proc_uint8_t *str, utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize);
+/** NFKD normalization (@ref UTF8PROC_DECOMPOSE and @ref UTF8PROC_COMPAT). */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_NFKD_buffer(const utf8proc_uint8_t *str, utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize);
+/** NFKC normalization (@ref UTF8PROC_COMPOSE and @ref UTF8PROC_COMPAT). */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_NFKC_buffer(const utf8proc_uint8_t *str, utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize);
+/** NFKC_Casefold normalization (see @ref utf8proc_NFKC_Casefold). */
+UTF8PROC_DLLEXPORT utf8proc_ssize_t utf8proc_NFKC_Casefold_buffer(const utf8proc_uint8_t *str, utf8proc_uint8_t *buffer, utf8proc_ssize_t bufsize);
+/** @} */
+
 #ifdef __cplusplus
 }
 #endif